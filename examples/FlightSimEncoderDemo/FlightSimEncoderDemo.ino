@@ -0,0 +1,35 @@
+#include <FlightSimSwitches.h>
+
+// always declare FlightSimSwitches first
+FlightSimSwitches switches;
+
+// Encoder A and B pins specified in object declaration,
+// common pin to GND
+FlightSimEncoder heading(2, 3);
+
+// Pins specified in setup()
+FlightSimEncoder altitude;
+
+void setup() {
+  delay(1000);
+  // heading bug: decode every edge in pin change interrupts
+  heading.setCommands(XPlaneRef("sim/autopilot/heading_up"),
+                      XPlaneRef("sim/autopilot/heading_down"));
+  heading.setInterrupts(true);
+
+  // turning faster than one detent per 50ms moves the bug 5 degrees per detent
+  heading.setAcceleration(50, 5);
+
+  // altitude selector on pins 4 and 5, decoded at the scan rate
+  altitude.setPositions(4, 5);
+  altitude.setCommands(XPlaneRef("sim/autopilot/altitude_up"),
+                       XPlaneRef("sim/autopilot/altitude_down"));
+
+  switches.setDebug(DEBUG_SWITCHES);
+  switches.begin();
+}
+
+void loop() {
+  FlightSim.update();
+  switches.loop();
+}
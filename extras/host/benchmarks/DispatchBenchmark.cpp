@@ -0,0 +1,120 @@
+#include <FlightSimSwitches.h>
+
+/*
+ * Dispatch time of four 8x8 matrices with 64 on/off switches each, like an
+ * overhead, pedestal, MIP and glareshield on one Teensy. Every matrix owns its
+ * elements, so a frame of one matrix costs the same whether the other matrices
+ * exist or not, and a frame with a single change dispatches a single element.
+ *
+ *   DispatchBenchmark [frames]
+ *
+ * Times are measured in real time on the host, with the library built with
+ * FLIGHTSIM_PROFILING. Exits with 1 if a frame sends the wrong commands.
+ *
+ * (c) Jorg Neves Bliesener
+ */
+
+#define NUMBER_OF_MATRICES   4
+#define ROWS                 8
+#define COLUMNS              8
+#define ELEMENTS             (ROWS * COLUMNS)
+#define FIRST_COLUMN_PIN     32
+
+// rows on pins 0..31, all matrices share the column pins 32..39
+FlightSimSwitchMatrix<ROWS, COLUMNS> matrices[NUMBER_OF_MATRICES] = {
+   { ROWS, SWITCH_PINS(0, 1, 2, 3, 4, 5, 6, 7), COLUMNS, SWITCH_PINS(32, 33, 34, 35, 36, 37, 38, 39), 2 },
+   { ROWS, SWITCH_PINS(8, 9, 10, 11, 12, 13, 14, 15), COLUMNS, SWITCH_PINS(32, 33, 34, 35, 36, 37, 38, 39), 2 },
+   { ROWS, SWITCH_PINS(16, 17, 18, 19, 20, 21, 22, 23), COLUMNS, SWITCH_PINS(32, 33, 34, 35, 36, 37, 38, 39), 2 },
+   { ROWS, SWITCH_PINS(24, 25, 26, 27, 28, 29, 30, 31), COLUMNS, SWITCH_PINS(32, 33, 34, 35, 36, 37, 38, 39), 2 }
+};
+
+FlightSimOnOffCommandSwitch *elements[NUMBER_OF_MATRICES][ELEMENTS];
+char names[NUMBER_OF_MATRICES][ELEMENTS][2][24];
+
+static bool failed = false;
+
+
+static void setSwitch(uint8_t matrix, uint8_t row, uint8_t column, bool closed)
+{
+   FlightSimHost::setSwitch(matrix * ROWS + row, FIRST_COLUMN_PIN + column, closed);
+}
+
+
+// runs the matrix until a complete frame was dispatched
+static void runFrame(FlightSimSwitchesBase& matrix)
+{
+   uint32_t frames = matrix.getFrameCount();
+   while (matrix.getFrameCount() == frames)
+   {
+      matrix.loop();
+      FlightSimHost::advanceMicros(100);
+   }
+}
+
+
+/*
+ * Runs frames of matrix 0, toggling changes switches per frame, and prints the
+ * dispatch time. Every frame must send one command per toggled switch.
+ */
+static void measure(const char *title, uint8_t changes, uint32_t frames)
+{
+   FlightSimSwitchesBase& matrix = matrices[0];
+   bool closed = false;
+
+   runFrame(matrix);
+   matrix.clearProfile();
+   for (uint32_t frame = 0; frame < frames; frame++)
+   {
+      closed = !closed;
+      for (uint8_t i = 0; i < changes; i++)
+      {
+         setSwitch(0, i / COLUMNS, i % COLUMNS, closed);
+      }
+      FlightSimHost::clearEvents();
+      runFrame(matrix);
+      if (FlightSimHost::getNumberOfEvents() != changes)
+      {
+         fprintf(stderr, "%s: frame %u sent %u commands, expected %u\n", title, (unsigned) frame,
+                 (unsigned) FlightSimHost::getNumberOfEvents(), changes);
+         failed = true;
+      }
+   }
+
+   FlightSimProfile profile;
+   matrix.getProfile(&profile);
+   printf("%-16s %8u frames, dispatch min/avg/max %6u/%6u/%6u ns\n", title, (unsigned) profile.frames,
+          (unsigned) profile.dispatchMin, (unsigned) profile.dispatchAvg, (unsigned) profile.dispatchMax);
+
+   for (uint8_t i = 0; i < changes; i++)
+   {
+      setSwitch(0, i / COLUMNS, i % COLUMNS, false);
+   }
+   runFrame(matrix);
+}
+
+
+int main(int argc, char **argv)
+{
+   uint32_t frames = (argc > 1) ? atoi(argv[1]) : 10000;
+
+   FlightSimHost::reset();
+   FlightSimHost::setSerialOutput(false);
+   for (uint8_t m = 0; m < NUMBER_OF_MATRICES; m++)
+   {
+      for (uint8_t i = 0; i < ELEMENTS; i++)
+      {
+         snprintf(names[m][i][0], sizeof(names[m][i][0]), "matrix%u/switch%u_on", m, i);
+         snprintf(names[m][i][1], sizeof(names[m][i][1]), "matrix%u/switch%u_off", m, i);
+         elements[m][i] = new FlightSimOnOffCommandSwitch(matrices[m], MATRIX(i / COLUMNS, i % COLUMNS));
+         elements[m][i]->setOnOffCommands(XPlaneRef(names[m][i][0]), XPlaneRef(names[m][i][1]));
+      }
+      matrices[m].setScanMode(SCAN_FULL_FRAME);
+      matrices[m].begin();
+   }
+
+   printf("%u matrices with %u elements each\n", NUMBER_OF_MATRICES, ELEMENTS);
+   measure("no change", 0, frames);
+   measure("one changed", 1, frames);
+   measure("all changed", ELEMENTS, frames);
+   return failed ? 1 : 0;
+}
@@ -0,0 +1,225 @@
+#ifndef _FLIGHTSIM_HOST_ARDUINO_H
+#define _FLIGHTSIM_HOST_ARDUINO_H
+
+/*
+ * Host (Linux) replacement of the Teensy core, as far as FlightSimSwitches and
+ * its examples need it. Time is virtual, pins are scriptable and everything sent
+ * to X-Plane is recorded, see FlightSimHost.h.
+ *
+ * (c) Jorg Neves Bliesener
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+
+#define FLIGHTSIM_INTERFACE  1
+#define FLIGHTSIM_HOST       1
+
+#define HIGH                 1
+#define LOW                  0
+#define INPUT                0
+#define OUTPUT               1
+#define INPUT_PULLUP         2
+#define INPUT_PULLDOWN       3
+
+#define BIN                  2
+#define OCT                  8
+#define DEC                  10
+#define HEX                  16
+
+#define constrain(amt, low, high)    ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+typedef uint8_t byte;
+typedef bool    boolean;
+
+// flash strings are plain strings on the host
+class __FlashStringHelper;
+#define F(string_literal)    ((const __FlashStringHelper *) (string_literal))
+#define PSTR(s)              (s)
+
+// time, virtual clock
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t msec);
+void delayMicroseconds(uint32_t usec);
+
+// cycle counter of the Teensy 3.x/4.x debug unit. Runs in real time (1 GHz) on
+// the host, so that profiling measures the code and not the virtual clock
+#define F_CPU_ACTUAL         1000000000
+#define ARM_DWT_CYCCNT       (hostCycleCount())
+uint32_t hostCycleCount();
+
+class elapsedMillis {
+public:
+   elapsedMillis()
+   {
+      ms = millis();
+   }
+
+   operator unsigned long() const
+   {
+      return millis() - ms;
+   }
+
+   elapsedMillis& operator=(unsigned long val)
+   {
+      ms = millis() - val;
+      return *this;
+   }
+
+private:
+   unsigned long ms;
+};
+
+class elapsedMicros {
+public:
+   elapsedMicros()
+   {
+      us = micros();
+   }
+
+   operator unsigned long() const
+   {
+      return micros() - us;
+   }
+
+   elapsedMicros& operator=(unsigned long val)
+   {
+      us = micros() - val;
+      return *this;
+   }
+
+private:
+   unsigned long us;
+};
+
+// periodic timer interrupt. Fires while the virtual clock advances, interrupts
+// do not nest: the clock advanced by a running interrupt does not fire timers
+class IntervalTimer {
+public:
+   IntervalTimer()
+   {
+      funct     = NULL;
+      period    = 0;
+      next      = 0;
+      nextTimer = NULL;
+   }
+
+   ~IntervalTimer()
+   {
+      end();
+   }
+
+   bool begin(void (*funct)(), uint32_t microseconds);
+   void end();
+
+   void priority(uint8_t n)
+   {
+   }
+
+private:
+   friend void runIntervalTimers(uint32_t until);
+
+   void (*funct)();
+   uint32_t period;
+   uint32_t next;                     // virtual time of the next interrupt
+   IntervalTimer *nextTimer;
+};
+
+// pins
+#define NUM_DIGITAL_PINS     64
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+// port input registers, see HostPorts.h
+#include "HostPorts.h"
+
+// pin change interrupts. Fire when setPin() or setSwitch() change the level of
+// an input pin
+#define FALLING              2
+#define RISING               3
+#define CHANGE               4
+
+#define digitalPinToInterrupt(p)     ((p) < NUM_DIGITAL_PINS ? (p) : -1)
+
+void attachInterrupt(uint8_t pin, void (*function)(), int mode);
+void detachInterrupt(uint8_t pin);
+
+// interrupts run when the virtual clock advances or a pin changes, never between
+// two instructions, so there is nothing to block
+inline void noInterrupts()
+{
+}
+
+inline void interrupts()
+{
+}
+
+// serial output goes to stdout
+class Stream {
+public:
+   void begin(uint32_t baud)
+   {
+   }
+
+   operator bool()
+   {
+      return true;
+   }
+
+   int available()
+   {
+      return 0;
+   }
+
+   int read()
+   {
+      return -1;
+   }
+
+   int availableForWrite()
+   {
+      return 4096;
+   }
+
+   size_t write(uint8_t b);
+   size_t write(const char *str);
+
+   size_t print(const char *str);
+   size_t print(const __FlashStringHelper *str);
+   size_t print(char c);
+   size_t print(int n, int base = DEC);
+   size_t print(unsigned int n, int base = DEC);
+   size_t print(long n, int base = DEC);
+   size_t print(unsigned long n, int base = DEC);
+   size_t print(double n, int digits = 2);
+
+   size_t println();
+   template <typename T>
+   size_t println(T value)
+   {
+      return print(value) + println();
+   }
+
+   template <typename T>
+   size_t println(T value, int format)
+   {
+      return print(value, format) + println();
+   }
+
+   int printf(const char *format, ...);
+   int printf(const __FlashStringHelper *format, ...);
+};
+
+extern Stream Serial;
+
+#include "FlightSimHost.h"
+
+#endif // _FLIGHTSIM_HOST_ARDUINO_H
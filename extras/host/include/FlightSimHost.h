@@ -0,0 +1,265 @@
+#ifndef _FLIGHTSIM_HOST_H
+#define _FLIGHTSIM_HOST_H
+
+/*
+ * Host (Linux) replacement of the Teensy Flight Sim Controls interface. Commands
+ * and dataref writes are not sent anywhere, but recorded with the virtual time,
+ * so that sketches and library changes can be run and measured off a Teensy.
+ *
+ * (c) Jorg Neves Bliesener
+ */
+
+#include <Arduino.h>
+
+class _XpRefStr_;
+#define XPlaneRef(s)         ((const _XpRefStr_ *) (s))
+
+// recorded event types
+#define HOST_COMMAND_ONCE    (0)
+#define HOST_COMMAND_BEGIN   (1)
+#define HOST_COMMAND_END     (2)
+#define HOST_WRITE_FLOAT     (3)
+#define HOST_WRITE_INTEGER   (4)
+
+struct FlightSimHostEvent {
+   uint32_t   time;                   // virtual time in microseconds
+   uint8_t    type;
+   const char *name;                  // command or dataref name, NULL if unassigned
+   float      value;                  // value written, 0 for commands
+};
+
+
+class FlightSimCommand {
+public:
+   FlightSimCommand();
+
+   void assign(const _XpRefStr_ *s)
+   {
+      name = (const char *) s;
+   }
+
+   FlightSimCommand& operator=(const _XpRefStr_ *s)
+   {
+      assign(s);
+      return *this;
+   }
+
+   void begin();
+   void end();
+   void once();
+
+   FlightSimCommand& operator=(int n)
+   {
+      n ? begin() : end();
+      return *this;
+   }
+
+   const char *getName()
+   {
+      return name;
+   }
+
+private:
+   const char *name;
+};
+
+
+class FlightSimFloat {
+public:
+   FlightSimFloat();
+   ~FlightSimFloat();
+
+   void assign(const _XpRefStr_ *s)
+   {
+      name = (const char *) s;
+   }
+
+   FlightSimFloat& operator=(const _XpRefStr_ *s)
+   {
+      assign(s);
+      return *this;
+   }
+
+   void write(float val);
+
+   FlightSimFloat& operator=(float n)
+   {
+      write(n);
+      return *this;
+   }
+
+   float read() const
+   {
+      return value;
+   }
+
+   operator float() const
+   {
+      return value;
+   }
+
+   void onChange(void (*fptr)(float))
+   {
+      change_callback = fptr;
+   }
+
+   const char *getName()
+   {
+      return name;
+   }
+
+private:
+   friend class FlightSimHost;
+   void update(float val);
+
+   const char *name;
+   float value;
+   void (*change_callback)(float);
+   FlightSimFloat *next;
+};
+
+
+class FlightSimInteger {
+public:
+   FlightSimInteger();
+   ~FlightSimInteger();
+
+   void assign(const _XpRefStr_ *s)
+   {
+      name = (const char *) s;
+   }
+
+   FlightSimInteger& operator=(const _XpRefStr_ *s)
+   {
+      assign(s);
+      return *this;
+   }
+
+   void write(long val);
+
+   FlightSimInteger& operator=(long n)
+   {
+      write(n);
+      return *this;
+   }
+
+   long read() const
+   {
+      return value;
+   }
+
+   operator long() const
+   {
+      return value;
+   }
+
+   void onChange(void (*fptr)(long))
+   {
+      change_callback = fptr;
+   }
+
+   const char *getName()
+   {
+      return name;
+   }
+
+private:
+   friend class FlightSimHost;
+   void update(long val);
+
+   const char *name;
+   long value;
+   void (*change_callback)(long);
+   FlightSimInteger *next;
+};
+
+
+class FlightSimClass {
+public:
+   bool isEnabled();
+   void update()
+   {
+   }
+};
+
+extern FlightSimClass FlightSim;
+
+
+/*
+ * Controls the simulated environment: virtual clock, pin levels, switches between
+ * two pins, the simulator state and the record of everything sent to X-Plane.
+ */
+class FlightSimHost {
+public:
+   // reset clock, pins, switches and the event record
+   static void reset();
+
+   // virtual clock. delay() and delayMicroseconds() advance it as well
+   static void setMicros(uint32_t usec);
+   static void advanceMicros(uint32_t usec);
+   static void advanceMillis(uint32_t msec);
+
+   // level read from an input pin that is not connected to a driven pin. Like
+   // setSwitch(), calls the interrupts attached to pins whose level changes
+   static void setPin(uint8_t pin, uint8_t level);
+   static uint8_t getPin(uint8_t pin);
+
+   // closes or opens a switch between two pins, e.g. a matrix row and column
+   static void setSwitch(uint8_t pin1, uint8_t pin2, bool closed);
+
+   // replaces the simulated pin levels for all digitalRead() calls
+   static void onDigitalRead(int (*fptr)(uint8_t pin))
+   {
+      digitalReadCallback = fptr;
+   }
+
+   // called after every digitalWrite(), e.g. for the clock of a simulated chip
+   static void onDigitalWrite(void (*fptr)(uint8_t pin, uint8_t val))
+   {
+      digitalWriteCallback = fptr;
+   }
+
+   // simulator state, FlightSim.isEnabled()
+   static void setEnabled(bool enabled);
+
+   // sets the value X-Plane reports for a dataref, calls onChange callbacks
+   static void setDataref(const char *name, float value);
+
+   // called for every recorded event, e.g. to let a command change a dataref
+   static void onEvent(void (*fptr)(const FlightSimHostEvent *event))
+   {
+      eventCallback = fptr;
+   }
+
+   static size_t getNumberOfEvents();
+   static const FlightSimHostEvent *getEvent(size_t index);
+   static void clearEvents();
+   static void printEvents(FILE *f);
+
+   static void setSerialOutput(bool enabled);
+
+   // called with everything printed to Serial, also while serial output is off
+   static void onSerialOutput(void (*fptr)(const char *text, size_t length))
+   {
+      serialCallback = fptr;
+   }
+
+private:
+   friend class FlightSimCommand;
+   friend class FlightSimFloat;
+   friend class FlightSimInteger;
+   friend int digitalRead(uint8_t pin);
+   friend void digitalWrite(uint8_t pin, uint8_t val);
+   friend class Stream;
+
+   static void record(uint8_t type, const char *name, float value);
+
+   static int (*digitalReadCallback)(uint8_t pin);
+   static void (*digitalWriteCallback)(uint8_t pin, uint8_t val);
+   static void (*eventCallback)(const FlightSimHostEvent *event);
+   static void (*serialCallback)(const char *text, size_t length);
+   static FlightSimFloat *firstFloat;
+   static FlightSimInteger *firstInteger;
+};
+
+#endif // _FLIGHTSIM_HOST_H
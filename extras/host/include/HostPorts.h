@@ -0,0 +1,40 @@
+#ifndef _FLIGHTSIM_HOST_PORTS_H
+#define _FLIGHTSIM_HOST_PORTS_H
+
+/*
+ * GPIO port input registers, modelled after the 32 bit ports of the Teensy 4, so
+ * that direct port reads (FLIGHTSIM_PORT_READ) run on the host. The registers
+ * follow the simulated pin levels, they are updated whenever a pin mode, output,
+ * input level or switch changes. Levels replaced with FlightSimHost::onDigitalRead()
+ * are seen by digitalRead() only.
+ *
+ * Every 16 pins share a port. The first 8 are wired in order to port bits 16..23,
+ * the next 8 in reverse order to bits 15..8, like the mix of neighbouring and
+ * scattered pins on a real board.
+ *
+ * (c) Jorg Neves Bliesener
+ */
+
+#include <stdint.h>
+
+#define HOST_NUMBER_OF_PORTS (NUM_DIGITAL_PINS / 16)
+
+extern volatile uint32_t hostPortRegisters[HOST_NUMBER_OF_PORTS];
+
+static inline volatile uint32_t *portInputRegister(uint8_t pin)
+{
+   return &hostPortRegisters[(pin / 16) % HOST_NUMBER_OF_PORTS];
+}
+
+// 0 for pins that do not exist, they cannot be read through a port
+static inline uint32_t digitalPinToBitMask(uint8_t pin)
+{
+   if (pin >= NUM_DIGITAL_PINS)
+   {
+      return 0;
+   }
+   uint8_t n = pin % 16;
+   return ((uint32_t) 1) << ((n < 8) ? 16 + n : 23 - n);
+}
+
+#endif // _FLIGHTSIM_HOST_PORTS_H
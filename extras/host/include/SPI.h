@@ -0,0 +1,84 @@
+#ifndef _FLIGHTSIM_HOST_SPI_H
+#define _FLIGHTSIM_HOST_SPI_H
+
+/*
+ * Host (Linux) replacement of the SPI library. Every transferred byte is passed
+ * to a callback that returns the byte received from the simulated device.
+ *
+ * (c) Jorg Neves Bliesener
+ */
+
+#include <Arduino.h>
+
+#define LSBFIRST             0
+#define MSBFIRST             1
+#define SPI_MODE0            0x00
+#define SPI_MODE1            0x04
+#define SPI_MODE2            0x08
+#define SPI_MODE3            0x0C
+
+class SPISettings {
+public:
+   SPISettings(uint32_t clock = 4000000, uint8_t bitOrder = MSBFIRST, uint8_t dataMode = SPI_MODE0)
+   {
+      this->clock    = clock;
+      this->bitOrder = bitOrder;
+      this->dataMode = dataMode;
+   }
+
+   uint32_t clock;
+   uint8_t bitOrder;
+   uint8_t dataMode;
+};
+
+class SPIClass {
+public:
+   SPIClass()
+   {
+      this->transferCallback = NULL;
+      this->transfers        = 0;
+   }
+
+   void begin()
+   {
+   }
+
+   void end()
+   {
+   }
+
+   void beginTransaction(SPISettings settings)
+   {
+      this->settings = settings;
+   }
+
+   void endTransaction()
+   {
+   }
+
+   uint8_t transfer(uint8_t data)
+   {
+      transfers++;
+      return transferCallback ? (*transferCallback)(data) : 0xff;
+   }
+
+   // host only: simulated device, returns the byte shifted in for data
+   void onTransfer(uint8_t (*fptr)(uint8_t data))
+   {
+      transferCallback = fptr;
+   }
+
+   uint32_t getTransfers()
+   {
+      return transfers;
+   }
+
+private:
+   SPISettings settings;
+   uint8_t (*transferCallback)(uint8_t data);
+   uint32_t transfers;
+};
+
+extern SPIClass SPI;
+
+#endif // _FLIGHTSIM_HOST_SPI_H
@@ -0,0 +1,69 @@
+#ifndef _FLIGHTSIM_HOST_WIRE_H
+#define _FLIGHTSIM_HOST_WIRE_H
+
+/*
+ * Host (Linux) replacement of the Wire (I2C) library. Every device is a plain
+ * register file with an auto-incrementing register pointer: the first byte
+ * written in a transmission sets the pointer, further bytes are stored, reads
+ * start at the pointer. Devices must be added before they answer.
+ *
+ * (c) Jorg Neves Bliesener
+ */
+
+#include <Arduino.h>
+
+#define HOST_I2C_DEVICES     8
+#define HOST_I2C_REGISTERS   32
+
+class TwoWire {
+public:
+   TwoWire();
+
+   void begin()
+   {
+   }
+
+   void setClock(uint32_t frequency)
+   {
+   }
+
+   void beginTransmission(uint8_t address);
+   size_t write(uint8_t data);
+   uint8_t endTransmission(bool sendStop = true);
+   uint8_t requestFrom(uint8_t address, uint8_t quantity, bool sendStop = true);
+   int available();
+   int read();
+
+   // host only: simulated devices
+   bool addDevice(uint8_t address);
+   void removeDevice(uint8_t address);
+   void setRegister(uint8_t address, uint8_t reg, uint8_t value);
+   uint8_t getRegister(uint8_t address, uint8_t reg);
+
+   uint32_t getTransactions()
+   {
+      return transactions;
+   }
+
+private:
+   struct Device {
+      uint8_t address;
+      bool    present;
+      uint8_t pointer;
+      uint8_t registers[HOST_I2C_REGISTERS];
+   };
+
+   Device *findDevice(uint8_t address);
+
+   Device devices[HOST_I2C_DEVICES];
+   Device *txDevice;
+   uint8_t txBytes;
+   uint8_t rxBuffer[HOST_I2C_REGISTERS];
+   uint8_t rxLength;
+   uint8_t rxPosition;
+   uint32_t transactions;
+};
+
+extern TwoWire Wire;
+
+#endif // _FLIGHTSIM_HOST_WIRE_H
@@ -0,0 +1,511 @@
+#include <Arduino.h>
+#include <chrono>
+
+/*
+ * Host (Linux) replacement of the Teensy core: virtual clock, simulated pins and
+ * serial output.
+ *
+ * (c) Jorg Neves Bliesener
+ */
+
+Stream Serial;
+
+static uint32_t hostMicros   = 0;
+static bool     serialOutput = true;
+
+// active interval timers
+static IntervalTimer *firstTimer = NULL;
+static bool          inInterrupt = false;
+
+// pin state
+static uint8_t  pinModes[NUM_DIGITAL_PINS];
+static uint8_t  pinOutputs[NUM_DIGITAL_PINS];
+static uint8_t  pinInputs[NUM_DIGITAL_PINS];
+static bool     pinDriven[NUM_DIGITAL_PINS];      // input level set through setPin()
+static uint64_t pinSwitches[NUM_DIGITAL_PINS];    // bit n: switch to pin n closed
+
+volatile uint32_t hostPortRegisters[HOST_NUMBER_OF_PORTS];
+
+// pin change interrupts
+static void     (*pinInterrupts[NUM_DIGITAL_PINS])();
+static uint8_t  pinInterruptModes[NUM_DIGITAL_PINS];
+
+int (*FlightSimHost::digitalReadCallback)(uint8_t pin) = NULL;
+void (*FlightSimHost::digitalWriteCallback)(uint8_t pin, uint8_t val) = NULL;
+void (*FlightSimHost::serialCallback)(const char *text, size_t length) = NULL;
+
+
+unsigned long millis()
+{
+   return hostMicros / 1000;
+}
+
+
+unsigned long micros()
+{
+   return hostMicros;
+}
+
+
+uint32_t hostCycleCount()
+{
+   return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+/*
+ * Advances the virtual clock to until, calling every timer interrupt that falls
+ * due on the way in time order
+ */
+void runIntervalTimers(uint32_t until)
+{
+   if (inInterrupt)
+   {
+      hostMicros = until;
+      return;
+   }
+
+   for (;;)
+   {
+      IntervalTimer *due = NULL;
+      for (IntervalTimer *timer = firstTimer; timer; timer = timer->nextTimer)
+      {
+         if (((int32_t) (timer->next - until) <= 0) && (!due || ((int32_t) (timer->next - due->next) < 0)))
+         {
+            due = timer;
+         }
+      }
+      if (!due)
+      {
+         break;
+      }
+
+      hostMicros  = due->next;
+      due->next  += due->period;
+      inInterrupt = true;
+      (*due->funct)();
+      inInterrupt = false;
+   }
+   hostMicros = until;
+}
+
+
+bool IntervalTimer::begin(void (*funct)(), uint32_t microseconds)
+{
+   if (!funct || !microseconds)
+   {
+      return false;
+   }
+
+   end();
+   this->funct     = funct;
+   this->period    = microseconds;
+   this->next      = hostMicros + microseconds;
+   this->nextTimer = firstTimer;
+   firstTimer      = this;
+   return true;
+}
+
+
+void IntervalTimer::end()
+{
+   for (IntervalTimer **timer = &firstTimer; *timer; timer = &(*timer)->nextTimer)
+   {
+      if (*timer == this)
+      {
+         *timer = nextTimer;
+         break;
+      }
+   }
+   nextTimer = NULL;
+}
+
+
+void delay(uint32_t msec)
+{
+   runIntervalTimers(hostMicros + msec * 1000);
+}
+
+
+void delayMicroseconds(uint32_t usec)
+{
+   runIntervalTimers(hostMicros + usec);
+}
+
+
+void FlightSimHost::setMicros(uint32_t usec)
+{
+   hostMicros = usec;
+}
+
+
+void FlightSimHost::advanceMicros(uint32_t usec)
+{
+   runIntervalTimers(hostMicros + usec);
+}
+
+
+void FlightSimHost::advanceMillis(uint32_t msec)
+{
+   runIntervalTimers(hostMicros + msec * 1000);
+}
+
+
+static void updatePorts();
+
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+   if (pin < NUM_DIGITAL_PINS)
+   {
+      pinModes[pin] = mode;
+      updatePorts();
+   }
+}
+
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+   if (pin < NUM_DIGITAL_PINS)
+   {
+      pinOutputs[pin] = val ? HIGH : LOW;
+      updatePorts();
+   }
+   if (FlightSimHost::digitalWriteCallback)
+   {
+      (*FlightSimHost::digitalWriteCallback)(pin, val ? HIGH : LOW);
+   }
+}
+
+
+/*
+ * An input reads the level of the output pins it is connected to through closed
+ * switches. Like in a matrix with diodes, an output that pulls against the pull
+ * resistor wins, so inactive rows do not hide the active one. Otherwise the input
+ * reads the level set through setPin() or its pull resistor. Chains of switches
+ * (ghosting in matrices without diodes) are not simulated.
+ */
+static uint8_t pinLevel(uint8_t pin)
+{
+   if (pin >= NUM_DIGITAL_PINS)
+   {
+      return LOW;
+   }
+
+   if (pinModes[pin] == OUTPUT)
+   {
+      return pinOutputs[pin];
+   }
+
+   uint8_t pull      = (pinModes[pin] == INPUT_PULLUP) ? HIGH : LOW;
+   bool    connected = false;
+   for (uint64_t switches = pinSwitches[pin]; switches; switches &= switches - 1)
+   {
+      uint8_t other = __builtin_ctzll(switches);
+      if (pinModes[other] == OUTPUT)
+      {
+         if (pinOutputs[other] != pull)
+         {
+            return pinOutputs[other];
+         }
+         connected = true;
+      }
+   }
+   if (connected)
+   {
+      return pull;
+   }
+
+   if (pinDriven[pin])
+   {
+      return pinInputs[pin];
+   }
+   return (pinModes[pin] == INPUT_PULLUP) ? HIGH : LOW;
+}
+
+
+int digitalRead(uint8_t pin)
+{
+   if (FlightSimHost::digitalReadCallback)
+   {
+      return (*FlightSimHost::digitalReadCallback)(pin);
+   }
+   return pinLevel(pin);
+}
+
+
+// copies the pin levels to the port input registers
+static void updatePorts()
+{
+   uint32_t ports[HOST_NUMBER_OF_PORTS] = { 0 };
+   for (uint8_t pin = 0; pin < NUM_DIGITAL_PINS; pin++)
+   {
+      if (pinLevel(pin))
+      {
+         ports[(pin / 16) % HOST_NUMBER_OF_PORTS] |= digitalPinToBitMask(pin);
+      }
+   }
+   for (uint8_t i = 0; i < HOST_NUMBER_OF_PORTS; i++)
+   {
+      hostPortRegisters[i] = ports[i];
+   }
+}
+
+
+void attachInterrupt(uint8_t pin, void (*function)(), int mode)
+{
+   if (pin < NUM_DIGITAL_PINS)
+   {
+      pinInterrupts[pin]     = function;
+      pinInterruptModes[pin] = mode;
+   }
+}
+
+
+void detachInterrupt(uint8_t pin)
+{
+   if (pin < NUM_DIGITAL_PINS)
+   {
+      pinInterrupts[pin] = NULL;
+   }
+}
+
+
+// levels of the pins with interrupts, read before a change
+static void readInterruptPins(uint8_t *levels)
+{
+   for (uint8_t pin = 0; pin < NUM_DIGITAL_PINS; pin++)
+   {
+      levels[pin] = pinInterrupts[pin] ? digitalRead(pin) : LOW;
+   }
+}
+
+
+// calls the interrupts of the pins whose level differs from levels
+static void runPinInterrupts(const uint8_t *levels)
+{
+   if (inInterrupt)
+   {
+      return;
+   }
+
+   for (uint8_t pin = 0; pin < NUM_DIGITAL_PINS; pin++)
+   {
+      if (!pinInterrupts[pin])
+      {
+         continue;
+      }
+      uint8_t level = digitalRead(pin);
+      if ((level == levels[pin]) || ((pinInterruptModes[pin] == RISING) && !level) || ((pinInterruptModes[pin] == FALLING) && level))
+      {
+         continue;
+      }
+      inInterrupt = true;
+      (*pinInterrupts[pin])();
+      inInterrupt = false;
+   }
+}
+
+
+void FlightSimHost::setPin(uint8_t pin, uint8_t level)
+{
+   if (pin < NUM_DIGITAL_PINS)
+   {
+      uint8_t levels[NUM_DIGITAL_PINS];
+      readInterruptPins(levels);
+      pinInputs[pin] = level ? HIGH : LOW;
+      pinDriven[pin] = true;
+      updatePorts();
+      runPinInterrupts(levels);
+   }
+}
+
+
+uint8_t FlightSimHost::getPin(uint8_t pin)
+{
+   if (pin >= NUM_DIGITAL_PINS)
+   {
+      return LOW;
+   }
+   return (pinModes[pin] == OUTPUT) ? pinOutputs[pin] : digitalRead(pin);
+}
+
+
+void FlightSimHost::setSwitch(uint8_t pin1, uint8_t pin2, bool closed)
+{
+   if ((pin1 >= NUM_DIGITAL_PINS) || (pin2 >= NUM_DIGITAL_PINS))
+   {
+      return;
+   }
+
+   uint8_t levels[NUM_DIGITAL_PINS];
+   readInterruptPins(levels);
+   if (closed)
+   {
+      pinSwitches[pin1] |= ((uint64_t) 1) << pin2;
+      pinSwitches[pin2] |= ((uint64_t) 1) << pin1;
+   }
+   else
+   {
+      pinSwitches[pin1] &= ~(((uint64_t) 1) << pin2);
+      pinSwitches[pin2] &= ~(((uint64_t) 1) << pin1);
+   }
+   updatePorts();
+   runPinInterrupts(levels);
+}
+
+
+void FlightSimHost::reset()
+{
+   hostMicros           = 0;
+   digitalReadCallback  = NULL;
+   digitalWriteCallback = NULL;
+   serialCallback       = NULL;
+   memset(pinModes, INPUT, sizeof(pinModes));
+   memset(pinOutputs, LOW, sizeof(pinOutputs));
+   memset(pinInputs, LOW, sizeof(pinInputs));
+   memset(pinDriven, 0, sizeof(pinDriven));
+   memset(pinSwitches, 0, sizeof(pinSwitches));
+   memset(pinInterrupts, 0, sizeof(pinInterrupts));
+   updatePorts();
+   setEnabled(true);
+   clearEvents();
+}
+
+
+void FlightSimHost::setSerialOutput(bool enabled)
+{
+   serialOutput = enabled;
+}
+
+
+/*
+ * Serial
+ */
+
+size_t Stream::write(uint8_t b)
+{
+   if (serialOutput)
+   {
+      fputc(b, stdout);
+   }
+   if (FlightSimHost::serialCallback)
+   {
+      char c = b;
+      (*FlightSimHost::serialCallback)(&c, 1);
+   }
+   return 1;
+}
+
+
+size_t Stream::write(const char *str)
+{
+   size_t len = strlen(str);
+   if (serialOutput)
+   {
+      fwrite(str, 1, len, stdout);
+   }
+   if (FlightSimHost::serialCallback)
+   {
+      (*FlightSimHost::serialCallback)(str, len);
+   }
+   return len;
+}
+
+
+size_t Stream::print(const char *str)
+{
+   return write(str);
+}
+
+
+size_t Stream::print(const __FlashStringHelper *str)
+{
+   return write((const char *) str);
+}
+
+
+size_t Stream::print(char c)
+{
+   return write((uint8_t) c);
+}
+
+
+size_t Stream::print(int n, int base)
+{
+   return print((long) n, base);
+}
+
+
+size_t Stream::print(unsigned int n, int base)
+{
+   return print((unsigned long) n, base);
+}
+
+
+size_t Stream::print(long n, int base)
+{
+   if ((n < 0) && (base == DEC))
+   {
+      return print('-') + print((unsigned long) -n, base);
+   }
+   return print((unsigned long) n, base);
+}
+
+
+size_t Stream::print(unsigned long n, int base)
+{
+   char buf[8 * sizeof(long) + 1];
+   char *str = &buf[sizeof(buf) - 1];
+
+   if (base < 2)
+   {
+      base = DEC;
+   }
+   *str = '\0';
+   do
+   {
+      char c = n % base;
+      n     /= base;
+      *--str = c < 10 ? c + '0' : c + 'A' - 10;
+   } while (n);
+   return write(str);
+}
+
+
+size_t Stream::print(double n, int digits)
+{
+   char buf[64];
+   snprintf(buf, sizeof(buf), "%.*f", digits, n);
+   return write(buf);
+}
+
+
+size_t Stream::println()
+{
+   return write("\n");
+}
+
+
+int Stream::printf(const char *format, ...)
+{
+   char    buf[256];
+   va_list args;
+   va_start(args, format);
+   int len = vsnprintf(buf, sizeof(buf), format, args);
+   va_end(args);
+   write(buf);
+   return len;
+}
+
+
+int Stream::printf(const __FlashStringHelper *format, ...)
+{
+   char    buf[256];
+   va_list args;
+   va_start(args, format);
+   int len = vsnprintf(buf, sizeof(buf), (const char *) format, args);
+   va_end(args);
+   write(buf);
+   return len;
+}
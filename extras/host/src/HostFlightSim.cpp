@@ -0,0 +1,212 @@
+#include <Arduino.h>
+#include <vector>
+
+/*
+ * Host (Linux) replacement of the Teensy Flight Sim Controls interface. Everything
+ * sent to X-Plane is recorded as a FlightSimHostEvent.
+ *
+ * (c) Jorg Neves Bliesener
+ */
+
+FlightSimClass FlightSim;
+
+static bool                            hostEnabled = true;
+static std::vector<FlightSimHostEvent> hostEvents;
+
+void (*FlightSimHost::eventCallback)(const FlightSimHostEvent *event) = NULL;
+FlightSimFloat   *FlightSimHost::firstFloat   = NULL;
+FlightSimInteger *FlightSimHost::firstInteger = NULL;
+
+
+bool FlightSimClass::isEnabled()
+{
+   return hostEnabled;
+}
+
+
+void FlightSimHost::setEnabled(bool enabled)
+{
+   hostEnabled = enabled;
+}
+
+
+void FlightSimHost::record(uint8_t type, const char *name, float value)
+{
+   FlightSimHostEvent event;
+
+   event.time  = micros();
+   event.type  = type;
+   event.name  = name;
+   event.value = value;
+   hostEvents.push_back(event);
+   if (eventCallback)
+   {
+      (*eventCallback)(&event);
+   }
+}
+
+
+size_t FlightSimHost::getNumberOfEvents()
+{
+   return hostEvents.size();
+}
+
+
+const FlightSimHostEvent *FlightSimHost::getEvent(size_t index)
+{
+   return (index < hostEvents.size()) ? &hostEvents[index] : NULL;
+}
+
+
+void FlightSimHost::clearEvents()
+{
+   hostEvents.clear();
+}
+
+
+void FlightSimHost::printEvents(FILE *f)
+{
+   static const char *types[] = { "once", "begin", "end", "float", "integer" };
+
+   for (size_t i = 0; i < hostEvents.size(); i++)
+   {
+      const FlightSimHostEvent *event = &hostEvents[i];
+      fprintf(f, "%10lu.%03lu %-7s %s", (unsigned long) event->time / 1000, (unsigned long) event->time % 1000,
+              types[event->type], event->name ? event->name : "(unassigned)");
+      if (event->type >= HOST_WRITE_FLOAT)
+      {
+         fprintf(f, " = %g", event->value);
+      }
+      fprintf(f, "\n");
+   }
+}
+
+
+void FlightSimHost::setDataref(const char *name, float value)
+{
+   for (FlightSimFloat *f = firstFloat; f; f = f->next)
+   {
+      if (f->name && !strcmp(f->name, name))
+      {
+         f->update(value);
+      }
+   }
+   for (FlightSimInteger *i = firstInteger; i; i = i->next)
+   {
+      if (i->name && !strcmp(i->name, name))
+      {
+         i->update((long) value);
+      }
+   }
+}
+
+
+/*
+ * Commands
+ */
+
+FlightSimCommand::FlightSimCommand()
+{
+   this->name = NULL;
+}
+
+
+void FlightSimCommand::begin()
+{
+   FlightSimHost::record(HOST_COMMAND_BEGIN, name, 0);
+}
+
+
+void FlightSimCommand::end()
+{
+   FlightSimHost::record(HOST_COMMAND_END, name, 0);
+}
+
+
+void FlightSimCommand::once()
+{
+   FlightSimHost::record(HOST_COMMAND_ONCE, name, 0);
+}
+
+
+/*
+ * Datarefs. Writes are recorded, the value read back only changes through
+ * FlightSimHost::setDataref(), like in X-Plane.
+ */
+
+FlightSimFloat::FlightSimFloat()
+{
+   this->name                = NULL;
+   this->value               = 0;
+   this->change_callback     = NULL;
+   this->next                = FlightSimHost::firstFloat;
+   FlightSimHost::firstFloat = this;
+}
+
+
+FlightSimFloat::~FlightSimFloat()
+{
+   for (FlightSimFloat **p = &FlightSimHost::firstFloat; *p; p = &(*p)->next)
+   {
+      if (*p == this)
+      {
+         *p = next;
+         break;
+      }
+   }
+}
+
+
+void FlightSimFloat::write(float val)
+{
+   FlightSimHost::record(HOST_WRITE_FLOAT, name, val);
+}
+
+
+void FlightSimFloat::update(float val)
+{
+   value = val;
+   if (change_callback)
+   {
+      (*change_callback)(val);
+   }
+}
+
+
+FlightSimInteger::FlightSimInteger()
+{
+   this->name                  = NULL;
+   this->value                 = 0;
+   this->change_callback       = NULL;
+   this->next                  = FlightSimHost::firstInteger;
+   FlightSimHost::firstInteger = this;
+}
+
+
+FlightSimInteger::~FlightSimInteger()
+{
+   for (FlightSimInteger **p = &FlightSimHost::firstInteger; *p; p = &(*p)->next)
+   {
+      if (*p == this)
+      {
+         *p = next;
+         break;
+      }
+   }
+}
+
+
+void FlightSimInteger::write(long val)
+{
+   FlightSimHost::record(HOST_WRITE_INTEGER, name, val);
+}
+
+
+void FlightSimInteger::update(long val)
+{
+   value = val;
+   if (change_callback)
+   {
+      (*change_callback)(val);
+   }
+}
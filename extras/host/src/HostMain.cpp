@@ -0,0 +1,37 @@
+#include <Arduino.h>
+
+/*
+ * Runs an Arduino sketch on the host: setup(), then loop() until the given
+ * virtual time has passed. Every loop() call advances the clock by the loop
+ * time, afterwards all recorded events are printed.
+ *
+ * Usage: <sketch> [run time in ms] [loop time in us]
+ *
+ * (c) Jorg Neves Bliesener
+ */
+
+#define DEFAULT_RUN_TIME     (1000)     // milliseconds
+#define DEFAULT_LOOP_TIME    (100)      // microseconds
+
+void setup();
+void loop();
+
+int main(int argc, char **argv)
+{
+   uint32_t runTime  = (argc > 1) ? strtoul(argv[1], NULL, 0) : DEFAULT_RUN_TIME;
+   uint32_t loopTime = (argc > 2) ? strtoul(argv[2], NULL, 0) : DEFAULT_LOOP_TIME;
+
+   FlightSimHost::reset();
+   setup();
+
+   uint32_t end = micros() + runTime * 1000;
+   while ((int32_t) (micros() - end) < 0)
+   {
+      loop();
+      FlightSimHost::advanceMicros(loopTime);
+   }
+
+   printf("\n%lu events in %lu ms:\n", (unsigned long) FlightSimHost::getNumberOfEvents(), (unsigned long) runTime);
+   FlightSimHost::printEvents(stdout);
+   return 0;
+}
@@ -0,0 +1,150 @@
+#include <Wire.h>
+#include <SPI.h>
+
+/*
+ * Host (Linux) replacement of the Wire and SPI libraries.
+ *
+ * (c) Jorg Neves Bliesener
+ */
+
+TwoWire  Wire;
+SPIClass SPI;
+
+
+TwoWire::TwoWire()
+{
+   memset(devices, 0, sizeof(devices));
+   this->txDevice     = NULL;
+   this->txBytes      = 0;
+   this->rxLength     = 0;
+   this->rxPosition   = 0;
+   this->transactions = 0;
+}
+
+
+TwoWire::Device *TwoWire::findDevice(uint8_t address)
+{
+   for (uint8_t i = 0; i < HOST_I2C_DEVICES; i++)
+   {
+      if (devices[i].present && (devices[i].address == address))
+      {
+         return &devices[i];
+      }
+   }
+   return NULL;
+}
+
+
+bool TwoWire::addDevice(uint8_t address)
+{
+   if (findDevice(address))
+   {
+      return true;
+   }
+   for (uint8_t i = 0; i < HOST_I2C_DEVICES; i++)
+   {
+      if (!devices[i].present)
+      {
+         memset(&devices[i], 0, sizeof(Device));
+         devices[i].address = address;
+         devices[i].present = true;
+         return true;
+      }
+   }
+   return false;
+}
+
+
+void TwoWire::removeDevice(uint8_t address)
+{
+   Device *device = findDevice(address);
+   if (device)
+   {
+      device->present = false;
+   }
+}
+
+
+void TwoWire::setRegister(uint8_t address, uint8_t reg, uint8_t value)
+{
+   Device *device = findDevice(address);
+   if (device && (reg < HOST_I2C_REGISTERS))
+   {
+      device->registers[reg] = value;
+   }
+}
+
+
+uint8_t TwoWire::getRegister(uint8_t address, uint8_t reg)
+{
+   Device *device = findDevice(address);
+   return (device && (reg < HOST_I2C_REGISTERS)) ? device->registers[reg] : 0;
+}
+
+
+void TwoWire::beginTransmission(uint8_t address)
+{
+   txDevice = findDevice(address);
+   txBytes  = 0;
+}
+
+
+size_t TwoWire::write(uint8_t data)
+{
+   if (!txDevice)
+   {
+      return 1;
+   }
+   if (txBytes++ == 0)
+   {
+      txDevice->pointer = data;
+   }
+   else
+   {
+      if (txDevice->pointer < HOST_I2C_REGISTERS)
+      {
+         txDevice->registers[txDevice->pointer] = data;
+      }
+      txDevice->pointer++;
+   }
+   return 1;
+}
+
+
+uint8_t TwoWire::endTransmission(bool sendStop)
+{
+   transactions++;
+   return txDevice ? 0 : 2;                        // 2: address NACK
+}
+
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity, bool sendStop)
+{
+   transactions++;
+   rxLength   = 0;
+   rxPosition = 0;
+
+   Device *device = findDevice(address);
+   if (!device)
+   {
+      return 0;
+   }
+   for ( ; (rxLength < quantity) && (rxLength < sizeof(rxBuffer)); rxLength++)
+   {
+      uint8_t reg = device->pointer++;
+      rxBuffer[rxLength] = (reg < HOST_I2C_REGISTERS) ? device->registers[reg] : 0;
+   }
+   return rxLength;
+}
+
+
+int TwoWire::available()
+{
+   return rxLength - rxPosition;
+}
+
+
+int TwoWire::read()
+{
+   return (rxPosition < rxLength) ? rxBuffer[rxPosition++] : -1;
+}
@@ -0,0 +1,162 @@
+#include <FlightSimTest.h>
+
+/*
+ * SCAN_BACKGROUND: the timer interrupt reads one row per scanRate ms and hands
+ * complete frames to loop(). A second timer changes the switches between two
+ * scans, every scan closes the same column in all rows, so a frame with rows
+ * of two scans shows up as rows that disagree. Every scan is either consumed by
+ * loop() or counted as an overrun, none is lost.
+ */
+
+#define ROWS                 4
+#define COLUMNS              4
+#define SCAN_TIME            (ROWS * 1000)  // us, scan rate 1 ms per row
+
+static const uint8_t rowPins[ROWS]       = { 2, 3, 4, 5 };
+static const uint8_t columnPins[COLUMNS] = { 10, 11, 12, 13 };
+
+FlightSimSwitchMatrix<ROWS, COLUMNS> switches(ROWS, rowPins, COLUMNS, columnPins, 1);
+FlightSimOnOffCommandSwitch *elements[COLUMNS];
+char names[COLUMNS][2][16];
+
+static IntervalTimer patternTimer;
+static uint32_t      generation = 0;
+static uint32_t      eventDelay = 0;
+
+
+// closes column generation % COLUMNS in all rows
+static void setPattern(uint32_t gen, bool closed)
+{
+   for (uint8_t row = 0; row < ROWS; row++)
+   {
+      FlightSimHost::setSwitch(rowPins[row], columnPins[gen % COLUMNS], closed);
+   }
+}
+
+
+static void nextPattern()
+{
+   setPattern(generation, false);
+   generation++;
+   setPattern(generation, true);
+}
+
+
+// keeps loop() busy while the scan goes on
+static void delayEvent(const FlightSimHostEvent *event)
+{
+   FlightSimHost::advanceMicros(eventDelay);
+}
+
+
+// column closed in all rows of the last frame, -1 if the rows disagree
+static int frameColumn()
+{
+   int column = -1;
+   for (uint8_t row = 0; row < ROWS; row++)
+   {
+      uint32_t closed = 0;
+      for (uint8_t c = 0; c < COLUMNS; c++)
+      {
+         closed |= switches.isOn(row, c) ? (1 << c) : 0;
+      }
+      if (__builtin_popcount(closed) != 1)
+      {
+         return -1;
+      }
+      if (row == 0)
+      {
+         column = __builtin_ctz(closed);
+      }
+      else if (column != __builtin_ctz(closed))
+      {
+         return -1;
+      }
+   }
+   return column;
+}
+
+
+// scans completed since begin() at time 0
+static uint32_t scans()
+{
+   return micros() / SCAN_TIME;
+}
+
+
+// loop() faster than the scan: every scan is consumed, in order
+static void testFastLoop()
+{
+   for (uint32_t step = 0; step < 400; step++)
+   {
+      uint32_t frames = switches.getFrameCount();
+      switches.loop();
+      if (switches.getFrameCount() != frames)
+      {
+         CHECK_EQUAL(frames + 1, switches.getFrameCount());
+         CHECK_EQUAL(frames % COLUMNS, frameColumn());
+      }
+      FlightSimHost::advanceMicros(500);
+   }
+   CHECK_EQUAL(0, switches.getOverruns());
+   CHECK_EQUAL(scans(), switches.getFrameCount());
+}
+
+
+/*
+ * loop() called at random times and kept busy by the dispatch, so that scans
+ * complete while loop() owns the last frame. Frames are complete, the scans
+ * loop() missed are overruns.
+ */
+static void testSlowLoop()
+{
+   uint32_t seed   = 1;
+   uint32_t frames = switches.getFrameCount();
+   eventDelay = 1500;
+   FlightSimHost::onEvent(delayEvent);
+   for (uint32_t step = 0; step < 400; step++)
+   {
+      switches.loop();
+      if (switches.getFrameCount() != frames)
+      {
+         frames = switches.getFrameCount();
+         CHECK(frameColumn() >= 0);
+      }
+      seed = seed * 1103515245 + 12345;
+      FlightSimHost::advanceMicros(200 + (seed >> 16) % 10000);
+   }
+
+   // consume the last scan
+   FlightSimHost::onEvent(NULL);
+   FlightSimHost::advanceMicros(SCAN_TIME - micros() % SCAN_TIME + 100);
+   switches.loop();
+   CHECK(frameColumn() >= 0);
+   CHECK(switches.getOverruns() > 0);
+   CHECK_EQUAL(scans(), switches.getFrameCount() + switches.getOverruns());
+}
+
+
+int main()
+{
+   FlightSimHost::reset();
+   FlightSimHost::setSerialOutput(false);
+   for (uint8_t c = 0; c < COLUMNS; c++)
+   {
+      snprintf(names[c][0], sizeof(names[c][0]), "column%u_on", c);
+      snprintf(names[c][1], sizeof(names[c][1]), "column%u_off", c);
+      elements[c] = new FlightSimOnOffCommandSwitch(switches, MATRIX(0, c));
+      elements[c]->setOnOffCommands(XPlaneRef(names[c][0]), XPlaneRef(names[c][1]));
+   }
+   setPattern(0, true);
+   switches.setScanMode(SCAN_BACKGROUND);
+   switches.begin();
+
+   // the pattern changes half way between the last row of a scan and the first
+   // row of the next one
+   FlightSimHost::advanceMicros(500);
+   patternTimer.begin(nextPattern, SCAN_TIME);
+
+   testFastLoop();
+   testSlowLoop();
+   return TEST_RESULT();
+}
@@ -0,0 +1,104 @@
+#include <FlightSimTest.h>
+
+/*
+ * Up/down switch whose dataref never follows: the commands are resent after a
+ * timeout that doubles on every retry, then the switch gives up, stops sending
+ * and polling until it is moved again.
+ */
+
+#define TIMEOUT              100
+#define RETRIES              3
+
+FlightSimSwitchMatrix<1, 3> switches(3, SWITCH_PINS(10, 11, 12), 2);
+FlightSimUpDownCommandSwitch selector(switches, 3, SWITCH_POSITIONS(MATRIX(0, 0), MATRIX(0, 1), MATRIX(0, 2)),
+                                      SWITCH_VALUES(0, 1, 2));
+
+
+// runs loop() for msec of virtual time
+static void runMillis(uint32_t msec)
+{
+   uint32_t start = micros();
+   while (micros() - start < msec * 1000)
+   {
+      switches.loop();
+      FlightSimHost::advanceMicros(100);
+   }
+}
+
+
+static void setPosition(uint8_t position)
+{
+   for (uint8_t i = 0; i < 3; i++)
+   {
+      FlightSimHost::setPin(10 + i, (i == position) ? LOW : HIGH);
+   }
+}
+
+
+static void testRetries()
+{
+   FlightSimHost::clearEvents();
+   setPosition(2);
+   runMillis(2000);
+
+   // the first command and one per retry, each after twice the last timeout
+   CHECK_EQUAL(1 + RETRIES, countEvents(HOST_COMMAND_ONCE, "selector_up"));
+   CHECK_EQUAL(0, countEvents(HOST_COMMAND_ONCE, "selector_down"));
+   uint32_t timeout = TIMEOUT;
+   for (size_t i = 1; i < FlightSimHost::getNumberOfEvents(); i++)
+   {
+      uint32_t interval = (FlightSimHost::getEvent(i)->time - FlightSimHost::getEvent(i - 1)->time) / 1000;
+      CHECK(interval > timeout);
+      CHECK(interval <= timeout + 10);
+      timeout *= 2;
+   }
+
+   CHECK(selector.isUnreachable());
+   CHECK_EQUAL(1, selector.getStalls());
+   CHECK_EQUAL(1 + RETRIES, selector.getCommandTimeouts());
+   CHECK(!selector.isPolling());
+
+   // given up: nothing more is sent
+   FlightSimHost::clearEvents();
+   runMillis(5000);
+   CHECK_EQUAL(0, FlightSimHost::getNumberOfEvents());
+}
+
+
+// moving the switch tracks the dataref again
+static void testRecovery()
+{
+   FlightSimHost::clearEvents();
+   setPosition(1);
+   runMillis(20);
+   CHECK_EQUAL(1, countEvents(HOST_COMMAND_ONCE, "selector_up"));
+   CHECK(!selector.isUnreachable());
+   CHECK(selector.isPolling());
+
+   FlightSimHost::setDataref("selector", 1);
+   runMillis(20);
+   CHECK(!selector.isPolling());
+   CHECK(!selector.isUnreachable());
+   CHECK_EQUAL(1, selector.getStalls());
+   CHECK_EQUAL(1, countEvents(HOST_COMMAND_ONCE, "selector_up"));
+}
+
+
+int main()
+{
+   FlightSimHost::reset();
+   FlightSimHost::setSerialOutput(false);
+   selector.setDatarefAndCommands(XPlaneRef("selector"), XPlaneRef("selector_up"), XPlaneRef("selector_down"));
+   selector.setMaxPendingCommands(1);
+   selector.setCommandTimeout(TIMEOUT);
+   selector.setCommandRetries(RETRIES);
+   FlightSimHost::setDataref("selector", 0);
+   setPosition(0);
+   switches.begin();
+   runMillis(20);
+   CHECK(!selector.isPolling());
+
+   testRetries();
+   testRecovery();
+   return TEST_RESULT();
+}
@@ -0,0 +1,147 @@
+#include <FlightSimTest.h>
+
+/*
+ * Debouncer traces: a bit changes after pressSamples (raw 1) or releaseSamples
+ * (raw 0) consecutive samples that differ from the debounced state, a bounce
+ * restarts the count. Each of the 32 bits counts on its own.
+ */
+
+// feeds trace (one character per sample, '1' pressed, '0' released) to bit 0 and
+// returns the debounced states as the same kind of string
+static void runTrace(FlightSimDebouncer& debouncer, const char *trace, char *result)
+{
+   uint32_t counters[DEBOUNCE_BITS] = { 0 };
+   uint32_t debounced = 0;
+   for ( ; *trace; trace++)
+   {
+      debounced = debouncer.debounce(*trace == '1', debounced, counters);
+      *result++ = (debounced & 1) ? '1' : '0';
+   }
+   *result = 0;
+}
+
+
+#define CHECK_TRACE(debouncer, trace, expected)                                     \
+   do                                                                               \
+   {                                                                                \
+      char result[64];                                                              \
+      runTrace(debouncer, trace, result);                                           \
+      testChecks++;                                                                 \
+      if (strcmp(result, expected))                                                 \
+      {                                                                             \
+         testFailures++;                                                            \
+         fprintf(stderr, "%s:%d: trace %s gives %s, expected %s\n", __FILE__,      \
+                 __LINE__, trace, result, expected);                                \
+      }                                                                             \
+   } while (0)
+
+
+static void testThresholds()
+{
+   FlightSimDebouncer debouncer;
+   CHECK(!debouncer.isActive());
+   CHECK_TRACE(debouncer, "0110100", "0110100");
+
+   debouncer.setSamples(3, 3);
+   CHECK(debouncer.isActive());
+   CHECK_TRACE(debouncer, "0111110000000", "0001111100000");
+   CHECK_TRACE(debouncer, "0110111101100111100000", "0000001111111111111000");
+
+   // press and release thresholds are independent
+   debouncer.setSamples(1, 4);
+   CHECK_TRACE(debouncer, "0100011000001", "0111111111001");
+   debouncer.setSamples(4, 1);
+   CHECK_TRACE(debouncer, "0111011110100", "0000000010000");
+}
+
+
+static void testMaxDelay()
+{
+   FlightSimDebouncer debouncer;
+
+   // a change is accepted after exactly the maximum number of samples
+   debouncer.setSamples(MAX_DEBOUNCE_SAMPLES, MAX_DEBOUNCE_SAMPLES);
+   CHECK_TRACE(debouncer, "11111111000000000", "00000011111111000");
+   CHECK_TRACE(debouncer, "111111011111110", "000000000000011");
+
+   // larger values are limited to the maximum, 0 to 1
+   debouncer.setSamples(100, 0);
+   CHECK_TRACE(debouncer, "1111111100", "0000001100");
+   debouncer.setSamples(0, 0);
+   CHECK(!debouncer.isActive());
+
+   // the counters do not wrap around on long bouncing
+   debouncer.setSamples(2, 2);
+   CHECK_TRACE(debouncer, "1010101010101010101011", "0000000000000000000001");
+}
+
+
+static void testVertical()
+{
+   FlightSimDebouncer debouncer;
+   debouncer.setSamples(2, 3);
+
+   uint32_t counters[DEBOUNCE_BITS] = { 0 };
+   uint32_t debounced = 0;
+   debounced = debouncer.debounce(0xff00ff00, debounced, counters);
+   CHECK_EQUAL(0, debounced);
+   debounced = debouncer.debounce(0x0f00ff0f, debounced, counters);
+   CHECK_EQUAL(0x0f00ff00, debounced);
+
+   // released bits need three samples, the new ones two
+   debounced = debouncer.debounce(0x0000000f, debounced, counters);
+   CHECK_EQUAL(0x0f00ff0f, debounced);
+   debounced = debouncer.debounce(0x0000000f, debounced, counters);
+   CHECK_EQUAL(0x0f00ff0f, debounced);
+   debounced = debouncer.debounce(0x0000000f, debounced, counters);
+   CHECK_EQUAL(0x0000000f, debounced);
+}
+
+
+// runs the matrix until a complete frame was published
+template<class Matrix> static void runFrame(Matrix& switches)
+{
+   uint32_t frames = switches.getFrameCount();
+   while (switches.getFrameCount() == frames)
+   {
+      switches.loop();
+      FlightSimHost::advanceMicros(100);
+   }
+}
+
+
+// the matrix publishes a press after pressSamples frames
+static void testMatrix()
+{
+   FlightSimSwitchMatrix<2, 2> switches(2, SWITCH_PINS(2, 3), 2, SWITCH_PINS(10, 11), 2);
+   switches.setScanMode(SCAN_FULL_FRAME);
+   switches.setDebounce(3, 2);
+   switches.begin();
+   runFrame(switches);
+
+   FlightSimHost::setSwitch(3, 11, true);
+   for (int frame = 1; frame <= 3; frame++)
+   {
+      runFrame(switches);
+      CHECK_EQUAL(frame >= 3, switches.isOn(1, 1));
+   }
+   FlightSimHost::setSwitch(3, 11, false);
+   for (int frame = 1; frame <= 2; frame++)
+   {
+      runFrame(switches);
+      CHECK_EQUAL(frame < 2, switches.isOn(1, 1));
+   }
+   CHECK(!switches.isOn(0, 0));
+}
+
+
+int main()
+{
+   FlightSimHost::reset();
+   FlightSimHost::setSerialOutput(false);
+   testThresholds();
+   testMaxDelay();
+   testVertical();
+   testMatrix();
+   return TEST_RESULT();
+}
@@ -0,0 +1,113 @@
+#include <FlightSimTest.h>
+
+/*
+ * Dispatch: a frame calls the owners of the cells that changed and the elements
+ * that poll, nothing else. Elements without positions are called every frame.
+ */
+
+#define COLUMNS              4
+
+FlightSimSwitchMatrix<1, COLUMNS> switches(COLUMNS, SWITCH_PINS(10, 11, 12, 13), 2);
+CountingElement *elements[COLUMNS];
+CountingElement *sharing;                   // on the cell of elements[2]
+CountingElement *unpositioned;
+
+
+static void runFrame()
+{
+   uint32_t frames = switches.getFrameCount();
+   while (switches.getFrameCount() == frames)
+   {
+      switches.loop();
+      FlightSimHost::advanceMicros(100);
+   }
+}
+
+
+static void clearCalls()
+{
+   for (uint8_t i = 0; i < COLUMNS; i++)
+   {
+      elements[i]->calls = 0;
+   }
+   sharing->calls      = 0;
+   unpositioned->calls = 0;
+}
+
+
+static void testUnchanged()
+{
+   clearCalls();
+   for (int i = 0; i < 10; i++)
+   {
+      runFrame();
+   }
+   for (uint8_t i = 0; i < COLUMNS; i++)
+   {
+      CHECK_EQUAL(0, elements[i]->calls);
+   }
+   CHECK_EQUAL(0, sharing->calls);
+   CHECK_EQUAL(10, unpositioned->calls);
+}
+
+
+static void testChanged()
+{
+   clearCalls();
+   FlightSimHost::setPin(12, LOW);
+   runFrame();
+   runFrame();
+   FlightSimHost::setPin(12, HIGH);
+   runFrame();
+   runFrame();
+   CHECK_EQUAL(0, elements[0]->calls);
+   CHECK_EQUAL(0, elements[1]->calls);
+   CHECK_EQUAL(2, elements[2]->calls);
+   CHECK_EQUAL(2, sharing->calls);
+   CHECK_EQUAL(0, elements[3]->calls);
+}
+
+
+static void testPolling()
+{
+   clearCalls();
+   elements[1]->setPolling(true);
+   for (int i = 0; i < 5; i++)
+   {
+      runFrame();
+   }
+   CHECK_EQUAL(5, elements[1]->calls);
+   CHECK_EQUAL(0, elements[0]->calls);
+
+   elements[1]->setPolling(false);
+   clearCalls();
+   runFrame();
+   CHECK_EQUAL(0, elements[1]->calls);
+}
+
+
+int main()
+{
+   FlightSimHost::reset();
+   FlightSimHost::setSerialOutput(false);
+   for (uint8_t i = 0; i < COLUMNS; i++)
+   {
+      elements[i] = new CountingElement(switches, MATRIX(0, i));
+   }
+   sharing      = new CountingElement(switches, MATRIX(0, 2));
+   unpositioned = new CountingElement(switches, NO_POSITION);
+   switches.begin();
+
+   // the first frame evaluates everything
+   runFrame();
+   for (uint8_t i = 0; i < COLUMNS; i++)
+   {
+      CHECK(elements[i]->calls >= 1);
+   }
+   runFrame();
+
+   testUnchanged();
+   testChanged();
+   testPolling();
+   return TEST_RESULT();
+}
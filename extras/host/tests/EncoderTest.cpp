@@ -0,0 +1,162 @@
+#include <FlightSimTest.h>
+
+/*
+ * Encoder A/B traces. A trace is a string of pin states, one digit per step:
+ * (A << 1) | B, with both pins HIGH (open) at the detent. "31023" turns one
+ * detent up, "32013" one detent down.
+ */
+
+#define UP_TRACE             "31023"
+#define DOWN_TRACE           "32013"
+
+FlightSimSwitches switches;
+FlightSimSwitches spareSwitches;
+
+#define FAST_PINS            2, 3
+#define SLOW_PINS            4, 5
+
+FlightSimEncoder fast(switches, FAST_PINS);
+FlightSimEncoder slow(switches, SLOW_PINS);
+
+
+static void runTrace(uint8_t pinA, uint8_t pinB, const char *trace)
+{
+   for ( ; *trace; trace++)
+   {
+      FlightSimHost::setPin(pinA, (*trace - '0') & 2 ? HIGH : LOW);
+      FlightSimHost::setPin(pinB, (*trace - '0') & 1 ? HIGH : LOW);
+   }
+}
+
+
+static void runFrame()
+{
+   uint32_t frames = switches.getFrameCount();
+   while (switches.getFrameCount() == frames)
+   {
+      switches.loop();
+      FlightSimHost::advanceMicros(100);
+   }
+}
+
+
+// one trace step per frame, the scan rate sampling every state
+static void runSlowTrace(uint8_t pinA, uint8_t pinB, const char *trace)
+{
+   char step[2] = { 0, 0 };
+   for ( ; *trace; trace++)
+   {
+      step[0] = *trace;
+      runTrace(pinA, pinB, step);
+      runFrame();
+   }
+}
+
+
+// deleted encoders give their interrupt slots back
+static void testSlots()
+{
+   FlightSimEncoder *encoders[MAX_INTERRUPT_ENCODERS];
+   for (uint8_t i = 0; i < MAX_INTERRUPT_ENCODERS; i++)
+   {
+      encoders[i] = new FlightSimEncoder(spareSwitches, 20 + 2 * i, 21 + 2 * i);
+      encoders[i]->setInterrupts(true);
+   }
+   spareSwitches.begin();
+   for (uint8_t i = 0; i < MAX_INTERRUPT_ENCODERS; i++)
+   {
+      delete encoders[i];
+   }
+
+   // the interrupts are detached
+   FlightSimHost::setPin(20, LOW);
+   FlightSimHost::setPin(21, LOW);
+}
+
+
+// every edge is decoded, however many between two frames
+static void testInterrupts()
+{
+   FlightSimHost::clearEvents();
+   runTrace(FAST_PINS, UP_TRACE UP_TRACE UP_TRACE);
+   runFrame();
+   CHECK_EQUAL(3, countEvents(HOST_COMMAND_ONCE, "fast_up"));
+   CHECK_EQUAL(3, fast.getValue());
+
+   runTrace(FAST_PINS, DOWN_TRACE DOWN_TRACE);
+   runFrame();
+   CHECK_EQUAL(2, countEvents(HOST_COMMAND_ONCE, "fast_down"));
+   CHECK_EQUAL(1, fast.getValue());
+
+   // contact bounce on A is decoded forth and back
+   runTrace(FAST_PINS, "3101023");
+   runFrame();
+   CHECK_EQUAL(4, countEvents(HOST_COMMAND_ONCE, "fast_up"));
+   CHECK_EQUAL(2, fast.getValue());
+
+   // half a detent is kept for the next frame
+   runTrace(FAST_PINS, "310");
+   runFrame();
+   CHECK_EQUAL(2, fast.getValue());
+   runTrace(FAST_PINS, "23");
+   runFrame();
+   CHECK_EQUAL(3, fast.getValue());
+   CHECK_EQUAL(5, countEvents(HOST_COMMAND_ONCE, "fast_up"));
+}
+
+
+// sampled once per frame: a detent within one frame is lost
+static void testScanRate()
+{
+   FlightSimHost::clearEvents();
+   runSlowTrace(SLOW_PINS, UP_TRACE DOWN_TRACE DOWN_TRACE);
+   CHECK_EQUAL(1, countEvents(HOST_COMMAND_ONCE, "slow_up"));
+   CHECK_EQUAL(2, countEvents(HOST_COMMAND_ONCE, "slow_down"));
+   CHECK_EQUAL(-1, slow.getValue());
+
+   runTrace(SLOW_PINS, UP_TRACE);
+   runFrame();
+   CHECK_EQUAL(-1, slow.getValue());
+
+   // both signals changed between two frames: counted, decoded as no step
+   runSlowTrace(SLOW_PINS, "03");
+   CHECK_EQUAL(2, slow.getMissedSteps());
+   CHECK_EQUAL(-1, slow.getValue());
+   CHECK_EQUAL(0, fast.getMissedSteps());
+}
+
+
+// relative: the resync sends nothing
+static void testResync()
+{
+   FlightSimHost::setEnabled(false);
+   runFrame();
+   runFrame();
+   FlightSimHost::setEnabled(true);
+   FlightSimHost::clearEvents();
+   runFrame();
+   CHECK_EQUAL(0, FlightSimHost::getNumberOfEvents());
+
+   runTrace(FAST_PINS, UP_TRACE);
+   runFrame();
+   CHECK_EQUAL(1, countEvents(HOST_COMMAND_ONCE, "fast_up"));
+}
+
+
+int main()
+{
+   FlightSimHost::reset();
+   FlightSimHost::setSerialOutput(false);
+   testSlots();
+
+   fast.setCommands(XPlaneRef("fast_up"), XPlaneRef("fast_down"));
+   fast.setInterrupts(true);
+   slow.setCommands(XPlaneRef("slow_up"), XPlaneRef("slow_down"));
+   switches.begin();
+   runFrame();
+
+   testInterrupts();
+   testScanRate();
+   testResync();
+   return TEST_RESULT();
+}
@@ -0,0 +1,134 @@
+#include <FlightSimTest.h>
+
+/*
+ * Switch event ring: events come out in order, events that do not fit are
+ * counted as overflows, and the free running 16 bit head and tail wrap around.
+ * A matrix records every transition it reads.
+ */
+
+FlightSimSwitchMatrix<2, 3> switches(2, SWITCH_PINS(2, 3), 3, SWITCH_PINS(10, 11, 12), 2);
+
+
+static void testOverflow()
+{
+   FlightSimEventBuffer<8> ring;
+   for (uint16_t i = 0; i < 11; i++)
+   {
+      CHECK_EQUAL(i < 8, ring.push(i % 2, i, i & 1, 1000 + i));
+   }
+   CHECK_EQUAL(8, ring.available());
+   CHECK_EQUAL(3, ring.getOverflows());
+
+   FlightSimSwitchEvent event;
+   for (uint16_t i = 0; i < 8; i++)
+   {
+      CHECK(ring.pop(&event));
+      CHECK_EQUAL(i, event.column);
+      CHECK_EQUAL(i % 2, event.row);
+      CHECK_EQUAL(i & 1, event.state);
+      CHECK_EQUAL(1000 + i, event.time);
+   }
+   CHECK(!ring.pop(&event));
+   CHECK_EQUAL(0, ring.available());
+
+   // room again
+   CHECK(ring.push(0, 0, true, 0));
+   CHECK_EQUAL(3, ring.getOverflows());
+}
+
+
+// more than 65536 events: head and tail wrap, full and empty still tell apart
+static void testWraparound()
+{
+   FlightSimEventBuffer<4> ring;
+   FlightSimSwitchEvent event;
+   bool inOrder = true;
+   for (uint32_t i = 0; i < 70000; i++)
+   {
+      ring.push(0, i & 0xFFFF, true, i);
+      inOrder = inOrder && ring.pop(&event) && (event.time == i);
+      if (i == 65533)
+      {
+         // head and tail at 65534: fill across the wrap
+         for (uint16_t j = 0; j < 4; j++)
+         {
+            CHECK(ring.push(1, j, false, j));
+         }
+         CHECK(!ring.push(1, 4, false, 4));
+         CHECK_EQUAL(4, ring.available());
+         for (uint16_t j = 0; j < 4; j++)
+         {
+            CHECK(ring.pop(&event));
+            CHECK_EQUAL(j, event.column);
+         }
+         CHECK_EQUAL(0, ring.available());
+      }
+   }
+   CHECK(inOrder);
+   CHECK_EQUAL(1, ring.getOverflows());
+   CHECK(!ring.pop(&event));
+}
+
+
+static void runFrame()
+{
+   uint32_t frames = switches.getFrameCount();
+   while (switches.getFrameCount() == frames)
+   {
+      switches.loop();
+      FlightSimHost::advanceMicros(100);
+   }
+}
+
+
+// a scan records each transition with its cell and the time the row was read
+static void testScan()
+{
+   FlightSimEventBuffer<16> ring;
+   FlightSimSwitchEvent event;
+   switches.setEventBuffer(ring);
+   switches.begin();
+   runFrame();
+   CHECK_EQUAL(0, ring.available());
+
+   uint32_t changed = micros();
+   FlightSimHost::setSwitch(2, 11, true);
+   FlightSimHost::setSwitch(3, 12, true);
+   runFrame();
+   runFrame();
+   CHECK_EQUAL(2, ring.available());
+   CHECK(ring.pop(&event));
+   CHECK_EQUAL(0, event.row);
+   CHECK_EQUAL(1, event.column);
+   CHECK(event.state);
+   CHECK(event.time >= changed);
+   uint32_t first = event.time;
+   CHECK(ring.pop(&event));
+   CHECK_EQUAL(1, event.row);
+   CHECK_EQUAL(2, event.column);
+   CHECK(event.state);
+   CHECK(event.time > first);
+   CHECK(event.time <= micros());
+
+   FlightSimHost::setSwitch(2, 11, false);
+   runFrame();
+   runFrame();
+   CHECK_EQUAL(1, ring.available());
+   CHECK(ring.pop(&event));
+   CHECK_EQUAL(0, event.row);
+   CHECK_EQUAL(1, event.column);
+   CHECK(!event.state);
+   CHECK_EQUAL(0, ring.getOverflows());
+   switches.setEventBuffer(NULL);
+}
+
+
+int main()
+{
+   FlightSimHost::reset();
+   FlightSimHost::setSerialOutput(false);
+   testOverflow();
+   testWraparound();
+   testScan();
+   return TEST_RESULT();
+}
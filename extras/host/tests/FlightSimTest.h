@@ -0,0 +1,103 @@
+#ifndef _FLIGHTSIM_TEST_H
+#define _FLIGHTSIM_TEST_H
+
+/*
+ * Minimal checks for the host tests. A failed check prints its location and
+ * the test continues, TEST_RESULT() is the exit code for ctest.
+ *
+ * (c) Jorg Neves Bliesener
+ */
+
+#include <FlightSimSwitches.h>
+
+static int testChecks   = 0;
+static int testFailures = 0;
+
+#define CHECK(condition)                                                              \
+   do                                                                                 \
+   {                                                                                  \
+      testChecks++;                                                                   \
+      if (!(condition))                                                               \
+      {                                                                               \
+         testFailures++;                                                              \
+         fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+      }                                                                               \
+   } while (0)
+
+#define CHECK_EQUAL(expected, actual)                                                 \
+   do                                                                                 \
+   {                                                                                  \
+      testChecks++;                                                                   \
+      long long e = (long long) (expected);                                           \
+      long long a = (long long) (actual);                                             \
+      if (e != a)                                                                     \
+      {                                                                               \
+         testFailures++;                                                              \
+         fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__,    \
+                 #actual, a, e);                                                      \
+      }                                                                               \
+   } while (0)
+
+#define TEST_RESULT()                                                                 \
+   (printf("%d checks, %d failed\n", testChecks, testFailures), testFailures ? 1 : 0)
+
+// number of recorded events of a type and name (NULL: any name)
+static inline size_t countEvents(uint8_t type, const char *name = NULL)
+{
+   size_t count = 0;
+   for (size_t i = 0; i < FlightSimHost::getNumberOfEvents(); i++)
+   {
+      const FlightSimHostEvent *event = FlightSimHost::getEvent(i);
+      if ((event->type == type) && (!name || (event->name && !strcmp(event->name, name))))
+      {
+         count++;
+      }
+   }
+   return count;
+}
+
+
+// element on one position that counts its dispatches. With NO_POSITION it has
+// no positions, like elements that do not read the matrix
+class CountingElement : public MatrixElement {
+public:
+   CountingElement(FlightSimSwitchesBase& matrix, uint32_t position) : MatrixElement(matrix)
+   {
+      this->position = position;
+      this->calls    = 0;
+      this->resyncs  = 0;
+   }
+
+   using MatrixElement::setPolling;
+
+   virtual float getValue()
+   {
+      return getPositionData(position);
+   }
+
+   uint32_t calls;                       // handleLoop(), resyncs included
+   uint32_t resyncs;
+
+protected:
+   virtual void handleLoop(bool resync)
+   {
+      calls++;
+      resyncs += resync;
+   }
+
+   virtual uint32_t getDebugMask()
+   {
+      return 0;
+   }
+
+   virtual size_t getPositions(const uint32_t **positions)
+   {
+      *positions = &position;
+      return (position == NO_POSITION) ? 0 : 1;
+   }
+
+private:
+   uint32_t position;
+};
+
+#endif // _FLIGHTSIM_TEST_H
@@ -0,0 +1,168 @@
+#include <FlightSimTest.h>
+
+/*
+ * Storage planes: a matrix only keeps row data and changed cells by default.
+ * SCAN_ROW_BY_ROW then updates rows as they are read, with setFrameSnapshot()
+ * the rows are published together when the frame is complete. Elements are
+ * dispatched after the last row either way, but the rows of a frame are read one
+ * scan period apart unless the matrix scans SCAN_FULL_FRAME.
+ */
+
+
+// with a scan rate of 1, every other millisecond reads the next row
+static void runRow(FlightSimSwitchesBase& switches)
+{
+   FlightSimHost::advanceMillis(2);
+   switches.loop();
+}
+
+
+static void testRows(bool frameSnapshot)
+{
+   FlightSimHost::reset();
+   FlightSimSwitchMatrix<2, 2> switches(2, SWITCH_PINS(2, 3), 2, SWITCH_PINS(10, 11), 1);
+   switches.setFrameSnapshot(frameSnapshot);
+   switches.begin();
+   runRow(switches);
+   runRow(switches);
+   uint32_t frames = switches.getFrameCount();
+
+   FlightSimHost::setSwitch(2, 10, true);
+   FlightSimHost::setSwitch(3, 11, true);
+   runRow(switches);
+   CHECK_EQUAL(frames, switches.getFrameCount());
+   CHECK_EQUAL(!frameSnapshot, switches.isOn(0, 0));
+   CHECK(!switches.isOn(1, 1));
+
+   runRow(switches);
+   CHECK_EQUAL(frames + 1, switches.getFrameCount());
+   CHECK(switches.isOn(0, 0));
+   CHECK(switches.isOn(1, 1));
+   CHECK(switches.isChanged(0, 0));
+   CHECK(switches.isChanged(1, 1));
+   CHECK(!switches.isChanged(0, 1));
+
+   // the changes belong to the last complete frame until the next one
+   runRow(switches);
+   runRow(switches);
+   CHECK(!switches.isChanged(0, 0));
+   CHECK(!switches.isChanged(1, 1));
+   CHECK(switches.isOn(0, 0));
+
+   // without debouncer, raw data is the debounced data
+   CHECK(switches.isRawOn(1, 1));
+   CHECK(switches.getRawRowData() == switches.getRowData());
+}
+
+
+// a two row rotary switch is evaluated on complete frames only
+static const uint32_t selectorPositions[] = { MATRIX(0, 0), MATRIX(0, 1), MATRIX(1, 0) };
+static const float    selectorValues[]    = { 0, 1, 2 };
+
+static void testElement(bool frameSnapshot)
+{
+   FlightSimHost::reset();
+   FlightSimHost::setSerialOutput(false);
+   FlightSimSwitchMatrix<2, 2> switches(2, SWITCH_PINS(2, 3), 2, SWITCH_PINS(10, 11), 1);
+   FlightSimWriteDatarefSwitch selector(switches, 3, selectorPositions, selectorValues);
+   selector = XPlaneRef("selector");
+   switches.setFrameSnapshot(frameSnapshot);
+   switches.begin();
+   FlightSimHost::setSwitch(2, 10, true);
+   for (int i = 0; i < 4; i++)
+   {
+      runRow(switches);
+   }
+
+   // move from position 0 (row 0) to position 2 (row 1)
+   FlightSimHost::clearEvents();
+   FlightSimHost::setSwitch(2, 10, false);
+   FlightSimHost::setSwitch(3, 10, true);
+   for (int i = 0; i < 4; i++)
+   {
+      runRow(switches);
+   }
+   CHECK_EQUAL(1, countEvents(HOST_WRITE_FLOAT, "selector"));
+   CHECK(FlightSimHost::getEvent(0)->value == 2);
+}
+
+
+// a rotary switch moved between the reads of its two rows
+static const uint32_t skewPositions[] = { MATRIX(0, 0), MATRIX(1, 0) };
+static const float    skewValues[]    = { 0, 1 };
+
+static void testSkew(uint8_t scanMode)
+{
+   FlightSimHost::reset();
+   FlightSimHost::setSerialOutput(false);
+   FlightSimSwitchMatrix<2, 1> switches(2, SWITCH_PINS(2, 3), 1, SWITCH_PINS(10), 1);
+   FlightSimWriteDatarefSwitch selector(switches, 2, skewPositions, skewValues, 9);
+   selector = XPlaneRef("selector");
+   switches.setScanMode(scanMode);
+   switches.begin();
+   FlightSimHost::setSwitch(3, 10, true);
+   for (int i = 0; i < 4; i++)
+   {
+      runRow(switches);
+   }
+
+   // row 0 is read before the move, row 1 after it
+   FlightSimHost::clearEvents();
+   runRow(switches);
+   FlightSimHost::setSwitch(3, 10, false);
+   FlightSimHost::setSwitch(2, 10, true);
+   for (int i = 0; i < 3; i++)
+   {
+      runRow(switches);
+   }
+
+   if (scanMode == SCAN_ROW_BY_ROW)
+   {
+      // one frame without a position: the default value, then position 0
+      CHECK_EQUAL(2, countEvents(HOST_WRITE_FLOAT, "selector"));
+      CHECK(FlightSimHost::getEvent(0)->value == 9);
+   }
+   else
+   {
+      CHECK_EQUAL(1, countEvents(HOST_WRITE_FLOAT, "selector"));
+   }
+   CHECK(FlightSimHost::getEvent(FlightSimHost::getNumberOfEvents() - 1)->value == 0);
+}
+
+
+// the debouncer keeps its raw data apart
+static void testDebouncedRaw()
+{
+   FlightSimHost::reset();
+   FlightSimSwitchMatrix<1, 2> switches(2, SWITCH_PINS(10, 11), 1);
+   switches.setScanMode(SCAN_FULL_FRAME);
+   switches.setDebounce(3);
+   switches.begin();
+   FlightSimHost::setPin(10, LOW);
+   runRow(switches);
+   CHECK(switches.isRawOn(0, 0));
+   CHECK(!switches.isOn(0, 0));
+   CHECK(switches.getRawRowData() != switches.getRowData());
+
+   // too late, the planes are allocated
+   switches.setDebounce(1);
+   switches.setFrameSnapshot(true);
+   runRow(switches);
+   runRow(switches);
+   CHECK(switches.isOn(0, 0));
+}
+
+
+int main()
+{
+   FlightSimHost::setSerialOutput(false);
+   CHECK(sizeof(FlightSimSwitchMatrix<32, 32>) - sizeof(FlightSimSwitchesBase) <= 32 * 4 * 2 + 32);
+   testRows(false);
+   testRows(true);
+   testElement(false);
+   testElement(true);
+   testSkew(SCAN_ROW_BY_ROW);
+   testSkew(SCAN_FULL_FRAME);
+   testDebouncedRaw();
+   return TEST_RESULT();
+}
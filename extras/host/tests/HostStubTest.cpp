@@ -0,0 +1,93 @@
+#include <FlightSimTest.h>
+
+/*
+ * The simulated environment itself: virtual clock, timers, pins, switches and
+ * the event record that the other tests rely on.
+ */
+
+static int ticks = 0;
+
+static void tick()
+{
+   ticks++;
+}
+
+
+static void testClock()
+{
+   FlightSimHost::reset();
+   CHECK_EQUAL(0, micros());
+   delay(3);
+   CHECK_EQUAL(3000, micros());
+   FlightSimHost::advanceMicros(500);
+   CHECK_EQUAL(3, millis());
+
+   IntervalTimer timer;
+   ticks = 0;
+   timer.begin(tick, 1000);
+   FlightSimHost::advanceMillis(10);
+   CHECK_EQUAL(10, ticks);
+   timer.end();
+   FlightSimHost::advanceMillis(10);
+   CHECK_EQUAL(10, ticks);
+}
+
+
+static void testPins()
+{
+   FlightSimHost::reset();
+   pinMode(2, INPUT_PULLUP);
+   pinMode(3, OUTPUT);
+   digitalWrite(3, LOW);
+   CHECK_EQUAL(HIGH, digitalRead(2));
+   FlightSimHost::setSwitch(2, 3, true);
+   CHECK_EQUAL(LOW, digitalRead(2));
+   FlightSimHost::setSwitch(2, 3, false);
+   CHECK_EQUAL(HIGH, digitalRead(2));
+   FlightSimHost::setPin(2, LOW);
+   CHECK_EQUAL(LOW, digitalRead(2));
+
+   ticks = 0;
+   attachInterrupt(digitalPinToInterrupt(2), tick, CHANGE);
+   FlightSimHost::setPin(2, HIGH);
+   FlightSimHost::setPin(2, HIGH);
+   FlightSimHost::setSwitch(2, 3, true);
+   CHECK_EQUAL(2, ticks);
+   detachInterrupt(2);
+   FlightSimHost::setSwitch(2, 3, false);
+   CHECK_EQUAL(2, ticks);
+}
+
+
+static void testEvents()
+{
+   FlightSimHost::reset();
+   FlightSimCommand command;
+   command = XPlaneRef("sim/test/command");
+   FlightSimFloat dataref;
+   dataref = XPlaneRef("sim/test/dataref");
+
+   command.once();
+   command.begin();
+   command.end();
+   dataref = 1.5;
+   CHECK_EQUAL(4, FlightSimHost::getNumberOfEvents());
+   CHECK_EQUAL(1, countEvents(HOST_COMMAND_ONCE, "sim/test/command"));
+   CHECK_EQUAL(1, countEvents(HOST_WRITE_FLOAT, "sim/test/dataref"));
+   CHECK(FlightSimHost::getEvent(3)->value == 1.5);
+
+   FlightSimHost::setDataref("sim/test/dataref", 2.5);
+   CHECK(dataref.read() == 2.5);
+   FlightSimHost::clearEvents();
+   CHECK_EQUAL(0, FlightSimHost::getNumberOfEvents());
+}
+
+
+int main()
+{
+   FlightSimHost::setSerialOutput(false);
+   testClock();
+   testPins();
+   testEvents();
+   return TEST_RESULT();
+}
@@ -0,0 +1,171 @@
+#include <FlightSimTest.h>
+
+/*
+ * Debug log ring: records of one frame beyond the ring size are dropped and
+ * counted, the kept records are printed in order by flushDebugLog() or, one
+ * per call, by loop() when no frame is due.
+ */
+
+#define ELEMENTS             8
+#define RING_SIZE            4
+
+FlightSimSwitchMatrix<1, ELEMENTS> switches(ELEMENTS, SWITCH_PINS(10, 11, 12, 13, 14, 15, 16, 17), 10);
+FlightSimLogBuffer<RING_SIZE> debugLog;
+FlightSimOnOffCommandSwitch *elements[ELEMENTS];
+char names[ELEMENTS][2][16];
+
+static char   output[1024];
+static size_t outputLength = 0;
+
+
+static void captureOutput(const char *text, size_t length)
+{
+   if (outputLength + length < sizeof(output))
+   {
+      memcpy(&output[outputLength], text, length);
+      outputLength += length;
+      output[outputLength] = 0;
+   }
+}
+
+
+static void clearOutput()
+{
+   outputLength = 0;
+   output[0]    = 0;
+}
+
+
+// number of lines printed since clearOutput()
+static size_t countLines()
+{
+   size_t lines = 0;
+   for (size_t i = 0; i < outputLength; i++)
+   {
+      lines += (output[i] == '\n');
+   }
+   return lines;
+}
+
+
+// next line from text on that ends with message and name, NULL if none
+static const char *findLine(const char *text, const char *message, const char *name)
+{
+   size_t messageLength = strlen(message);
+   size_t nameLength    = strlen(name);
+   for (text = strstr(text, message); text; text = strstr(text + 1, message))
+   {
+      if (!strncmp(text + messageLength, name, nameLength) && (text[messageLength + nameLength] == '\n'))
+      {
+         return text;
+      }
+   }
+   return NULL;
+}
+
+
+static void runFrame()
+{
+   uint32_t frames = switches.getFrameCount();
+   while (switches.getFrameCount() == frames)
+   {
+      switches.loop();
+      FlightSimHost::advanceMicros(100);
+   }
+}
+
+
+static void setAll(uint8_t state)
+{
+   for (uint8_t i = 0; i < ELEMENTS; i++)
+   {
+      FlightSimHost::setPin(10 + i, state);
+   }
+}
+
+
+// a frame with more records than the ring: the first ones are kept
+static void testOverflow()
+{
+   setAll(LOW);
+   runFrame();
+   CHECK_EQUAL(ELEMENTS, countEvents(HOST_COMMAND_ONCE));
+   CHECK_EQUAL(RING_SIZE, debugLog.available());
+   CHECK_EQUAL(ELEMENTS - RING_SIZE, debugLog.getDrops());
+
+   // nothing printed before the flush
+   CHECK_EQUAL(0, countLines());
+
+   switches.flushDebugLog();
+   CHECK_EQUAL(0, debugLog.available());
+   CHECK_EQUAL(RING_SIZE, countLines());
+
+   const char *line = output;
+   for (uint8_t i = 0; i < RING_SIZE; i++)
+   {
+      line = findLine(line, "FlightSimOnOffCommandSwitch: Sending ON command ", names[i][0]);
+      CHECK(line != NULL);
+      if (!line)
+      {
+         return;
+      }
+   }
+
+   // dropped records are not printed
+   CHECK(findLine(output, "Sending ON command ", names[RING_SIZE][0]) == NULL);
+}
+
+
+// loop() prints one record per call between two frames
+static void testIdleFlush()
+{
+   setAll(HIGH);
+   runFrame();
+   CHECK_EQUAL(RING_SIZE, debugLog.available());
+   CHECK_EQUAL(2 * (ELEMENTS - RING_SIZE), debugLog.getDrops());
+
+   clearOutput();
+   for (uint8_t i = 1; i <= RING_SIZE; i++)
+   {
+      switches.loop();
+      CHECK_EQUAL(RING_SIZE - i, debugLog.available());
+      CHECK_EQUAL(i, countLines());
+   }
+   CHECK(findLine(output, "Sending OFF command ", names[0][1]) == strstr(output, "Sending OFF"));
+   CHECK(findLine(output, "Sending OFF command ", names[RING_SIZE - 1][1]) != NULL);
+
+   // an empty ring prints nothing
+   clearOutput();
+   switches.flushDebugLog();
+   CHECK_EQUAL(0, countLines());
+}
+
+
+int main()
+{
+   FlightSimHost::reset();
+   FlightSimHost::setSerialOutput(false);
+   FlightSimHost::onSerialOutput(captureOutput);
+   for (uint8_t i = 0; i < ELEMENTS; i++)
+   {
+      snprintf(names[i][0], sizeof(names[i][0]), "column%u_on", i);
+      snprintf(names[i][1], sizeof(names[i][1]), "column%u_off", i);
+      elements[i] = new FlightSimOnOffCommandSwitch(switches, MATRIX(0, i));
+      elements[i]->setOnOffCommands(XPlaneRef(names[i][0]), XPlaneRef(names[i][1]));
+   }
+   switches.begin();
+   runFrame();
+
+   // debug from here on, the resync of the first frame is not logged
+   for (uint8_t i = 0; i < ELEMENTS; i++)
+   {
+      elements[i]->setDebug(true);
+   }
+   switches.setDebugLog(debugLog);
+   FlightSimHost::clearEvents();
+   clearOutput();
+
+   testOverflow();
+   testIdleFlush();
+   return TEST_RESULT();
+}
@@ -0,0 +1,156 @@
+#include <FlightSimTest.h>
+#include <Wire.h>
+
+/*
+ * FlightSimMCP23017Input against the register files of the host Wire library.
+ * begin() must configure every expander with one burst from IODIRA to GPPUB, and
+ * a read must map GPIOA to columns d * 16 + 0..7 and GPIOB to d * 16 + 8..15.
+ */
+
+// MCP23017 registers with IOCON.BANK = 0
+#define IODIRA               0x00
+#define IPOLA                0x02
+#define GPINTENA             0x04
+#define DEFVALA              0x06
+#define INTCONA              0x08
+#define IOCON                0x0A
+#define GPPUA                0x0C
+#define GPIOA                0x12
+#define GPIOB                0x13
+
+#define ADDRESS              0x20
+#define INTERRUPT_PIN        20
+
+
+// closes the switches set in closedA/B, active low: a closed switch pulls its
+// pin low. GPIOA/B report the pin levels with the input polarity applied
+static void setPins(uint8_t device, uint8_t closedA, uint8_t closedB)
+{
+   Wire.setRegister(ADDRESS + device, GPIOA, ~closedA ^ Wire.getRegister(ADDRESS + device, IPOLA));
+   Wire.setRegister(ADDRESS + device, GPIOB, ~closedB ^ Wire.getRegister(ADDRESS + device, IPOLA + 1));
+}
+
+
+static void testConfiguration()
+{
+   for (uint8_t device = 0; device < 3; device++)
+   {
+      Wire.addDevice(ADDRESS + device);
+   }
+   FlightSimMCP23017Input input(Wire, ADDRESS, 3);
+   uint32_t transactions = Wire.getTransactions();
+   CHECK(input.begin());
+   CHECK_EQUAL(transactions + 3, Wire.getTransactions());
+
+   static const uint8_t expected[] = {
+      0xff, 0xff,                           // IODIRA/B: inputs
+      0xff, 0xff,                           // IPOLA/B: active low
+      0xff, 0xff,                           // GPINTENA/B
+      0x00, 0x00,                           // DEFVALA/B
+      0x00, 0x00,                           // INTCONA/B
+      0x44, 0x44,                           // IOCON: MIRROR | ODR
+      0xff, 0xff                            // GPPUA/B: pullups
+   };
+   for (uint8_t device = 0; device < 3; device++)
+   {
+      for (uint8_t reg = IODIRA; reg < sizeof(expected); reg++)
+      {
+         CHECK_EQUAL(expected[reg], Wire.getRegister(ADDRESS + device, reg));
+      }
+   }
+
+   // active high switches: no inversion, no pullups
+   FlightSimMCP23017Input activeHigh(Wire, ADDRESS, 1, NO_INTERRUPT_PIN, false);
+   CHECK(activeHigh.begin());
+   CHECK_EQUAL(0x00, Wire.getRegister(ADDRESS, IPOLA));
+   CHECK_EQUAL(0x00, Wire.getRegister(ADDRESS, GPPUA + 1));
+
+   // a missing expander fails begin()
+   FlightSimMCP23017Input missing(Wire, ADDRESS, 4);
+   CHECK(!missing.begin());
+}
+
+
+static void testPortOrder()
+{
+   FlightSimMCP23017Input input(Wire, ADDRESS, 3);
+   CHECK(input.begin());
+
+   setPins(0, 0x01, 0x00);                  // GPA0 of expander 0: column 0
+   setPins(1, 0x00, 0x80);                  // GPB7 of expander 1: column 31
+   setPins(2, 0x80, 0x01);                  // GPA7, GPB0 of expander 2: columns 39, 40
+   uint32_t readData[2] = { 0 };
+   uint32_t transactions = Wire.getTransactions();
+   input.readRow(0, readData);
+   CHECK_EQUAL(0x80000001, readData[0]);
+   CHECK_EQUAL(0x00000180, readData[1]);
+
+   // one register write and one burst read of GPIOA/B per expander
+   CHECK_EQUAL(transactions + 6, Wire.getTransactions());
+
+   setPins(0, 0x5a, 0xc3);
+   setPins(1, 0x00, 0x00);
+   setPins(2, 0xff, 0xff);
+   memset(readData, 0, sizeof(readData));
+   input.readRow(0, readData);
+   CHECK_EQUAL(0x0000c35a, readData[0]);
+   CHECK_EQUAL(0x0000ffff, readData[1]);
+   CHECK_EQUAL(0, input.getErrors());
+
+   // an expander that does not answer keeps its last state
+   Wire.removeDevice(ADDRESS + 1);
+   setPins(0, 0x00, 0x00);
+   memset(readData, 0, sizeof(readData));
+   input.readRow(0, readData);
+   CHECK_EQUAL(0x00000000, readData[0]);
+   CHECK_EQUAL(1, input.getErrors());
+   Wire.addDevice(ADDRESS + 1);
+}
+
+
+// while the interrupt line is high, frames leave the bus alone
+static void testInterrupt()
+{
+   FlightSimMCP23017Input input(Wire, ADDRESS, 1, INTERRUPT_PIN);
+   CHECK(input.begin());
+   uint32_t readData[1] = { 0 };
+   CHECK(input.frameChanged());
+   input.readRow(0, readData);
+   CHECK(!input.frameChanged());
+   FlightSimHost::setPin(INTERRUPT_PIN, LOW);
+   CHECK(input.frameChanged());
+   FlightSimHost::setPin(INTERRUPT_PIN, HIGH);
+}
+
+
+// GPIOA/B arrive in a matrix as switches
+static void testMatrix()
+{
+   FlightSimSwitchMatrix<1, 32> switches;
+   FlightSimMCP23017Input input(Wire, ADDRESS, 2);
+   switches.addInputSource(input);
+   switches.begin();
+   setPins(0, 0x02, 0x00);
+   setPins(1, 0x00, 0x40);
+   while (switches.getFrameCount() < 2)
+   {
+      switches.loop();
+      FlightSimHost::advanceMicros(100);
+   }
+   for (uint8_t column = 0; column < 32; column++)
+   {
+      CHECK_EQUAL((column == 1) || (column == 30), switches.isOn(0, column));
+   }
+}
+
+
+int main()
+{
+   FlightSimHost::reset();
+   FlightSimHost::setSerialOutput(false);
+   testConfiguration();
+   testPortOrder();
+   testInterrupt();
+   testMatrix();
+   return TEST_RESULT();
+}
@@ -0,0 +1,238 @@
+#include <FlightSimTest.h>
+
+/*
+ * FlightSimOutput against the recorded host events as transport: immediate
+ * sending, the message rate, priorities, superseded resync messages, full
+ * queues, command batches, write coalescing and the order of writes and
+ * commands.
+ */
+
+FlightSimCommand commandA;
+FlightSimCommand commandB;
+FlightSimFloat   datarefA;
+FlightSimFloat   datarefB;
+
+static int ownerA;
+static int ownerB;
+
+
+// sends everything queued and resets the queue settings and counters
+static void drain()
+{
+   FlightSimOutput.setMessageRate(0);
+   FlightSimOutput.process();
+   FlightSimOutput.setWriteCoalescing(false);
+   FlightSimOutput.clearCounters();
+   FlightSimHost::clearEvents();
+}
+
+
+static void advanceAndProcess(uint32_t usec)
+{
+   FlightSimHost::advanceMicros(usec);
+   FlightSimOutput.process();
+}
+
+
+static void testImmediate()
+{
+   drain();
+   FlightSimOutput.once(&commandA);
+   FlightSimOutput.begin(&commandB);
+   FlightSimOutput.end(&commandB);
+   FlightSimOutput.write(&datarefA, 1.5);
+   CHECK_EQUAL(4, FlightSimHost::getNumberOfEvents());
+   CHECK_EQUAL(HOST_COMMAND_ONCE, FlightSimHost::getEvent(0)->type);
+   CHECK_EQUAL(HOST_COMMAND_BEGIN, FlightSimHost::getEvent(1)->type);
+   CHECK_EQUAL(HOST_COMMAND_END, FlightSimHost::getEvent(2)->type);
+   CHECK_EQUAL(HOST_WRITE_FLOAT, FlightSimHost::getEvent(3)->type);
+   CHECK_EQUAL(0, FlightSimOutput.getQueueDepth());
+   CHECK_EQUAL(4, FlightSimOutput.getSentMessages());
+}
+
+
+// one message per millisecond, in the order queued
+static void testMessageRate()
+{
+   drain();
+   FlightSimOutput.setMessageRate(1);
+   advanceAndProcess(2000);
+   for (int i = 0; i < 4; i++)
+   {
+      FlightSimOutput.once((i % 2) ? &commandB : &commandA, PRIORITY_LIVE, (i % 2) ? &ownerB : &ownerA);
+   }
+   CHECK_EQUAL(1, FlightSimHost::getNumberOfEvents());
+   CHECK_EQUAL(3, FlightSimOutput.getQueueDepth());
+   for (int i = 2; i <= 4; i++)
+   {
+      advanceAndProcess(999);
+      CHECK_EQUAL(i - 1, FlightSimHost::getNumberOfEvents());
+      advanceAndProcess(1);
+      CHECK_EQUAL(i, FlightSimHost::getNumberOfEvents());
+   }
+   CHECK_EQUAL(2, countEvents(HOST_COMMAND_ONCE, "command/a"));
+   CHECK_EQUAL(2, countEvents(HOST_COMMAND_ONCE, "command/b"));
+   CHECK(!strcmp("command/b", FlightSimHost::getEvent(3)->name));
+   CHECK_EQUAL(3, FlightSimOutput.getMaxQueueDepth());
+}
+
+
+// live messages go first, and drop the queued resync messages of their owner
+static void testPriorities()
+{
+   drain();
+   FlightSimOutput.setMessageRate(1);
+   advanceAndProcess(2000);
+   FlightSimOutput.once(&commandA, PRIORITY_RESYNC, &ownerA);      // sent right away
+   FlightSimOutput.once(&commandA, PRIORITY_RESYNC, &ownerA);
+   FlightSimOutput.end(&commandB, PRIORITY_RESYNC, &ownerB);
+   FlightSimOutput.begin(&commandB, PRIORITY_LIVE, &ownerA);
+   CHECK_EQUAL(1, FlightSimOutput.getSupersededMessages());
+   CHECK_EQUAL(1, FlightSimOutput.getQueueDepth(PRIORITY_LIVE));
+   CHECK_EQUAL(2, FlightSimOutput.getQueueDepth(PRIORITY_RESYNC));   // superseded until sent
+
+   for (int i = 0; i < 4; i++)
+   {
+      advanceAndProcess(1000);
+   }
+   CHECK_EQUAL(3, FlightSimHost::getNumberOfEvents());
+   CHECK_EQUAL(HOST_COMMAND_ONCE, FlightSimHost::getEvent(0)->type);
+   CHECK_EQUAL(HOST_COMMAND_BEGIN, FlightSimHost::getEvent(1)->type);
+   CHECK_EQUAL(HOST_COMMAND_END, FlightSimHost::getEvent(2)->type);
+   CHECK_EQUAL(0, FlightSimOutput.getQueueDepth());
+}
+
+
+// a full queue drops messages, the other priority still has room
+static void testFullQueue()
+{
+   drain();
+   FlightSimOutput.setMessageRate(1);
+   advanceAndProcess(2000);
+   FlightSimOutput.once(&commandA);
+   for (int i = 0; i < OUTPUT_QUEUE_SIZE + 3; i++)
+   {
+      FlightSimOutput.begin(&commandA);
+   }
+   CHECK_EQUAL(OUTPUT_QUEUE_SIZE, FlightSimOutput.getQueueDepth(PRIORITY_LIVE));
+   CHECK_EQUAL(3, FlightSimOutput.getDroppedMessages());
+   FlightSimOutput.end(&commandB, PRIORITY_RESYNC, &ownerB);
+   CHECK_EQUAL(1, FlightSimOutput.getQueueDepth(PRIORITY_RESYNC));
+
+   // a dropped batch counts all its commands
+   FlightSimOutput.once(&commandB, PRIORITY_LIVE, NULL, 5);
+   CHECK_EQUAL(8, FlightSimOutput.getDroppedMessages());
+}
+
+
+// a batch takes one entry and sends one command per credit
+static void testBatches()
+{
+   drain();
+   FlightSimOutput.setMessageRate(1);
+   advanceAndProcess(2000);
+   FlightSimOutput.once(&commandA, PRIORITY_LIVE, &ownerA, 3);
+   CHECK_EQUAL(1, FlightSimHost::getNumberOfEvents());
+   CHECK_EQUAL(1, FlightSimOutput.getQueueDepth());
+   FlightSimOutput.once(&commandA, PRIORITY_LIVE, &ownerA, 2);
+   CHECK_EQUAL(1, FlightSimOutput.getQueueDepth());
+   FlightSimOutput.once(&commandB, PRIORITY_LIVE, &ownerB);
+   CHECK_EQUAL(2, FlightSimOutput.getQueueDepth());
+   CHECK_EQUAL(3, FlightSimOutput.getCollapsedCommands());
+
+   for (int i = 0; i < 5; i++)
+   {
+      advanceAndProcess(1000);
+   }
+   CHECK_EQUAL(5, countEvents(HOST_COMMAND_ONCE, "command/a"));
+   CHECK_EQUAL(1, countEvents(HOST_COMMAND_ONCE, "command/b"));
+   CHECK(!strcmp("command/b", FlightSimHost::getEvent(5)->name));
+   CHECK_EQUAL(0, FlightSimOutput.getQueueDepth());
+}
+
+
+// coalescing is on by default
+static void testDefault()
+{
+   FlightSimOutput.write(&datarefA, 1);
+   FlightSimOutput.write(&datarefA, 2);
+   CHECK_EQUAL(0, FlightSimHost::getNumberOfEvents());
+   FlightSimOutput.process();
+   CHECK_EQUAL(1, countEvents(HOST_WRITE_FLOAT));
+   CHECK(FlightSimHost::getEvent(0)->value == 2);
+   CHECK_EQUAL(1, FlightSimOutput.getCoalescedWrites());
+}
+
+
+// coalesced writes wait for process(), the last value of a dataref wins
+static void testCoalescing()
+{
+   drain();
+   FlightSimOutput.setWriteCoalescing(true);
+   FlightSimOutput.write(&datarefA, 1);
+   FlightSimOutput.write(&datarefB, 2);
+   FlightSimOutput.write(&datarefA, 3);
+   CHECK_EQUAL(0, FlightSimHost::getNumberOfEvents());
+   FlightSimOutput.process();
+   CHECK_EQUAL(2, countEvents(HOST_WRITE_FLOAT));
+   CHECK(FlightSimHost::getEvent(1)->value == 3);
+   CHECK_EQUAL(1, FlightSimOutput.getCoalescedWrites());
+
+   // X-Plane already has the value last written
+   FlightSimHost::setDataref("dataref/a", 3);
+   FlightSimOutput.write(&datarefA, 3);
+   FlightSimOutput.process();
+   CHECK_EQUAL(2, FlightSimHost::getNumberOfEvents());
+   CHECK_EQUAL(1, FlightSimOutput.getSkippedWrites());
+}
+
+
+// writes and commands are sent in the order given, with and without coalescing
+static void testOrder()
+{
+   drain();
+   FlightSimOutput.write(&datarefA, 4);
+   FlightSimOutput.once(&commandA);
+   FlightSimOutput.write(&datarefA, 5);
+   CHECK_EQUAL(3, FlightSimHost::getNumberOfEvents());
+   CHECK(FlightSimHost::getEvent(0)->value == 4);
+   CHECK_EQUAL(HOST_COMMAND_ONCE, FlightSimHost::getEvent(1)->type);
+   CHECK(FlightSimHost::getEvent(2)->value == 5);
+
+   drain();
+   FlightSimOutput.setWriteCoalescing(true);
+   FlightSimOutput.write(&datarefA, 6);
+   FlightSimOutput.once(&commandA);
+   FlightSimOutput.write(&datarefA, 7);
+   FlightSimOutput.write(&datarefA, 8);
+   FlightSimOutput.process();
+   CHECK_EQUAL(3, FlightSimHost::getNumberOfEvents());
+   CHECK_EQUAL(HOST_WRITE_FLOAT, FlightSimHost::getEvent(0)->type);
+   CHECK(FlightSimHost::getEvent(0)->value == 6);
+   CHECK_EQUAL(HOST_COMMAND_ONCE, FlightSimHost::getEvent(1)->type);
+   CHECK_EQUAL(HOST_WRITE_FLOAT, FlightSimHost::getEvent(2)->type);
+   CHECK(FlightSimHost::getEvent(2)->value == 8);
+   CHECK_EQUAL(1, FlightSimOutput.getCoalescedWrites());
+}
+
+
+int main()
+{
+   FlightSimHost::reset();
+   FlightSimHost::setSerialOutput(false);
+   commandA = XPlaneRef("command/a");
+   commandB = XPlaneRef("command/b");
+   datarefA = XPlaneRef("dataref/a");
+   datarefB = XPlaneRef("dataref/b");
+
+   testDefault();
+   testImmediate();
+   testMessageRate();
+   testPriorities();
+   testFullQueue();
+   testBatches();
+   testCoalescing();
+   testOrder();
+   drain();
+   return TEST_RESULT();
+}
@@ -0,0 +1,104 @@
+#include <FlightSimTest.h>
+
+/*
+ * Direct port reads against digitalRead(): the rows read through the port map of
+ * FlightSimPinInput must be the same as the rows read pin by pin, for pins wired
+ * in order, in reverse, on several ports and in both polarities.
+ */
+
+// 40 columns: pins 16..23 are in order on port 1, 24..31 reversed, the rest mixed
+const uint8_t columnPins[] = {
+   16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31,
+   0, 8, 1, 9, 2, 10, 3, 11, 32, 48, 33, 49, 34, 50, 35, 51,
+   4, 63, 5, 62, 6, 61, 7, 60
+};
+#define NUMBER_OF_COLUMNS (sizeof(columnPins) / sizeof(columnPins[0]))
+#define ROW_PIN           12
+
+static uint32_t randomState = 12345;
+
+static uint32_t nextRandom()
+{
+   randomState = randomState * 1103515245 + 12345;
+   return randomState >> 16;
+}
+
+
+static void compareRows(bool activeLow)
+{
+   FlightSimPinInput portInput(NUMBER_OF_COLUMNS, columnPins, activeLow);
+   FlightSimPinInput pinInput(NUMBER_OF_COLUMNS, columnPins, activeLow);
+   pinInput.setPortRead(false);
+   CHECK(portInput.begin());
+   CHECK(pinInput.begin());
+   CHECK(portInput.getPortMap() != NULL);
+   CHECK(pinInput.getPortMap() == NULL);
+
+   // neighbouring columns on neighbouring port bits share a gather
+   CHECK_EQUAL(4, portInput.getPortMap()->getNumberOfPorts());
+   CHECK(portInput.getPortMap()->getNumberOfGathers() < NUMBER_OF_COLUMNS);
+
+   pinMode(ROW_PIN, OUTPUT);
+   digitalWrite(ROW_PIN, activeLow ? LOW : HIGH);
+   for (int pattern = 0; pattern < 200; pattern++)
+   {
+      uint64_t closed = ((uint64_t) nextRandom() << 32) ^ ((uint64_t) nextRandom() << 16) ^ nextRandom();
+      if (pattern < 2)
+      {
+         closed = pattern ? 0xffffffffffull : 0;
+      }
+      for (uint8_t i = 0; i < NUMBER_OF_COLUMNS; i++)
+      {
+         FlightSimHost::setSwitch(ROW_PIN, columnPins[i], (closed >> i) & 1);
+      }
+
+      uint32_t portRow[MATRIX_WORDS(NUMBER_OF_COLUMNS)] = { 0 };
+      uint32_t pinRow[MATRIX_WORDS(NUMBER_OF_COLUMNS)]  = { 0 };
+      portInput.readRow(0, portRow);
+      pinInput.readRow(0, pinRow);
+      CHECK_EQUAL(pinRow[0], portRow[0]);
+      CHECK_EQUAL(pinRow[1], portRow[1]);
+      CHECK_EQUAL((uint32_t) closed, pinRow[0]);
+      CHECK_EQUAL((uint32_t) (closed >> 32) & 0xff, pinRow[1]);
+   }
+   for (uint8_t i = 0; i < NUMBER_OF_COLUMNS; i++)
+   {
+      FlightSimHost::setSwitch(ROW_PIN, columnPins[i], false);
+   }
+}
+
+
+// a matrix scanned through the ports publishes the same switches
+static void testMatrix()
+{
+   FlightSimSwitchMatrix<2, 8> switches(2, SWITCH_PINS(40, 41), 8, SWITCH_PINS(16, 17, 18, 19, 31, 30, 29, 28), 2);
+   switches.setScanMode(SCAN_FULL_FRAME);
+   switches.begin();
+   FlightSimHost::setSwitch(40, 17, true);
+   FlightSimHost::setSwitch(41, 30, true);
+   FlightSimHost::setSwitch(41, 28, true);
+   for (int i = 0; i < 100; i++)
+   {
+      switches.loop();
+      FlightSimHost::advanceMicros(100);
+   }
+   for (uint8_t row = 0; row < 2; row++)
+   {
+      for (uint8_t column = 0; column < 8; column++)
+      {
+         bool on = ((row == 0) && (column == 1)) || ((row == 1) && ((column == 5) || (column == 7)));
+         CHECK_EQUAL(on, switches.isOn(row, column));
+      }
+   }
+}
+
+
+int main()
+{
+   FlightSimHost::reset();
+   FlightSimHost::setSerialOutput(false);
+   compareRows(true);
+   compareRows(false);
+   testMatrix();
+   return TEST_RESULT();
+}
@@ -0,0 +1,93 @@
+#include <FlightSimTest.h>
+
+/*
+ * Multi-position switch over two rows. Positions are grouped into runs of
+ * ascending columns in one row word; the first active position wins, and more
+ * than one active position is a wiring fault.
+ */
+
+#define POSITIONS            7
+
+// two groups in row 0, one in row 1, a group of one in row 0 again, and a
+// position outside the matrix that is never active
+static const uint32_t positions[POSITIONS] = {
+   MATRIX(0, 1), MATRIX(0, 3), MATRIX(1, 0), MATRIX(1, 2), MATRIX(0, 4), MATRIX(0, 0), MATRIX(3, 0)
+};
+static const float values[POSITIONS] = { 10, 20, 30, 40, 50, 60, 70 };
+static const uint8_t rowPins[]       = { 2, 3 };
+static const uint8_t columnPins[]    = { 10, 11, 12, 13, 14 };
+
+FlightSimSwitchMatrix<2, 5> switches(2, rowPins, 5, columnPins, 1);
+FlightSimWriteDatarefSwitch selector(switches, POSITIONS, positions, values, -1);
+
+
+static void runFrame()
+{
+   uint32_t frames = switches.getFrameCount();
+   while (switches.getFrameCount() == frames)
+   {
+      switches.loop();
+      FlightSimHost::advanceMicros(100);
+   }
+}
+
+
+static void setPosition(uint8_t position, bool closed)
+{
+   FlightSimHost::setSwitch(rowPins[MATRIX_ROW(positions[position])], columnPins[MATRIX_COLUMN(positions[position])], closed);
+}
+
+
+static void testDetents()
+{
+   for (uint8_t position = 0; position < POSITIONS - 1; position++)
+   {
+      setPosition(position, true);
+      runFrame();
+      CHECK_EQUAL(values[position], selector.getValue());
+      CHECK_EQUAL(1, selector.getActivePositions());
+      CHECK(!selector.hasWiringFault());
+      setPosition(position, false);
+   }
+
+   // between two detents
+   runFrame();
+   CHECK_EQUAL(-1, selector.getValue());
+   CHECK_EQUAL(0, selector.getActivePositions());
+   CHECK(!selector.hasWiringFault());
+}
+
+
+// two positions closed at once: the first one counts
+static void testFault(uint8_t first, uint8_t second)
+{
+   setPosition(first, true);
+   setPosition(second, true);
+   runFrame();
+   CHECK_EQUAL(values[first], selector.getValue());
+   CHECK_EQUAL(2, selector.getActivePositions());
+   CHECK(selector.hasWiringFault());
+
+   setPosition(first, false);
+   setPosition(second, false);
+   runFrame();
+   CHECK(!selector.hasWiringFault());
+}
+
+
+int main()
+{
+   FlightSimHost::reset();
+   FlightSimHost::setSerialOutput(false);
+   selector = XPlaneRef("selector");
+   switches.setScanMode(SCAN_FULL_FRAME);
+   switches.begin();
+   runFrame();
+
+   testDetents();
+   testFault(0, 1);                         // same group
+   testFault(1, 3);                         // two rows
+   testFault(4, 5);                         // same row word, two groups
+   testFault(2, 5);
+   return TEST_RESULT();
+}
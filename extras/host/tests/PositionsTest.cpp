@@ -0,0 +1,83 @@
+#include <FlightSimTest.h>
+
+/*
+ * Position tables fixed at compile time with FlightSimPositions. The table,
+ * its size and fits() are checked by the compiler; a switch built from the
+ * table reads the cells it lists.
+ */
+
+typedef FlightSimPositions<MATRIX(1, 0), MATRIX(0, 33), MATRIX(2, 4)> SelectorPositions;
+typedef FlightSimPositions<MATRIX(0, 1), NO_POSITION> SparePositions;
+
+static_assert(SelectorPositions::count == 3, "one position per argument");
+static_assert(SelectorPositions::positions[0] == MATRIX(1, 0), "positions in argument order");
+static_assert(SelectorPositions::positions[1] == MATRIX(0, 33), "positions in argument order");
+static_assert(SelectorPositions::positions[2] == MATRIX(2, 4), "positions in argument order");
+
+static_assert(SelectorPositions::fits(3, 34), "all positions on the matrix");
+static_assert(!SelectorPositions::fits(2, 34), "row 2 is not on a 2 row matrix");
+static_assert(!SelectorPositions::fits(3, 33), "column 33 is not on a 33 column matrix");
+static_assert(SparePositions::fits(1, 2), "NO_POSITION fits every matrix");
+static_assert(!SparePositions::fits(1, 1), "column 1 is not on a 1 column matrix");
+
+#define ROWS                 3
+#define COLUMNS              34
+
+static const uint8_t rowPins[ROWS]       = { 2, 3, 4 };
+static const uint8_t columnPins[COLUMNS] = { 10, 11, 12, 13, 14, 15, 16, 17, 18, 19,
+                                             20, 21, 22, 23, 24, 25, 26, 27, 28, 29,
+                                             30, 31, 32, 33, 34, 35, 36, 37, 38, 39,
+                                             40, 41, 42, 43 };
+static const float values[SelectorPositions::count] = { 10, 20, 30 };
+
+FlightSimSwitchMatrix<ROWS, COLUMNS> switches(ROWS, rowPins, COLUMNS, columnPins, 1);
+FlightSimWriteDatarefSwitch selector(switches, SelectorPositions(), values, -1);
+
+
+static void runFrame()
+{
+   uint32_t frames = switches.getFrameCount();
+   while (switches.getFrameCount() == frames)
+   {
+      switches.loop();
+      FlightSimHost::advanceMicros(100);
+   }
+}
+
+
+static void setPosition(uint8_t position, bool closed)
+{
+   uint32_t cell = SelectorPositions::positions[position];
+   FlightSimHost::setSwitch(rowPins[MATRIX_ROW(cell)], columnPins[MATRIX_COLUMN(cell)], closed);
+}
+
+
+static void testPositions()
+{
+   CHECK_EQUAL(SelectorPositions::count, selector.getNumberOfPositions());
+   for (uint8_t position = 0; position < SelectorPositions::count; position++)
+   {
+      FlightSimHost::clearEvents();
+      setPosition(position, true);
+      runFrame();
+      CHECK_EQUAL(values[position], selector.getValue());
+      CHECK_EQUAL(1, countEvents(HOST_WRITE_FLOAT, "selector"));
+      setPosition(position, false);
+   }
+   runFrame();
+   CHECK_EQUAL(-1, selector.getValue());
+}
+
+
+int main()
+{
+   FlightSimHost::reset();
+   FlightSimHost::setSerialOutput(false);
+   selector = XPlaneRef("selector");
+   switches.setScanMode(SCAN_FULL_FRAME);
+   switches.begin();
+   runFrame();
+
+   testPositions();
+   return TEST_RESULT();
+}
@@ -0,0 +1,131 @@
+#include <FlightSimTest.h>
+
+/*
+ * Resync in chunks: every frame resyncs the next setResyncChunkSize() elements,
+ * until each element has been resynced exactly once. Then the completion
+ * callback runs once.
+ */
+
+#define ELEMENTS             10
+#define CHUNK                3
+
+FlightSimSwitchMatrix<1, ELEMENTS> switches(ELEMENTS, SWITCH_PINS(10, 11, 12, 13, 14, 15, 16, 17, 18, 19), 2);
+CountingElement *elements[ELEMENTS];
+
+static uint32_t completions = 0;
+
+
+static void resyncComplete()
+{
+   completions++;
+}
+
+
+static void runFrame()
+{
+   uint32_t frames = switches.getFrameCount();
+   while (switches.getFrameCount() == frames)
+   {
+      switches.loop();
+      FlightSimHost::advanceMicros(100);
+   }
+}
+
+
+static void testChunks()
+{
+   FlightSimHost::setEnabled(false);
+   runFrame();
+   runFrame();
+   for (uint8_t i = 0; i < ELEMENTS; i++)
+   {
+      elements[i]->resyncs = 0;
+   }
+   completions = 0;
+
+   FlightSimHost::setEnabled(true);
+   uint16_t remaining = ELEMENTS;
+   uint32_t resyncTime = 0;
+   while (remaining)
+   {
+      runFrame();
+      uint16_t chunk = (remaining < CHUNK) ? remaining : CHUNK;
+      remaining     -= chunk;
+      CHECK_EQUAL(remaining, switches.getResyncRemaining());
+      CHECK_EQUAL(remaining ? 0 : 1, completions);
+
+      // the cursor moves in element order
+      for (uint8_t i = 0; i < ELEMENTS; i++)
+      {
+         CHECK_EQUAL(i < ELEMENTS - remaining, elements[i]->resyncs);
+      }
+      CHECK(switches.getResyncTime() >= resyncTime);
+      resyncTime = switches.getResyncTime();
+   }
+   CHECK(resyncTime > 0);
+
+   // complete: no more resyncs, the time stays the total duration
+   for (int i = 0; i < 5; i++)
+   {
+      runFrame();
+   }
+   for (uint8_t i = 0; i < ELEMENTS; i++)
+   {
+      CHECK_EQUAL(1, elements[i]->resyncs);
+   }
+   CHECK_EQUAL(1, completions);
+   CHECK_EQUAL(0, switches.getResyncRemaining());
+   CHECK_EQUAL(resyncTime, switches.getResyncTime());
+}
+
+
+// the flightsim stops in the middle: the resync starts over when it is back
+static void testRestart()
+{
+   FlightSimHost::setEnabled(false);
+   runFrame();
+   FlightSimHost::setEnabled(true);
+   runFrame();
+   CHECK_EQUAL(ELEMENTS - CHUNK, switches.getResyncRemaining());
+   FlightSimHost::setEnabled(false);
+   runFrame();
+   CHECK_EQUAL(0, switches.getResyncRemaining());
+
+   for (uint8_t i = 0; i < ELEMENTS; i++)
+   {
+      elements[i]->resyncs = 0;
+   }
+   completions = 0;
+   FlightSimHost::setEnabled(true);
+   for (int i = 0; i < 6; i++)
+   {
+      runFrame();
+   }
+   for (uint8_t i = 0; i < ELEMENTS; i++)
+   {
+      CHECK_EQUAL(1, elements[i]->resyncs);
+   }
+   CHECK_EQUAL(1, completions);
+}
+
+
+int main()
+{
+   FlightSimHost::reset();
+   FlightSimHost::setSerialOutput(false);
+   for (uint8_t i = 0; i < ELEMENTS; i++)
+   {
+      elements[i] = new CountingElement(switches, MATRIX(0, i));
+   }
+   switches.setResyncChunkSize(CHUNK);
+   switches.onResyncComplete(resyncComplete);
+   switches.begin();
+   for (int i = 0; i < 6; i++)
+   {
+      runFrame();
+   }
+
+   testChunks();
+   testRestart();
+   return TEST_RESULT();
+}
@@ -0,0 +1,64 @@
+#include <FlightSimTest.h>
+
+/*
+ * A resync frame dispatches every element once: the elements of the resync
+ * chunk resync, the others handle live changes. Up/down switches send a single
+ * step when resyncing, so a resync must not be followed by a live dispatch that
+ * sends the remaining steps in the same frame.
+ */
+
+FlightSimSwitchMatrix<2, 5> switches(2, SWITCH_PINS(2, 3), 5, SWITCH_PINS(10, 11, 12, 13, 14), 2);
+FlightSimUpDownCommandSwitch magnetos(switches, 5,
+                                      SWITCH_POSITIONS(MATRIX(0, 0), MATRIX(0, 1), MATRIX(0, 2), MATRIX(0, 3), MATRIX(0, 4)),
+                                      SWITCH_VALUES(0, 1, 2, 3, 4));
+
+
+// runs the matrix until a complete frame was dispatched
+static void runFrame()
+{
+   uint32_t frames = switches.getFrameCount();
+   while (switches.getFrameCount() == frames)
+   {
+      switches.loop();
+      FlightSimHost::advanceMicros(100);
+   }
+}
+
+
+static void testResyncFrame(uint8_t maxPendingCommands)
+{
+   FlightSimHost::setEnabled(false);
+   magnetos.setMaxPendingCommands(maxPendingCommands);
+   FlightSimHost::setDataref("sim/magnetos", 0);
+   FlightSimHost::setSwitch(2, 14, true);
+   for (int i = 0; i < 5; i++)
+   {
+      runFrame();
+   }
+
+   FlightSimHost::clearEvents();
+   FlightSimHost::setEnabled(true);
+   runFrame();
+   CHECK_EQUAL(1, countEvents(HOST_COMMAND_ONCE, "sim/magnetos_up"));
+   CHECK_EQUAL(0, countEvents(HOST_COMMAND_ONCE, "sim/magnetos_down"));
+
+   // the next frames continue with live changes, still one step at a time
+   // while the dataref has not followed
+   FlightSimHost::clearEvents();
+   runFrame();
+   CHECK(countEvents(HOST_COMMAND_ONCE, "sim/magnetos_up") <= maxPendingCommands);
+   FlightSimHost::setSwitch(2, 14, false);
+}
+
+
+int main()
+{
+   FlightSimHost::reset();
+   FlightSimHost::setSerialOutput(false);
+   magnetos.setDatarefAndCommands(XPlaneRef("sim/magnetos"), XPlaneRef("sim/magnetos_up"), XPlaneRef("sim/magnetos_down"));
+   switches.begin();
+
+   testResyncFrame(1);
+   testResyncFrame(4);
+   return TEST_RESULT();
+}
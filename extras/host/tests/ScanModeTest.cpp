@@ -0,0 +1,109 @@
+#include <FlightSimTest.h>
+
+/*
+ * Frame duration and latency of the two loop() scan modes on the virtual
+ * clock. The frame duration runs from reading the first row to the end of the
+ * dispatch. SCAN_ROW_BY_ROW reads one row per scanRate period, so a frame
+ * takes ROWS - 1 periods and a change waits for the last row of the next frame
+ * before it is sent. SCAN_FULL_FRAME reads all rows in one call, one settle
+ * time apart, and sends a change within one period.
+ */
+
+#define ROWS                 4
+#define COLUMNS              2
+#define SCAN_RATE            2              // ms
+#define SETTLE_TIME          20             // us
+#define STEP                 100            // us per loop() call
+
+// loop() reads the next row once the timer is past the scan rate
+#define PERIOD               ((SCAN_RATE + 1) * 1000)
+
+static uint32_t fullFrameLatency = 0;
+
+static const uint8_t rowPins[ROWS]       = { 2, 3, 4, 5 };
+static const uint8_t columnPins[COLUMNS] = { 10, 11 };
+
+FlightSimSwitchMatrix<ROWS, COLUMNS> switches(ROWS, rowPins, COLUMNS, columnPins, SCAN_RATE);
+FlightSimOnOffCommandSwitch firstRow(switches, MATRIX(0, 0));
+FlightSimOnOffCommandSwitch lastRow(switches, MATRIX(ROWS - 1, 1));
+
+
+static void runFrame()
+{
+   uint32_t frames = switches.getFrameCount();
+   while (switches.getFrameCount() == frames)
+   {
+      switches.loop();
+      FlightSimHost::advanceMicros(STEP);
+   }
+}
+
+
+// time from closing the switch right after a frame until its command is sent
+static uint32_t latency(uint8_t row, uint8_t column)
+{
+   runFrame();
+   FlightSimHost::clearEvents();
+   uint32_t start = micros();
+   FlightSimHost::setSwitch(rowPins[row], columnPins[column], true);
+   while (!FlightSimHost::getNumberOfEvents())
+   {
+      switches.loop();
+      FlightSimHost::advanceMicros(STEP);
+   }
+   uint32_t time = FlightSimHost::getEvent(0)->time - start;
+
+   FlightSimHost::setSwitch(rowPins[row], columnPins[column], false);
+   runFrame();
+   runFrame();
+   return time;
+}
+
+
+static void testFullFrame()
+{
+   switches.setScanMode(SCAN_FULL_FRAME);
+   runFrame();
+   runFrame();
+   CHECK_EQUAL((ROWS - 1) * SETTLE_TIME, switches.getFrameDuration());
+
+   // the next frame, whichever row
+   uint32_t first = latency(0, 0);
+   uint32_t last  = latency(ROWS - 1, 1);
+   CHECK(first <= PERIOD);
+   CHECK_EQUAL(first, last);
+   fullFrameLatency = first;
+}
+
+
+static void testRowByRow()
+{
+   switches.setScanMode(SCAN_ROW_BY_ROW);
+   runFrame();
+   runFrame();
+   CHECK_EQUAL((ROWS - 1) * PERIOD, switches.getFrameDuration());
+
+   // the next frame ends ROWS periods after the last one, whichever row
+   uint32_t first = latency(0, 0);
+   uint32_t last  = latency(ROWS - 1, 1);
+   CHECK(first > (ROWS - 1) * PERIOD);
+   CHECK(first <= ROWS * PERIOD);
+   CHECK_EQUAL(first, last);
+   CHECK(first > ROWS * fullFrameLatency);
+}
+
+
+int main()
+{
+   FlightSimHost::reset();
+   FlightSimHost::setSerialOutput(false);
+   firstRow.setOnOffCommands(XPlaneRef("first_on"), XPlaneRef("first_off"));
+   lastRow.setOnOffCommands(XPlaneRef("last_on"), XPlaneRef("last_off"));
+   switches.setRowSettleTime(SETTLE_TIME);
+   switches.begin();
+   runFrame();
+
+   testFullFrame();
+   testRowByRow();
+   return TEST_RESULT();
+}
@@ -0,0 +1,163 @@
+#include <FlightSimTest.h>
+#include <SPI.h>
+
+/*
+ * FlightSimShiftRegisterInput against a simulated chain of 74HC165. SH/LD low
+ * loads the parallel inputs, every rising clock edge shifts the chain by one bit
+ * towards QH of register 0, which drives the data pin. Bit n of register r must
+ * end up in column r * 8 + n, both bit-banged and over SPI.
+ */
+
+#define LOAD_PIN             10
+#define CLOCK_PIN            11
+#define DATA_PIN             12
+#define REGISTERS            4
+
+static uint8_t inputs[REGISTERS];           // parallel inputs D0..D7 of every register
+static uint8_t chain[REGISTERS];            // shift registers, chain[0] drives QH
+static uint8_t clockLevel = LOW;
+static uint32_t loads     = 0;
+
+static void load()
+{
+   memcpy(chain, inputs, sizeof(chain));
+   loads++;
+}
+
+// shifts every register by one bit, towards QH (D7) of register 0
+static void shift()
+{
+   for (uint8_t r = 0; r < REGISTERS; r++)
+   {
+      uint8_t serialIn = (r + 1 < REGISTERS) ? chain[r + 1] >> 7 : 0;
+      chain[r] = (chain[r] << 1) | serialIn;
+   }
+}
+
+static void chipWrite(uint8_t pin, uint8_t val)
+{
+   if ((pin == LOAD_PIN) && (val == LOW))
+   {
+      load();
+   }
+   else if (pin == CLOCK_PIN)
+   {
+      if ((val == HIGH) && (clockLevel == LOW) && (FlightSimHost::getPin(LOAD_PIN) == HIGH))
+      {
+         shift();
+      }
+      clockLevel = val;
+   }
+}
+
+static int chipRead(uint8_t pin)
+{
+   return (pin == DATA_PIN) ? chain[0] >> 7 : LOW;
+}
+
+// SPI mode 0, MSB first: a transfer clocks in the next 8 bits from QH
+static uint8_t chipTransfer(uint8_t data)
+{
+   uint8_t in = 0;
+   for (uint8_t i = 0; i < 8; i++)
+   {
+      in = (in << 1) | (chain[0] >> 7);
+      shift();
+   }
+   return in;
+}
+
+
+static void setInputs(const uint8_t *values)
+{
+   memcpy(inputs, values, sizeof(inputs));
+}
+
+
+// a closed switch pulls its input low, the column reads 1
+static void checkColumns(FlightSimShiftRegisterInput& input, uint8_t rows)
+{
+   uint8_t registersPerRow = REGISTERS / rows;
+   input.startFrame();
+   for (uint8_t row = 0; row < rows; row++)
+   {
+      uint32_t readData[2] = { 0 };
+      input.readRow(row, readData);
+      for (uint8_t column = 0; column < registersPerRow * 8; column++)
+      {
+         uint8_t r      = row * registersPerRow + column / 8;
+         bool    closed = !(inputs[r] & _BV32(column % 8));
+         CHECK_EQUAL(closed, (readData[MATRIX_WORD(column)] >> MATRIX_BIT(column)) & 1);
+      }
+   }
+}
+
+
+static void testBitOrder(FlightSimShiftRegisterInput& input, uint8_t rows)
+{
+   static const uint8_t patterns[][REGISTERS] = {
+      { 0xff, 0xff, 0xff, 0xff },
+      { 0x00, 0x00, 0x00, 0x00 },
+      { 0xfe, 0xff, 0xff, 0xff },           // D0 of register 0: column 0
+      { 0x7f, 0xff, 0xff, 0xff },           // D7 of register 0: column 7
+      { 0xff, 0xfe, 0xff, 0xff },           // D0 of register 1: column 8
+      { 0xff, 0xff, 0xff, 0x7f },           // D7 of the last register
+      { 0x12, 0x34, 0x56, 0x78 },
+      { 0xa5, 0x5a, 0x0f, 0xf0 }
+   };
+
+   CHECK(input.begin());
+   for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++)
+   {
+      setInputs(patterns[i]);
+      uint32_t before = loads;
+      checkColumns(input, rows);
+      CHECK_EQUAL(before + 1, loads);
+   }
+}
+
+
+// the columns arrive in a matrix as switches
+static void testMatrix()
+{
+   FlightSimSwitchMatrix<1, 32> switches;
+   FlightSimShiftRegisterInput input(LOAD_PIN, CLOCK_PIN, DATA_PIN, REGISTERS);
+   switches.addInputSource(input);
+   switches.setScanMode(SCAN_FULL_FRAME);
+   switches.begin();
+
+   static const uint8_t pattern[REGISTERS] = { 0xfe, 0xbf, 0xff, 0x7f };
+   setInputs(pattern);
+   while (switches.getFrameCount() < 2)
+   {
+      switches.loop();
+      FlightSimHost::advanceMicros(100);
+   }
+   for (uint8_t column = 0; column < 32; column++)
+   {
+      CHECK_EQUAL((column == 0) || (column == 14) || (column == 31), switches.isOn(0, column));
+   }
+}
+
+
+int main()
+{
+   FlightSimHost::reset();
+   FlightSimHost::setSerialOutput(false);
+   FlightSimHost::onDigitalWrite(chipWrite);
+   FlightSimHost::onDigitalRead(chipRead);
+
+   FlightSimShiftRegisterInput oneRow(LOAD_PIN, CLOCK_PIN, DATA_PIN, REGISTERS);
+   testBitOrder(oneRow, 1);
+   FlightSimShiftRegisterInput twoRows(LOAD_PIN, CLOCK_PIN, DATA_PIN, REGISTERS, 2);
+   testBitOrder(twoRows, 2);
+
+   SPIClass spi;
+   spi.onTransfer(chipTransfer);
+   FlightSimShiftRegisterInput spiInput(spi, LOAD_PIN, REGISTERS);
+   testBitOrder(spiInput, 1);
+   CHECK_EQUAL(8 * REGISTERS, spi.getTransfers());
+
+   testMatrix();
+   return TEST_RESULT();
+}
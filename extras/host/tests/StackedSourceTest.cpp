@@ -0,0 +1,153 @@
+#include <FlightSimTest.h>
+
+/*
+ * Sources stacked in one matrix: a row of pins, a simulated chain of two
+ * 74HC165 read as two rows of 8 columns, and a 2 x 4 pin matrix. Matrix row 0
+ * is the pin row, rows 1 and 2 are the chain, rows 3 and 4 the pin matrix. A
+ * switch of every source reaches the element of its MATRIX() cell.
+ */
+
+#define ROWS                 5
+#define COLUMNS              8
+
+#define LOAD_PIN             10
+#define CLOCK_PIN            11
+#define DATA_PIN             12
+#define REGISTERS            2
+
+static const uint8_t firstPins[4]  = { 20, 21, 22, 23 };
+static const uint8_t rowPins[2]    = { 40, 41 };
+static const uint8_t columnPins[4] = { 30, 31, 32, 33 };
+
+FlightSimSwitchMatrix<ROWS, COLUMNS> switches;
+FlightSimPinInput firstRow(4, firstPins);
+FlightSimShiftRegisterInput chainRows(LOAD_PIN, CLOCK_PIN, DATA_PIN, REGISTERS, 2);
+FlightSimPinMatrixInput lastRows(2, rowPins, 4, columnPins);
+FlightSimOnOffCommandSwitch *elements[ROWS][COLUMNS];
+char names[ROWS][COLUMNS][2][16];
+
+static uint8_t inputs[REGISTERS] = { 0xff, 0xff };  // parallel inputs, low: closed
+static uint8_t chain[REGISTERS];                     // chain[0] drives QH
+static uint8_t clockLevel = LOW;
+
+
+// shifts every register by one bit, towards QH (D7) of register 0
+static void shift()
+{
+   for (uint8_t r = 0; r < REGISTERS; r++)
+   {
+      uint8_t serialIn = (r + 1 < REGISTERS) ? chain[r + 1] >> 7 : 0;
+      chain[r] = (chain[r] << 1) | serialIn;
+   }
+}
+
+
+// QH of register 0 drives the data pin
+static void setDataPin()
+{
+   FlightSimHost::setPin(DATA_PIN, chain[0] >> 7);
+}
+
+
+static void chipWrite(uint8_t pin, uint8_t val)
+{
+   if ((pin == LOAD_PIN) && (val == LOW))
+   {
+      memcpy(chain, inputs, sizeof(chain));
+      setDataPin();
+   }
+   else if (pin == CLOCK_PIN)
+   {
+      if ((val == HIGH) && (clockLevel == LOW) && (FlightSimHost::getPin(LOAD_PIN) == HIGH))
+      {
+         shift();
+         setDataPin();
+      }
+      clockLevel = val;
+   }
+}
+
+
+static void runFrame()
+{
+   uint32_t frames = switches.getFrameCount();
+   while (switches.getFrameCount() == frames)
+   {
+      switches.loop();
+      FlightSimHost::advanceMicros(100);
+   }
+}
+
+
+// closes or opens one switch of every source
+static void setSwitches(bool closed)
+{
+   FlightSimHost::setPin(firstPins[2], closed ? LOW : HIGH);
+   inputs[0] = closed ? (uint8_t) ~(1 << 5) : 0xff;   // register 0, D5: row 1, column 5
+   inputs[1] = closed ? (uint8_t) ~(1 << 0) : 0xff;   // register 1, D0: row 2, column 0
+   FlightSimHost::setSwitch(rowPins[1], columnPins[1], closed);   // row 4, column 1
+}
+
+
+static void testRowOffsets()
+{
+   static const uint8_t cells[][2] = { { 0, 2 }, { 1, 5 }, { 2, 0 }, { 4, 1 } };
+
+   FlightSimHost::clearEvents();
+   setSwitches(true);
+   runFrame();
+   CHECK_EQUAL(4, FlightSimHost::getNumberOfEvents());
+   for (uint8_t i = 0; i < 4; i++)
+   {
+      CHECK_EQUAL(1, countEvents(HOST_COMMAND_ONCE, names[cells[i][0]][cells[i][1]][0]));
+   }
+
+   for (uint8_t row = 0; row < ROWS; row++)
+   {
+      for (uint8_t column = 0; column < COLUMNS; column++)
+      {
+         bool closed = false;
+         for (uint8_t i = 0; i < 4; i++)
+         {
+            closed |= (cells[i][0] == row) && (cells[i][1] == column);
+         }
+         CHECK_EQUAL(closed, switches.isOn(row, column));
+      }
+   }
+
+   FlightSimHost::clearEvents();
+   setSwitches(false);
+   runFrame();
+   CHECK_EQUAL(4, FlightSimHost::getNumberOfEvents());
+   for (uint8_t i = 0; i < 4; i++)
+   {
+      CHECK_EQUAL(1, countEvents(HOST_COMMAND_ONCE, names[cells[i][0]][cells[i][1]][1]));
+   }
+}
+
+
+int main()
+{
+   FlightSimHost::reset();
+   FlightSimHost::setSerialOutput(false);
+   FlightSimHost::onDigitalWrite(chipWrite);
+
+   for (uint8_t row = 0; row < ROWS; row++)
+   {
+      for (uint8_t column = 0; column < COLUMNS; column++)
+      {
+         snprintf(names[row][column][0], sizeof(names[row][column][0]), "r%uc%u_on", row, column);
+         snprintf(names[row][column][1], sizeof(names[row][column][1]), "r%uc%u_off", row, column);
+         elements[row][column] = new FlightSimOnOffCommandSwitch(switches, MATRIX(row, column));
+         elements[row][column]->setOnOffCommands(XPlaneRef(names[row][column][0]), XPlaneRef(names[row][column][1]));
+      }
+   }
+   switches.addInputSource(firstRow);
+   switches.addInputSource(chainRows);
+   switches.addInputSource(lastRows);
+   switches.begin();
+   runFrame();
+
+   testRowOffsets();
+   return TEST_RESULT();
+}
@@ -0,0 +1,114 @@
+#include <FlightSimTest.h>
+
+/*
+ * Value index of multi-position switches. Without memory for the index, the
+ * lookups scan the value table and give the same positions and detents.
+ */
+
+// glibc allocator under a switch, to run out of memory on purpose
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void __libc_free(void *ptr);
+
+static bool   failAllocations = false;
+static size_t allocations     = 0;
+
+extern "C" void *malloc(size_t size)
+{
+   if (failAllocations)
+   {
+      return NULL;
+   }
+   allocations++;
+   return __libc_malloc(size);
+}
+
+extern "C" void free(void *ptr)
+{
+   if (ptr)
+   {
+      allocations--;
+   }
+   __libc_free(ptr);
+}
+
+
+// 20 and 20.0005 are one detent, the positions are not sorted
+static const float   values[]  = { 0, 10, 20, 20.0005, 30, 5 };
+static const uint8_t positions = sizeof(values) / sizeof(values[0]);
+static const float   tolerance = 0.001;
+
+
+static void testFallback()
+{
+   FlightSimValueIndex index;
+   FlightSimValueIndex linear;
+   CHECK(index.build(positions, values, tolerance));
+   CHECK(index.isBuilt());
+
+   failAllocations = true;
+   CHECK(!linear.build(positions, values, tolerance));
+   failAllocations = false;
+   CHECK(!linear.isBuilt());
+   CHECK(linear.hasFailed());
+
+   for (float value = -5; value <= 35; value += 0.25)
+   {
+      CHECK_EQUAL(index.findPosition(value), linear.findPosition(value));
+   }
+   CHECK_EQUAL(2, linear.findPosition(20.0003));
+   CHECK_EQUAL(2, index.findPosition(20.0003));
+
+   for (uint8_t position = 0; position < positions; position++)
+   {
+      CHECK_EQUAL(index.getStep(position), linear.getStep(position));
+   }
+   CHECK_EQUAL(3, linear.getStep(3));
+
+   // commands are sent one at a time
+   CHECK_EQUAL(3, index.countSteps(0, 20));
+   CHECK_EQUAL(1, linear.countSteps(0, 20));
+
+   // tried again after invalidate()
+   linear.invalidate();
+   CHECK(!linear.hasFailed());
+   CHECK(linear.build(positions, values, tolerance));
+   CHECK_EQUAL(3, linear.countSteps(0, 20));
+}
+
+
+static void testEmpty()
+{
+   FlightSimValueIndex index;
+   FlightSimValueIndex linear;
+   CHECK(index.build(0, NULL, tolerance));
+   failAllocations = true;
+   CHECK(linear.build(0, NULL, tolerance));
+   failAllocations = false;
+   CHECK_EQUAL(-1, index.findPosition(1));
+   CHECK_EQUAL(-1, linear.findPosition(1));
+}
+
+
+// the index frees its table
+static void testFree()
+{
+   size_t before = allocations;
+   {
+      FlightSimValueIndex index;
+      index.build(positions, values, tolerance);
+      index.invalidate();
+      index.build(positions, values, tolerance);
+      CHECK_EQUAL(before + 1, allocations);
+   }
+   CHECK_EQUAL(before, allocations);
+}
+
+
+int main()
+{
+   FlightSimHost::setSerialOutput(false);
+   testFallback();
+   testEmpty();
+   testFree();
+   return TEST_RESULT();
+}
@@ -0,0 +1,105 @@
+#include <FlightSimTest.h>
+
+/*
+ * Matrix wider than 32 columns: a row spans two words. Switches on both sides
+ * of the word boundary (columns 31 and 32) and in the last column reach the
+ * element of their cell, and no other.
+ */
+
+#define ROWS                 2
+#define COLUMNS              40
+
+static const uint8_t rowPins[ROWS]       = { 2, 3 };
+static const uint8_t columnPins[COLUMNS] = { 10, 11, 12, 13, 14, 15, 16, 17, 18, 19,
+                                             20, 21, 22, 23, 24, 25, 26, 27, 28, 29,
+                                             30, 31, 32, 33, 34, 35, 36, 37, 38, 39,
+                                             40, 41, 42, 43, 44, 45, 46, 47, 48, 49 };
+
+FlightSimSwitchMatrix<ROWS, COLUMNS> switches(ROWS, rowPins, COLUMNS, columnPins, 2);
+FlightSimOnOffCommandSwitch *elements[ROWS][COLUMNS];
+char names[ROWS][COLUMNS][2][16];
+
+
+static void runFrame()
+{
+   uint32_t frames = switches.getFrameCount();
+   while (switches.getFrameCount() == frames)
+   {
+      switches.loop();
+      FlightSimHost::advanceMicros(100);
+   }
+}
+
+
+static void setSwitch(uint8_t row, uint8_t column, bool closed)
+{
+   FlightSimHost::setSwitch(rowPins[row], columnPins[column], closed);
+}
+
+
+// events of exactly the switches that were set
+static void checkEvents(uint8_t type, uint8_t name, size_t count, const uint8_t cells[][2])
+{
+   CHECK_EQUAL(count, FlightSimHost::getNumberOfEvents());
+   for (size_t i = 0; i < count; i++)
+   {
+      CHECK_EQUAL(1, countEvents(type, names[cells[i][0]][cells[i][1]][name]));
+   }
+}
+
+
+static void testWordBoundary()
+{
+   static const uint8_t cells[][2] = { { 1, 31 }, { 0, 32 }, { 1, COLUMNS - 1 } };
+
+   FlightSimHost::clearEvents();
+   for (size_t i = 0; i < 3; i++)
+   {
+      setSwitch(cells[i][0], cells[i][1], true);
+   }
+   runFrame();
+   checkEvents(HOST_COMMAND_ONCE, 0, 3, cells);
+
+   for (uint8_t row = 0; row < ROWS; row++)
+   {
+      for (uint8_t column = 0; column < COLUMNS; column++)
+      {
+         bool closed = ((row == 1) && (column == 31)) || ((row == 0) && (column == 32)) ||
+                       ((row == 1) && (column == COLUMNS - 1));
+         CHECK_EQUAL(closed, switches.isOn(row, column));
+         CHECK_EQUAL(closed, elements[row][column]->getValue());
+      }
+   }
+
+   // one at a time, back open
+   for (size_t i = 0; i < 3; i++)
+   {
+      FlightSimHost::clearEvents();
+      setSwitch(cells[i][0], cells[i][1], false);
+      runFrame();
+      checkEvents(HOST_COMMAND_ONCE, 1, 1, &cells[i]);
+   }
+}
+
+
+int main()
+{
+   FlightSimHost::reset();
+   FlightSimHost::setSerialOutput(false);
+   for (uint8_t row = 0; row < ROWS; row++)
+   {
+      for (uint8_t column = 0; column < COLUMNS; column++)
+      {
+         snprintf(names[row][column][0], sizeof(names[row][column][0]), "r%uc%u_on", row, column);
+         snprintf(names[row][column][1], sizeof(names[row][column][1]), "r%uc%u_off", row, column);
+         elements[row][column] = new FlightSimOnOffCommandSwitch(switches, MATRIX(row, column));
+         elements[row][column]->setOnOffCommands(XPlaneRef(names[row][column][0]), XPlaneRef(names[row][column][1]));
+      }
+   }
+   switches.begin();
+   CHECK_EQUAL(2, switches.getWordsPerRow());
+   runFrame();
+
+   testWordBoundary();
+   return TEST_RESULT();
+}
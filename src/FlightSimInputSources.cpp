@@ -0,0 +1,236 @@
+#include "FlightSimInputSources.h"
+#include <SPI.h>
+#include <Wire.h>
+
+// MCP23017 registers (IOCON.BANK = 0)
+#define MCP23017_IODIRA      (0x00)
+#define MCP23017_IOCON       (0x0A)
+#define MCP23017_GPIOA       (0x12)
+#define MCP23017_IOCON_MIRROR   (0x40)
+#define MCP23017_IOCON_ODR      (0x04)
+
+/*
+ * Input sources for Teensy Flightsim projects
+ *
+ * (c) Jorg Neves Bliesener
+ */
+
+
+/*
+ * 74HC165 shift register chain. SH/LD is pulsed LOW to latch all inputs, the
+ * first bit (D7 of register 0) is then available on QH before the first clock.
+ */
+
+FlightSimShiftRegisterInput::FlightSimShiftRegisterInput(uint8_t loadPin, uint8_t clockPin, uint8_t dataPin, uint8_t numberOfRegisters,
+                                                         uint8_t numberOfRows, bool activeLow)
+{
+   this->spi               = NULL;
+   this->clockSpeed        = DEFAULT_SHIFT_REGISTER_CLOCK;
+   this->loadPin           = loadPin;
+   this->clockPin          = clockPin;
+   this->dataPin           = dataPin;
+   this->numberOfRegisters = numberOfRegisters;
+   this->numberOfRows      = numberOfRows;
+   this->activeLow         = activeLow;
+}
+
+
+FlightSimShiftRegisterInput::FlightSimShiftRegisterInput(SPIClass& spi, uint8_t loadPin, uint8_t numberOfRegisters,
+                                                         uint8_t numberOfRows, bool activeLow)
+   : FlightSimShiftRegisterInput(loadPin, 0xff, 0xff, numberOfRegisters, numberOfRows, activeLow)
+{
+   this->spi = &spi;
+}
+
+
+bool FlightSimShiftRegisterInput::begin()
+{
+   if (!numberOfRegisters || !numberOfRows || (numberOfRegisters % numberOfRows))
+   {
+      Serial.println(F("FlightSimShiftRegisterInput ERROR: The number of registers must be a multiple of the number of rows"));
+      return false;
+   }
+
+   if (getNumberOfColumns() > MAX_MATRIX_COLUMNS)
+   {
+      Serial.print(F("FlightSimShiftRegisterInput ERROR: Sorry, "));
+      Serial.print(MAX_MATRIX_COLUMNS / 8);
+      Serial.println(F(" registers per row max"));
+      return false;
+   }
+
+   pinMode(loadPin, OUTPUT);
+   digitalWrite(loadPin, HIGH);
+   if (spi)
+   {
+      spi->begin();
+   }
+   else
+   {
+      pinMode(clockPin, OUTPUT);
+      digitalWrite(clockPin, LOW);
+      pinMode(dataPin, INPUT);
+   }
+   return true;
+}
+
+
+void FlightSimShiftRegisterInput::startFrame()
+{
+   digitalWrite(loadPin, LOW);
+   delayMicroseconds(1);
+   digitalWrite(loadPin, HIGH);
+}
+
+
+void FlightSimShiftRegisterInput::readRow(uint8_t row, uint32_t *readData)
+{
+   uint8_t registersPerRow = numberOfRegisters / numberOfRows;
+
+   if (spi)
+   {
+      spi->beginTransaction(SPISettings(clockSpeed, MSBFIRST, SPI_MODE0));
+   }
+   for (uint8_t i = 0; i < registersPerRow; i++)
+   {
+      uint8_t data = spi ? spi->transfer(0) : shiftInByte();
+      if (activeLow)
+      {
+         data = ~data;
+      }
+      readData[i / 4] |= ((uint32_t) data) << (8 * (i % 4));
+   }
+   if (spi)
+   {
+      spi->endTransaction();
+   }
+}
+
+
+uint8_t FlightSimShiftRegisterInput::shiftInByte()
+{
+   uint8_t data = 0;
+   for (uint8_t i = 0; i < 8; i++)
+   {
+      data = (data << 1) | (digitalRead(dataPin) == HIGH ? 1 : 0);
+      digitalWrite(clockPin, HIGH);
+      digitalWrite(clockPin, LOW);
+   }
+   return data;
+}
+
+
+/*
+ * MCP23017 port expanders. The configuration registers IODIR to GPPU are written
+ * in a single sequential transaction. Input polarity is inverted for active low
+ * switches, so a closed switch always reads as 1.
+ */
+
+FlightSimMCP23017Input::FlightSimMCP23017Input(TwoWire& wire, uint8_t address, uint8_t numberOfDevices,
+                                               uint8_t interruptPin, bool activeLow)
+{
+   this->wire            = &wire;
+   this->address         = address;
+   this->numberOfDevices = numberOfDevices;
+   this->interruptPin    = interruptPin;
+   this->activeLow       = activeLow;
+   this->pullups         = activeLow;
+   this->firstFrame      = true;
+   this->errors          = 0;
+   memset(portData, 0, sizeof(portData));
+}
+
+
+bool FlightSimMCP23017Input::begin()
+{
+   if (!numberOfDevices || (numberOfDevices > MAX_MCP23017_DEVICES))
+   {
+      Serial.print(F("FlightSimMCP23017Input ERROR: Sorry, 1 to "));
+      Serial.print(MAX_MCP23017_DEVICES);
+      Serial.println(F(" devices only"));
+      return false;
+   }
+
+   wire->begin();
+   for (uint8_t device = 0; device < numberOfDevices; device++)
+   {
+      uint8_t polarity = activeLow ? 0xff : 0x00;
+      uint8_t pullup   = pullups ? 0xff : 0x00;
+      uint8_t iocon    = MCP23017_IOCON_MIRROR | MCP23017_IOCON_ODR;
+
+      wire->beginTransmission(address + device);
+      wire->write(MCP23017_IODIRA);
+      wire->write(0xff);                // IODIRA/B: all inputs
+      wire->write(0xff);
+      wire->write(polarity);            // IPOLA/B
+      wire->write(polarity);
+      wire->write(0xff);                // GPINTENA/B: interrupt on change
+      wire->write(0xff);
+      wire->write(0x00);                // DEFVALA/B
+      wire->write(0x00);
+      wire->write(0x00);                // INTCONA/B: compare against previous value
+      wire->write(0x00);
+      wire->write(iocon);               // IOCON (twice, same register)
+      wire->write(iocon);
+      wire->write(pullup);              // GPPUA/B
+      wire->write(pullup);
+      if (wire->endTransmission() != 0)
+      {
+         Serial.print(F("FlightSimMCP23017Input ERROR: No device at address 0x"));
+         Serial.println(address + device, HEX);
+         return false;
+      }
+   }
+
+   if (interruptPin != NO_INTERRUPT_PIN)
+   {
+      pinMode(interruptPin, INPUT_PULLUP);
+   }
+   firstFrame = true;
+   return true;
+}
+
+
+bool FlightSimMCP23017Input::frameChanged()
+{
+   if (firstFrame || (interruptPin == NO_INTERRUPT_PIN))
+   {
+      return true;
+   }
+   return digitalRead(interruptPin) == LOW;
+}
+
+
+void FlightSimMCP23017Input::readRow(uint8_t row, uint32_t *readData)
+{
+   for (uint8_t device = 0; device < numberOfDevices; device++)
+   {
+      // keep the previous state of a device that could not be read
+      if (!readDevice(device))
+      {
+         errors++;
+      }
+      readData[device / 2] |= ((uint32_t) portData[device]) << (16 * (device % 2));
+   }
+   firstFrame = false;
+}
+
+
+bool FlightSimMCP23017Input::readDevice(uint8_t device)
+{
+   // reading GPIOA/B also clears the interrupt
+   wire->beginTransmission(address + device);
+   wire->write(MCP23017_GPIOA);
+   if (wire->endTransmission(false) != 0)
+   {
+      return false;
+   }
+   if (wire->requestFrom((uint8_t) (address + device), (uint8_t) 2) != 2)
+   {
+      return false;
+   }
+   uint8_t portA = wire->read();
+   uint8_t portB = wire->read();
+   portData[device] = ((uint16_t) portB << 8) | portA;
+   return true;
+}
@@ -0,0 +1,130 @@
+#ifndef _FLIGHTSIM_INPUT_SOURCES_H
+#define _FLIGHTSIM_INPUT_SOURCES_H
+
+#include "FlightSimSwitches.h"
+
+/*
+ * Input sources for Teensy Flightsim projects
+ *
+ * (c) Jorg Neves Bliesener
+ */
+
+class SPIClass;
+class TwoWire;
+
+// default values
+#define DEFAULT_SHIFT_REGISTER_CLOCK    (4000000)  // default SPI clock for shift registers in Hz
+#define MCP23017_BASE_ADDRESS           (0x20)
+#define MAX_MCP23017_DEVICES            (8)
+#define NO_INTERRUPT_PIN                (0xff)
+
+// alternative names
+#define ShiftRegisterInput               FlightSimShiftRegisterInput
+#define MCP23017Input                    FlightSimMCP23017Input
+
+/*
+ * Chain of 74HC165 parallel-in/serial-out shift registers. All inputs are latched
+ * at the start of a frame and then clocked in row by row, either bit-banged or
+ * through a hardware SPI port.
+ *
+ * Register 0 is the one connected to the data pin (MISO). Input Dn of register r
+ * is column r * 8 + n. With more than one row, every row gets the same number of
+ * registers: registers 0..k-1 are row 0, k..2k-1 row 1 and so on.
+ *
+ * When the SPI bus is shared with other devices, either wire CLK INH to a chip
+ * select or use SCAN_FULL_FRAME, so that no foreign clocks shift the chain
+ * between two rows.
+ */
+class FlightSimShiftRegisterInput : public FlightSimInputSource {
+public:
+   FlightSimShiftRegisterInput(uint8_t loadPin, uint8_t clockPin, uint8_t dataPin, uint8_t numberOfRegisters,
+                               uint8_t numberOfRows = 1, bool activeLow = true);
+   FlightSimShiftRegisterInput(SPIClass& spi, uint8_t loadPin, uint8_t numberOfRegisters,
+                               uint8_t numberOfRows = 1, bool activeLow = true);
+
+   void setClockSpeed(uint32_t clockSpeed)
+   {
+      this->clockSpeed = clockSpeed;
+   }
+
+   virtual bool begin();
+   virtual void startFrame();
+   virtual void readRow(uint8_t row, uint32_t *readData);
+
+   virtual uint8_t getNumberOfRows()
+   {
+      return numberOfRows;
+   }
+
+   virtual uint16_t getNumberOfColumns()
+   {
+      return (uint16_t) numberOfRegisters * 8 / numberOfRows;
+   }
+
+private:
+   uint8_t shiftInByte();
+
+   SPIClass *spi;
+   uint32_t clockSpeed;
+   uint8_t loadPin;
+   uint8_t clockPin;
+   uint8_t dataPin;
+   uint8_t numberOfRegisters;
+   uint8_t numberOfRows;
+   bool activeLow;
+};
+
+/*
+ * One or more MCP23017 I2C port expanders at consecutive addresses, all 16 pins
+ * used as inputs. Every expander is read with a single burst transaction of
+ * GPIOA and GPIOB and adds 16 columns to the (single) row: GPA0..7 of expander d
+ * are columns d * 16 + 0..7, GPB0..7 are columns d * 16 + 8..15.
+ *
+ * The expanders are set up with mirrored, open drain interrupt outputs, so the
+ * INTA/INTB lines of all of them can be tied to one interrupt pin. While that
+ * pin is HIGH, no input has changed and the I2C bus is not touched at all.
+ */
+class FlightSimMCP23017Input : public FlightSimInputSource {
+public:
+   FlightSimMCP23017Input(TwoWire& wire, uint8_t address = MCP23017_BASE_ADDRESS, uint8_t numberOfDevices = 1,
+                          uint8_t interruptPin = NO_INTERRUPT_PIN, bool activeLow = true);
+
+   void setPullups(bool pullups)
+   {
+      this->pullups = pullups;
+   }
+
+   virtual bool begin();
+   virtual bool frameChanged();
+   virtual void readRow(uint8_t row, uint32_t *readData);
+
+   virtual uint8_t getNumberOfRows()
+   {
+      return 1;
+   }
+
+   virtual uint16_t getNumberOfColumns()
+   {
+      return (uint16_t) numberOfDevices * 16;
+   }
+
+   uint32_t getErrors()
+   {
+      return errors;
+   }
+
+private:
+   bool readDevice(uint8_t device);
+
+   TwoWire *wire;
+   uint8_t address;
+   uint8_t numberOfDevices;
+   uint8_t interruptPin;
+   bool activeLow;
+   bool pullups;
+   bool firstFrame;
+   uint16_t portData[MAX_MCP23017_DEVICES];
+   uint32_t errors;
+};
+
+#endif // _FLIGHTSIM_INPUT_SOURCES_H
@@ -7,7 +7,9 @@
  */
 
 
-/* Switch matrix - handles an arbitrary number of rows, each with up to 32 columns
+/* Switch matrix - handles up to 255 rows, each with up to 256 columns. The maximum
+ * size of a matrix is set at compile time through FlightSimSwitchMatrix<rows, columns>,
+ * FlightSimSwitches is a 32x32 matrix.
  *
  * The rows can be multiplexed through a 74HCT/LS154 or 74HCT/LS138 chip. The rows
  * will be the OUTPUT lines, the columns will be the INPUT lines. Exactly one row
@@ -15,87 +17,320 @@
  * HIGH.
  */
 
-FlightSimSwitches *FlightSimSwitches::firstMatrix = NULL;
-const uint8_t     FLIGHTSIM_EMPTY_PINS[]          = {};
+FlightSimSwitchesBase *FlightSimSwitchesBase::firstMatrix = NULL;
+#ifdef FLIGHTSIM_BACKGROUND_SCAN
+FlightSimSwitchesBase *FlightSimSwitchesBase::backgroundMatrix = NULL;
+#endif
+const uint8_t         FLIGHTSIM_EMPTY_PINS[]              = {};
+
+FlightSimSwitchesBase::FlightSimSwitchesBase(uint32_t *storage, uint8_t maxRows, uint16_t maxColumns, uint8_t *dynamicColumnPins,
+                                             uint32_t scanRate, bool activeLow)
+   : pinInput(1, FLIGHTSIM_EMPTY_PINS, 0, dynamicColumnPins, activeLow, false)
+{
+   setStorage(storage, maxRows, maxColumns, dynamicColumnPins);
+   init(scanRate);
+   this->columnPinsAreDynamic = true;
+}
+
+
+FlightSimSwitchesBase::FlightSimSwitchesBase(uint32_t *storage, uint8_t maxRows, uint16_t maxColumns, uint8_t *dynamicColumnPins,
+                                             uint8_t numberOfRows, const uint8_t *rowPins,
+                                             uint16_t numberOfColumns, const uint8_t *columnPins,
+                                             uint32_t scanRate, bool activeLow, bool rowsMuxed)
+   : pinInput(numberOfRows, rowPins, numberOfColumns, columnPins, activeLow, rowsMuxed)
+{
+   setStorage(storage, maxRows, maxColumns, dynamicColumnPins);
+   init(scanRate);
+   this->columnPinsAreDynamic = false;
+}
 
-FlightSimSwitches::FlightSimSwitches(uint32_t scanRate, bool activeLow)
+
+void FlightSimSwitchesBase::init(uint32_t scanRate)
 {
    if (firstMatrix == NULL)
    {
       firstMatrix = this;
    }
 
-   this->numberOfRows           = 1;
-   this->rowPins                = FLIGHTSIM_EMPTY_PINS;
-   this->numberOfRowPins        = 0;
-   this->rowsMuxed              = false;
+   this->numberOfRows           = 0;
    this->numberOfColumns        = 0;
-   this->columnPins             = dynamicColumnPins;
-   this->columnPinsAreDynamic   = true;
    this->currentRow             = 0;
    this->initialized            = false;
    this->matrixTimer            = 0;
    this->scanRate               = scanRate;
-   this->lastRow                = 0xff;
-   this->activeLow              = activeLow;
+   this->scanMode               = SCAN_ROW_BY_ROW;
+   this->frameSnapshot          = false;
+   this->settleTime             = DEFAULT_SETTLE_TIME;
+   this->frameStart             = 0;
+   this->frameDuration          = 0;
+   this->frameCount             = 0;
    this->hasChangedLoop         = false;
    this->hasChangedPoll         = false;
    this->changePositionCallback = NULL;
    this->changeMatrixCallback   = NULL;
    this->lastEnabled            = false;
+   this->resyncCursor           = NULL;
+   this->resyncChunkSize        = DEFAULT_RESYNC_CHUNK;
+   this->resyncRemaining        = 0;
+   this->resyncStart            = 0;
+   this->resyncDuration         = 0;
+   this->resyncCompleteCallback = NULL;
+   this->eventBuffer            = NULL;
+   this->debugLog               = NULL;
    this->debugScan              = false;
    this->debugConfig            = false;
+   this->cellIndex              = NULL;
+   this->cellIndexSize          = 0;
+   this->dispatchAll            = true;
+   this->pollingElements        = 0;
+   this->unindexedElements      = 0;
+   this->firstPending           = NULL;
+   this->lastPending            = NULL;
+   this->firstElement           = NULL;
+   this->lastElement            = NULL;
+   this->numberOfElements       = 0;
+   this->firstSource            = NULL;
+   this->lastSource             = NULL;
+   this->currentSource          = NULL;
+   this->debouncePending        = false;
+   this->skippedFrames          = 0;
+   this->pinColumns             = NULL;
+#ifdef FLIGHTSIM_PROFILING
+   clearProfile();
+#endif
+   this->frameReady             = false;
+   this->overruns               = 0;
+   this->scanFrameTime          = 0;
+   this->scanStart              = 0;
+   this->scanRow                = 0;
 }
 
 
-FlightSimSwitches::FlightSimSwitches(uint8_t numberOfRows, const uint8_t *rowPins,
-                                     uint8_t numberOfColumns, const uint8_t *columnPins,
-                                     uint32_t scanRate, bool activeLow, bool rowsMuxed)
+/*
+ * The row data lives in the storage array of FlightSimSwitchMatrix, which is
+ * sized at compile time. It is split into planes of maxRows * wordsPerRow words,
+ * one for the row data and one for the changed cells.
+ */
+void FlightSimSwitchesBase::setStorage(uint32_t *storage, uint8_t maxRows, uint16_t maxColumns, uint8_t *dynamicColumnPins)
 {
-   if (firstMatrix == NULL)
+   this->maxRows           = maxRows;
+   this->maxColumns        = maxColumns;
+   this->wordsPerRow       = MATRIX_WORDS(maxColumns);
+   this->dynamicColumnPins = dynamicColumnPins;
+   this->staticStorage     = storage;
+   this->planeStorage      = NULL;
+   this->rowData           = storage;
+   this->changedData       = storage + maxRows * wordsPerRow;
+   this->nextRowData       = rowData;
+   this->frameChangedData  = changedData;
+   this->rawData           = NULL;
+   this->scanData          = NULL;
+   this->debounceCounters  = NULL;
+}
+
+
+/*
+ * Allocates the planes that only some features need, all in one block: the back
+ * buffer of the frame snapshot, raw data and vertical counters of the debouncer,
+ * raw data and scan buffer of the background scan. Planes that are not needed
+ * alias the static row data and changed cells, or are NULL.
+ */
+bool FlightSimSwitchesBase::allocatePlanes()
+{
+   bool     debounce   = debouncer.isActive();
+   bool     background = (scanMode == SCAN_BACKGROUND);
+   bool     raw        = debounce || background;
+   uint32_t planeSize  = numberOfRows * wordsPerRow;
+   uint8_t  planes     = (frameSnapshot ? 2 : 0) + (raw ? 1 : 0) + (background ? 1 : 0) + (debounce ? DEBOUNCE_BITS : 0);
+
+   free(planeStorage);
+   setStorage(staticStorage, maxRows, maxColumns, dynamicColumnPins);
+   if (!planes)
    {
-      firstMatrix = this;
+      return true;
    }
-   this->numberOfRows           = numberOfRows;
-   this->numberOfRowPins        = 0;
-   this->rowPins                = rowPins;
-   this->rowsMuxed              = rowsMuxed;
-   this->numberOfColumns        = numberOfColumns;
-   this->columnPins             = columnPins;
-   this->columnPinsAreDynamic   = false;
-   this->currentRow             = 0;
-   this->initialized            = false;
-   this->matrixTimer            = 0;
-   this->scanRate               = scanRate;
-   this->lastRow                = 0xff;
-   this->activeLow              = activeLow;
-   this->hasChangedLoop         = false;
-   this->hasChangedPoll         = false;
-   this->changePositionCallback = NULL;
-   this->changeMatrixCallback   = NULL;
-   this->lastEnabled            = false;
-   this->debugScan              = false;
-   this->debugConfig            = false;
+
+   planeStorage = (uint32_t *) malloc(planes * planeSize * sizeof(uint32_t));
+   if (!planeStorage)
+   {
+      printTime(&Serial);
+      Serial.println(F("FlightSimSwitches ERROR: Not enough memory for the debouncer, frame snapshot or background scan"));
+      return false;
+   }
+   memset(planeStorage, 0, planes * planeSize * sizeof(uint32_t));
+
+   uint32_t *plane = planeStorage;
+   if (frameSnapshot)
+   {
+      nextRowData      = plane;
+      frameChangedData = plane + planeSize;
+      plane           += 2 * planeSize;
+   }
+   if (raw)
+   {
+      rawData = plane;
+      plane  += planeSize;
+   }
+   if (background)
+   {
+      scanData = plane;
+      plane   += planeSize;
+   }
+   if (debounce)
+   {
+      debounceCounters = plane;
+   }
+   return true;
 }
 
 
-FlightSimSwitches::FlightSimSwitches(uint8_t numberOfColumns, const uint8_t *columnPins,
-                                     uint32_t scanRate, bool activeLow)
-   : FlightSimSwitches(1, FLIGHTSIM_EMPTY_PINS, numberOfColumns, columnPins, scanRate, activeLow)
+void FlightSimSwitchesBase::printTime(Stream *s)
 {
+   printTime(s, millis());
 }
 
 
-void FlightSimSwitches::printTime(Stream *s)
+void FlightSimSwitchesBase::printTime(Stream *s, uint32_t time)
 {
    char buf[13];
 
-   sprintf(buf, "%10lu: ", millis());
+   sprintf(buf, "%10lu: ", (unsigned long) time);
    s->print(buf);
 }
 
 
-bool FlightSimSwitches::checkInitialized(const __FlashStringHelper *message, bool mustBeInitialized)
+/*
+ * Debug output of elements. Records go to the debug log if there is one, else
+ * they are printed right away
+ */
+void FlightSimSwitchesBase::log(uint8_t event, const _XpRefStr_ *name, float value1, float value2, float value3,
+                                int16_t index, bool resync)
+{
+   FlightSimLogRecord record;
+   record.time      = millis();
+   record.name      = name;
+   record.values[0] = value1;
+   record.values[1] = value2;
+   record.values[2] = value3;
+   record.index     = index;
+   record.event     = event;
+   record.resync    = resync;
+
+   if (debugLog)
+   {
+      debugLog->push(&record);
+      return;
+   }
+   printLogRecord(&record);
+}
+
+
+void FlightSimSwitchesBase::flushDebugLog(uint16_t maxRecords)
+{
+   FlightSimLogRecord record;
+   for (uint16_t i = 0; (i < maxRecords) && debugLog && debugLog->pop(&record); i++)
+   {
+      printLogRecord(&record);
+   }
+}
+
+
+void FlightSimSwitchesBase::printLogRecord(const FlightSimLogRecord *record)
+{
+   printTime(&Serial, record->time);
+   switch (record->event)
+   {
+   case LOG_ONOFF_COMMAND_ON:
+      Serial.print(F("FlightSimOnOffCommandSwitch: Sending ON command "));
+      Serial.println(PRINT_DATAREF(record->name));
+      break;
+
+   case LOG_ONOFF_COMMAND_OFF:
+      Serial.print(F("FlightSimOnOffCommandSwitch: Sending OFF command "));
+      Serial.println(PRINT_DATAREF(record->name));
+      break;
+
+   case LOG_PUSHBUTTON_BEGIN:
+   case LOG_PUSHBUTTON_END:
+      Serial.print(F("FlightSimOnOffCommandSwitch: Sending command "));
+      Serial.print(PRINT_DATAREF(record->name));
+      Serial.println((record->event == LOG_PUSHBUTTON_BEGIN) ? F(" BEGIN") : F(" END"));
+      break;
+
+   case LOG_UPDOWN_CHANGED:
+      Serial.print(F("FlightSimUpDownCommandSwitch: dataref name: "));
+      Serial.print(PRINT_DATAREF(record->name));
+      Serial.print(F(", switch value="));
+      Serial.print(record->values[0]);
+      Serial.print(F(", old switch value="));
+      Serial.print(record->values[1]);
+      Serial.print(F(", resync="));
+      Serial.print(record->resync ? F("TRUE") : F("FALSE"));
+      Serial.print(F(", valueIndex="));
+      Serial.print(record->index);
+      Serial.println(F(", switch changed!"));
+      break;
+
+   case LOG_UPDOWN_REACHED:
+   case LOG_UPDOWN_HANDLED:
+   case LOG_UPDOWN_UP:
+   case LOG_UPDOWN_DOWN:
+      Serial.print(F("FlightSimUpDownCommandSwitch: dataref name: "));
+      Serial.print(PRINT_DATAREF(record->name));
+      Serial.print(F(", switch value="));
+      Serial.print(record->values[0]);
+      Serial.print(F(", dataref value="));
+      Serial.print(record->values[1]);
+      if (record->event == LOG_UPDOWN_REACHED)
+      {
+         Serial.println(F(", final position reached!"));
+      }
+      else if (record->event == LOG_UPDOWN_HANDLED)
+      {
+         Serial.print(F(", old dataref value="));
+         Serial.print(record->values[2]);
+         Serial.println(F(", previous command handled!"));
+      }
+      else if (record->index > 1)
+      {
+         Serial.print(F(", sending "));
+         Serial.print(record->index);
+         Serial.println((record->event == LOG_UPDOWN_UP) ? F(" UP commands") : F(" DOWN commands"));
+      }
+      else
+      {
+         Serial.println((record->event == LOG_UPDOWN_UP) ? F(", sending UP command") : F(", sending DOWN command"));
+      }
+      break;
+
+   case LOG_ONOFF_DATAREF_WRITE:
+   case LOG_WRITE_DATAREF_WRITE:
+      Serial.print((record->event == LOG_ONOFF_DATAREF_WRITE) ? F("FlightSimOnOffDatarefSwitch: Writing value ")
+                                                              : F("FlightSimWriteDatarefSwitch: Writing value "));
+      Serial.print(record->values[0]);
+      Serial.print(F(" to dataref "));
+      Serial.println(PRINT_DATAREF(record->name));
+      break;
+
+   case LOG_ENCODER_UP:
+   case LOG_ENCODER_DOWN:
+      Serial.print(F("FlightSimEncoder: Sending "));
+      Serial.print(record->index);
+      Serial.print((record->event == LOG_ENCODER_UP) ? F(" UP command(s) ") : F(" DOWN command(s) "));
+      Serial.print(PRINT_DATAREF(record->name));
+      Serial.print(F(", value="));
+      Serial.println(record->values[0], 0);
+      break;
+
+   default:
+      Serial.print(F("FlightSimSwitches: unknown log event "));
+      Serial.println(record->event);
+      break;
+   }
+}
+
+
+bool FlightSimSwitchesBase::checkInitialized(const __FlashStringHelper *message, bool mustBeInitialized)
 {
    if (initialized != mustBeInitialized)
    {
@@ -116,155 +351,226 @@ bool FlightSimSwitches::checkInitialized(const __FlashStringHelper *message, boo
 }
 
 
-void FlightSimSwitches::begin()
+void FlightSimSwitchesBase::addSource(FlightSimInputSource *source)
 {
-   if (this->columnPinsAreDynamic)
+   source->nextSource = NULL;
+   if (lastSource)
    {
-      // find column pins
-      size_t  colIdxCtr    = 0;
-      uint8_t *colIdxPtr   = dynamicColumnPins;
-      bool    allPinsFound = true;
-      for (MatrixElement *elem = MatrixElement::firstElement; elem; elem = elem->nextElement)
-      {
-         if (elem->matrix == this)
-         {
-            size_t elementsStored = elem->setPinData(colIdxPtr, colIdxCtr);
-            if (elementsStored)
-            {
-               colIdxCtr += elementsStored;
-               colIdxPtr += elementsStored;
-            }
-            else
-            {
-               allPinsFound = false;
-            }
-         }
-      }
-      numberOfColumns = colIdxCtr;
+      lastSource->nextSource = source;
+   }
+   else
+   {
+      firstSource = source;
+   }
+   lastSource = source;
+}
 
 
-      if (!allPinsFound)
+void FlightSimSwitchesBase::begin()
+{
+   if (!firstSource)
+   {
+      // no other source set, use the Teensy pins
+      if (this->columnPinsAreDynamic)
       {
-         printTime(&Serial);
-         Serial.print(F("FlightSimSwitches WARNING: Not all pins could be assigned, only the first "));
-         Serial.print(MAX_COLUMNS);
-         Serial.println(F(" pins are active"));
+         findColumnPins();
       }
+      addSource(&pinInput);
+   }
 
-      if (debugConfig)
+   // stack the rows of all sources
+   uint16_t rows    = 0;
+   uint16_t columns = 0;
+   for (FlightSimInputSource *source = firstSource; source; source = source->nextSource)
+   {
+      source->firstRow = rows;
+      rows            += source->getNumberOfRows();
+      if (source->getNumberOfColumns() > columns)
       {
-         printTime(&Serial);
-         Serial.print(F("Pins: "));
-         for (size_t i = 0; i < numberOfColumns; i++)
-         {
-            Serial.print(columnPins[i]);
-            Serial.print(F(" "));
-         }
-         Serial.println();
+         columns = source->getNumberOfColumns();
       }
    }
 
-   if (this->numberOfColumns > MAX_COLUMNS)
+   if (columns > maxColumns)
    {
       printTime(&Serial);
       Serial.print(F("FlightSimSwitches ERROR: Sorry, "));
-      Serial.print(MAX_COLUMNS);
+      Serial.print(maxColumns);
       Serial.println(F(" columns max"));
       return;
    }
 
-   if (!this->numberOfColumns)
+   if (!columns)
    {
       printTime(&Serial);
       Serial.println(F("FlightSimSwitches ERROR: Sorry, we need at least one column"));
       return;
    }
 
-   if (this->numberOfRows > MAX_ROWS)
+   if (rows > maxRows)
    {
       printTime(&Serial);
       Serial.print(F("FlightSimSwitches ERROR: Sorry, "));
-      Serial.print(MAX_ROWS);
+      Serial.print(maxRows);
       Serial.println(F(" rows max"));
       return;
    }
 
-   if (!this->numberOfRows)
+   if (!rows)
    {
       printTime(&Serial);
       Serial.println(F("FlightSimSwitches ERROR: Sorry, we need at least one row"));
       return;
    }
 
-   if (!this->rowPins)
+   if (!this->scanRate)
    {
-      Serial.println(F("FlightSimSwitches ERROR:  Please set the row pins"));
+      printTime(&Serial);
+      Serial.println(F("FlightSimSwitch ERROR: scanRate can not be zero"));
       return;
    }
 
-   if (!this->columnPins)
+   this->numberOfRows    = rows;
+   this->numberOfColumns = columns;
+
+   if (!allocatePlanes())
    {
-      printTime(&Serial);
-      Serial.println(F("FlightSimSwitches ERROR: Please set the column pins"));
       return;
    }
+   memset(rowData, 0, maxRows * wordsPerRow * sizeof(uint32_t));
 
-   if (!this->scanRate)
+   if (!beginSources())
    {
-      printTime(&Serial);
-      Serial.println(F("FlightSimSwitch ERROR: scanRate can not be zero"));
       return;
    }
 
-   if (!rowsMuxed)
+   memset(changedData, 0, maxRows * wordsPerRow * sizeof(uint32_t));
+   buildCellIndex();
+   dispatchAll = true;                      // evaluate all elements on the first frame
+
+   for (MatrixElement *elem = firstElement; elem; elem = elem->nextElement)
    {
-      this->numberOfRowPins = numberOfRows;
+      elem->beginElement();
    }
-   else
+
+   initialized = true;
+
+   if (scanMode == SCAN_BACKGROUND)
    {
-      for (int i = 0; i < 32; i++)
+      initialized = beginBackgroundScan();
+      return;
+   }
+
+   setRowNumber(0);
+   this->matrixTimer = 0;
+}
+
+
+/*
+ * Direct pin mode: positions are pin numbers. Each pin used by an element gets
+ * the next free column, elements using the same pin share its column.
+ */
+void FlightSimSwitchesBase::findColumnPins()
+{
+   if (!pinColumns)
+   {
+      pinColumns = (uint16_t *) malloc(NUM_DIGITAL_PINS * sizeof(uint16_t));
+      if (!pinColumns)
       {
-         if (_BV32(i) >= numberOfRows)
+         printTime(&Serial);
+         Serial.println(F("FlightSimSwitches ERROR: Not enough memory for the pin table"));
+         return;
+      }
+   }
+   for (uint16_t pin = 0; pin < NUM_DIGITAL_PINS; pin++)
+   {
+      pinColumns[pin] = NO_COLUMN;
+   }
+
+   uint16_t       numberOfPins = 0;
+   bool           allPinsFound = true;
+   const uint32_t *positions;
+   for (MatrixElement *elem = firstElement; elem; elem = elem->nextElement)
+   {
+      size_t numberOfPositions = elem->getPositions(&positions);
+      for (size_t i = 0; i < numberOfPositions; i++)
+      {
+         uint32_t pin = positions[i];
+         if ((pin == NO_POSITION) || ((pin < NUM_DIGITAL_PINS) && (pinColumns[pin] != NO_COLUMN)))
          {
-            this->numberOfRowPins = i;
-            break;
+            continue;
          }
+         if ((pin >= NUM_DIGITAL_PINS) || (numberOfPins >= maxColumns))
+         {
+            allPinsFound = false;
+            continue;
+         }
+         pinColumns[pin]                 = numberOfPins;
+         dynamicColumnPins[numberOfPins] = pin;
+         numberOfPins++;
       }
-      if (debugScan)
+   }
+   pinInput.setColumnPins(numberOfPins, dynamicColumnPins);
+
+   if (!allPinsFound)
+   {
+      printTime(&Serial);
+      Serial.print(F("FlightSimSwitches WARNING: Not all pins could be assigned, only the first "));
+      Serial.print(maxColumns);
+      Serial.println(F(" pins are active"));
+   }
+
+   if (debugConfig)
+   {
+      printTime(&Serial);
+      Serial.print(F("Pins: "));
+      for (uint16_t i = 0; i < numberOfPins; i++)
       {
-         printTime(&Serial);
-         Serial.print(F("FlightSimSwitch: Number of row pins: "));
-         Serial.println(numberOfRowPins);
+         Serial.print(dynamicColumnPins[i]);
+         Serial.print(F(" "));
       }
+      Serial.println();
    }
+}
 
-   memset(rowData, 0, MAX_ROWS * sizeof(uint32_t));
 
-   if (rowPins != FLIGHTSIM_EMPTY_PINS) {
-     for (int i = 0; i < numberOfRowPins; i++)
-     {
-        pinMode(rowPins[i], OUTPUT);
-        digitalWrite(rowPins[i], activeLow ? HIGH : LOW);
-     }
+bool FlightSimSwitchesBase::beginSources()
+{
+   for (FlightSimInputSource *source = firstSource; source; source = source->nextSource)
+   {
+      if (!source->begin())
+      {
+         printTime(&Serial);
+         Serial.print(F("FlightSimSwitches ERROR: Input source for row "));
+         Serial.print(source->firstRow);
+         Serial.println(F(" could not be initialized"));
+         return false;
+      }
    }
 
-   for (int i = 0; i < numberOfColumns; i++)
+   if (debugConfig && (firstSource == &pinInput))
    {
-#ifdef INPUT_PULLDOWN
-      pinMode(columnPins[i], activeLow ? INPUT_PULLUP : INPUT_PULLDOWN);
-#else
-      pinMode(columnPins[i], activeLow ? INPUT_PULLUP : INPUT);
-#endif
+      printTime(&Serial);
+      Serial.print(F("FlightSimSwitches: Number of row pins: "));
+      Serial.print(pinInput.drivesRows() ? pinInput.getNumberOfRowPins() : 0);
+      FlightSimPortMap *portMap = pinInput.getPortMap();
+      if (portMap)
+      {
+         Serial.print(F(", port reads enabled, ports: "));
+         Serial.print(portMap->getNumberOfPorts());
+         Serial.print(F(", masks: "));
+         Serial.println(portMap->getNumberOfGathers());
+      }
+      else
+      {
+         Serial.println(F(", using digitalRead()"));
+      }
    }
-
-   initialized = true;
-
-   setRowNumber(0);
-   this->matrixTimer = 0;
+   return true;
 }
 
 
-void FlightSimSwitches::setRowNumber(uint32_t currentRow)
+void FlightSimSwitchesBase::setRowNumber(uint32_t currentRow)
 {
    if (!checkInitialized(F("setRowNumber"), true))
    {
@@ -272,276 +578,1907 @@ void FlightSimSwitches::setRowNumber(uint32_t currentRow)
    }
 
    this->currentRow = currentRow;
-   if (rowPins == FLIGHTSIM_EMPTY_PINS)
-   {
-      return;                      // do nothing if switches are connected directly to Teensy pins
-   }
+   currentSource    = findSource(currentRow);
 
-   if (debugScan)
+   if (debugScan && currentSource->drivesRows())
    {
       printTime(&Serial);
       Serial.print(F("FlightSimSwitches: Setting row "));
       Serial.println(currentRow);
    }
+#ifdef FLIGHTSIM_PROFILING
+   uint32_t start = FLIGHTSIM_CYCLES();
+   currentSource->selectRow(currentRow - currentSource->firstRow);
+   rowSelectTiming.add(FLIGHTSIM_CYCLES() - start);
+#else
+   currentSource->selectRow(currentRow - currentSource->firstRow);
+#endif
+}
 
-   if (!rowsMuxed)
-   {
-      // turn only selected row output LOW
-      if (lastRow != 0xff)
-      {
-         digitalWrite(rowPins[lastRow], activeLow ? HIGH : LOW);
-      }
-      digitalWrite(rowPins[currentRow], activeLow ? LOW : HIGH);
-   }
-   else
+
+FlightSimInputSource *FlightSimSwitchesBase::findSource(uint8_t row)
+{
+   FlightSimInputSource *source = firstSource;
+   while (source->nextSource && (row >= source->nextSource->firstRow))
    {
-      // output row number to row select pins
-      for (uint8_t i = 0; i < numberOfRowPins; i++)
-      {
-         digitalWrite(rowPins[i], (currentRow & _BV32(i)) ? HIGH : LOW);
-      }
+      source = source->nextSource;
    }
-   lastRow = currentRow;
+   return source;
 }
 
 
-uint32_t FlightSimSwitches::getSingleRowData()
+void FlightSimSwitchesBase::readSingleRow(uint32_t *readData)
 {
-   if (!checkInitialized(F("getSingleRowData"), true))
+   memset(readData, 0, wordsPerRow * sizeof(uint32_t));
+   if (!checkInitialized(F("readSingleRow"), true))
    {
-      return 0;
+      return;
    }
 
-   uint32_t readVal = 0;
-   for (uint8_t i = 0; i < numberOfColumns; i++)
-   {
-      bool readData = (digitalRead(columnPins[i]) == HIGH) ^ activeLow;
-      if (readData)
-      {
-         readVal |= _BV32(i);
-      }
-   }
+#ifdef FLIGHTSIM_PROFILING
+   uint32_t start = FLIGHTSIM_CYCLES();
+   currentSource->readRow(currentRow - currentSource->firstRow, readData);
+   rowReadTiming.add(FLIGHTSIM_CYCLES() - start);
+#else
+   currentSource->readRow(currentRow - currentSource->firstRow, readData);
+#endif
    if (debugScan)
    {
       printTime(&Serial);
       Serial.print(F("FlightSimSwitches: reading row data: "));
-      Serial.println(readVal);
+      for (int8_t w = wordsPerRow - 1; w >= 0; w--)
+      {
+         Serial.print(readData[w], HEX);
+         Serial.print(F(" "));
+      }
+      Serial.println();
    }
-   return readVal;
 }
 
 
-void FlightSimSwitches::loop()
+void FlightSimSwitchesBase::readCurrentRow()
 {
-   if (!checkInitialized(F("loop"), true))
+   if (currentRow == 0)
    {
-      return;
+      frameStart      = micros();
+      debouncePending = false;
+      clearChanges();
+      for (FlightSimInputSource *source = firstSource; source; source = source->nextSource)
+      {
+         source->startFrame();
+      }
    }
 
-   if (matrixTimer > scanRate)
+   // without a raw data plane, the row is only needed until it is processed
+   uint32_t  rowBuffer[MATRIX_WORDS(MAX_MATRIX_COLUMNS)];
+   uint32_t *raw = rawData ? rawData + currentRow * wordsPerRow : rowBuffer;
+   readSingleRow(raw);
+   processRow(currentRow, raw, eventBuffer ? micros() : 0);
+}
+
+
+/*
+ * Debounces the raw data of a row against the published frame, writes the row
+ * of the next frame and reports the changes
+ */
+void FlightSimSwitchesBase::processRow(uint8_t rowNumber, const uint32_t *raw, uint32_t readTime)
+{
+   uint32_t *row  = rowData + rowNumber * wordsPerRow;
+   uint32_t *next = nextRowData + rowNumber * wordsPerRow;
+
+   for (uint8_t w = 0; w < wordsPerRow; w++)
    {
-      // read current row
-      matrixTimer = 0;
-      uint32_t readData = getSingleRowData();
-      if (rowData[currentRow] != readData)
+      uint32_t readData = raw[w];
+      if (debounceCounters)
       {
-         if (changePositionCallback)
+         readData = debouncer.debounce(readData, row[w], debounceCounters + (rowNumber * wordsPerRow + w) * DEBOUNCE_BITS);
+         if (readData != raw[w])
          {
-            uint32_t diff = readData ^ rowData[currentRow];
-            for (uint8_t i = 0; i < numberOfColumns; i++)
-            {
-               if (diff & _BV32(i))
-               {
-                  (*changePositionCallback)(currentRow, i, readData & _BV32(i));
-               }
-            }
+            debouncePending = true;
          }
-         rowData[currentRow] = readData;
-         hasChangedPoll      = true;
-         hasChangedLoop      = true;
       }
 
-      currentRow++;
-      if (currentRow >= numberOfRows)
+      uint32_t diff = readData ^ row[w];
+      next[w]       = readData;                // same as row[w] without snapshot
+      if (!diff)
       {
-         // end of scan
-         currentRow = 0;
-         if (hasChangedLoop && changeMatrixCallback)
-         {
-            (*changeMatrixCallback)();
-         }
-         hasChangedLoop = false;
+         continue;
+      }
 
-         bool enabled = FlightSim.isEnabled();
-         bool resync  = enabled && (!lastEnabled);
-         if (resync)
-         {
-            printTime(&Serial);
-            Serial.println(F("FlightSimSwitches: Flightsim started, resyncing!"));
-         }
-         for (MatrixElement *elem = MatrixElement::firstElement; elem; elem = elem->nextElement)
+      if (changePositionCallback || eventBuffer)
+      {
+         for (uint32_t bits = diff; bits; bits &= bits - 1)
          {
-            if (elem->matrix == this)
+            uint8_t bit = __builtin_ctz(bits);
+            if (eventBuffer)
             {
-               elem->handleLoop(resync);
+               eventBuffer->push(rowNumber, w * 32 + bit, readData & _BV32(bit), readTime);
+            }
+            if (changePositionCallback)
+            {
+               (*changePositionCallback)(rowNumber, w * 32 + bit, readData & _BV32(bit));
             }
          }
-         lastEnabled = enabled;
       }
+      markChangedCells(rowNumber, w, diff);
+      hasChangedPoll = true;
+      hasChangedLoop = true;
+   }
+}
 
-      setRowNumber(currentRow);
+
+// without snapshot, the changes of the last frame are cleared when a new one starts
+void FlightSimSwitchesBase::clearChanges()
+{
+   if (changedData == frameChangedData)
+   {
+      memset(changedData, 0, numberOfRows * wordsPerRow * sizeof(uint32_t));
    }
 }
 
 
-void FlightSimSwitches::print()
+/*
+ * Publishes the frame that was just scanned: swaps the row data and the changed
+ * cells. If no rows were read (skipped frame), the row data stays the same and
+ * no cells changed. Without snapshot, the rows and changes are already in place.
+ */
+void FlightSimSwitchesBase::publishFrame(bool rowsRead)
 {
-   if (!checkInitialized(F("print"), true))
+   if (!rowsRead)
+   {
+      clearChanges();
+   }
+   if (!frameSnapshot)
    {
       return;
    }
 
-   if (numberOfRows > 1)
+   if (rowsRead)
    {
-      // Matrix
-      printTime(&Serial);
-      Serial.println(F("Switch matrix"));
-      printTime(&Serial);
-      Serial.print(F("    "));
-      for (uint8_t i = 0; i < numberOfColumns; i++)
-      {
-         Serial.print(F(" "));
-         if (i < 10)
+      uint32_t *frame = nextRowData;
+      nextRowData     = rowData;
+      rowData         = frame;
+   }
+
+   uint32_t *changes = changedData;
+   changedData       = frameChangedData;
+   frameChangedData  = changes;
+   memset(changedData, 0, numberOfRows * wordsPerRow * sizeof(uint32_t));
+}
+
+
+void FlightSimSwitchesBase::endOfFrame()
+{
+   if (hasChangedLoop && changeMatrixCallback)
+   {
+      (*changeMatrixCallback)();
+   }
+   hasChangedLoop = false;
+
+   bool enabled = FlightSim.isEnabled();
+   bool resync  = enabled && (!lastEnabled);
+   if (resync)
+   {
+      printTime(&Serial);
+      Serial.println(F("FlightSimSwitches: Flightsim started, resyncing!"));
+   }
+   else if (!enabled)
+   {
+      resyncCursor    = NULL;              // restarts when the flightsim is back
+      resyncRemaining = 0;
+   }
+#ifdef FLIGHTSIM_PROFILING
+   uint32_t start = FLIGHTSIM_CYCLES();
+   dispatchElements(resync);
+   dispatchTiming.add(FLIGHTSIM_CYCLES() - start);
+   profileFrames++;
+#else
+   dispatchElements(resync);
+#endif
+   FlightSimOutput.process();
+   lastEnabled = enabled;
+
+   frameDuration = micros() - frameStart;
+   frameCount++;
+}
+
+
+void FlightSimSwitchesBase::addElement(MatrixElement *elem)
+{
+   if (firstElement == NULL)
+   {
+      firstElement = elem;
+   }
+   else
+   {
+      lastElement->nextElement = elem;
+   }
+   lastElement = elem;
+   numberOfElements++;
+}
+
+
+static int compareCellOwners(const void *a, const void *b)
+{
+   return (int) ((const FlightSimCellOwner *) a)->cell - (int) ((const FlightSimCellOwner *) b)->cell;
+}
+
+
+void FlightSimSwitchesBase::buildCellIndex()
+{
+   if (cellIndex)
+   {
+      free(cellIndex);
+      cellIndex = NULL;
+   }
+   cellIndexSize     = 0;
+   unindexedElements = 0;
+
+   size_t          count = 0;
+   const uint32_t *positions;
+   for (MatrixElement *elem = firstElement; elem; elem = elem->nextElement)
+   {
+      count += elem->getPositions(&positions);
+   }
+
+   if (count)
+   {
+      cellIndex = (FlightSimCellOwner *) malloc(count * sizeof(FlightSimCellOwner));
+      if (!cellIndex)
+      {
+         printTime(&Serial);
+         Serial.println(F("FlightSimSwitches WARNING: Not enough memory for cell index, all elements will be polled"));
+         return;
+      }
+   }
+
+   for (MatrixElement *elem = firstElement; elem; elem = elem->nextElement)
+   {
+      elem->buildPositionGroups();
+
+      // elements without positions on the matrix are called on every frame
+      size_t numberOfPositions = elem->getPositions(&positions);
+      elem->indexed = (numberOfPositions > 0);
+      if (!elem->indexed)
+      {
+         unindexedElements++;
+      }
+
+      for (size_t i = 0; i < numberOfPositions; i++)
+      {
+         uint32_t cell   = getCell(positions[i]);
+         uint32_t row    = MATRIX_ROW(cell);
+         uint32_t column = MATRIX_COLUMN(cell);
+         if ((cell == NO_POSITION) || (row >= numberOfRows) || (column >= numberOfColumns))
          {
-            Serial.print(F(" "));
+            continue;
          }
-         Serial.print(i);
+         cellIndex[cellIndexSize].cell    = MATRIX(row, column);
+         cellIndex[cellIndexSize].element = elem;
+         cellIndexSize++;
       }
-      Serial.println();
-      for (uint8_t r = 0; r < numberOfRows; r++)
+   }
+   qsort(cellIndex, cellIndexSize, sizeof(FlightSimCellOwner), compareCellOwners);
+
+   if (debugConfig)
+   {
+      printTime(&Serial);
+      Serial.print(F("FlightSimSwitches: Cell index entries: "));
+      Serial.print(cellIndexSize);
+      Serial.print(F(", unindexed elements: "));
+      Serial.println(unindexedElements);
+   }
+}
+
+
+void FlightSimSwitchesBase::markChangedCells(uint8_t row, uint8_t word, uint32_t diff)
+{
+   changedData[row * wordsPerRow + word] |= diff;
+}
+
+
+void FlightSimSwitchesBase::dispatchElements(bool resync)
+{
+   if (resync)
+   {
+      resyncCursor    = firstElement;
+      resyncRemaining = numberOfElements;
+      resyncStart     = millis();
+   }
+   // elements resynced in this frame are not dispatched again for live changes,
+   // the resync already sent their current state
+   MatrixElement *resyncChunk = resyncCursor;
+   if (resyncCursor)
+   {
+      resyncElements();
+   }
+
+   if (dispatchAll || !cellIndex)
+   {
+      for (MatrixElement *elem = firstElement; elem; elem = elem->nextElement)
       {
-         printTime(&Serial);
-         if (r < 10)
+         if (!elem->resynced)
          {
-            Serial.print(F(" "));
+            handleElement(elem, false);
          }
-         Serial.print(r);
-         Serial.print(F(": "));
-         for (uint8_t c = 0; c < numberOfColumns; c++)
+      }
+      dispatchAll = false;
+      clearResynced(resyncChunk);
+      return;
+   }
+
+   // collect the owners of all changed cells
+   firstPending = NULL;
+   lastPending  = NULL;
+   for (uint16_t i = 0; i < numberOfRows * wordsPerRow; i++)
+   {
+      uint32_t diff = frameChangedData[i];
+      while (diff)
+      {
+         uint16_t cell = MATRIX(i / wordsPerRow, (i % wordsPerRow) * 32 + __builtin_ctz(diff));
+         diff &= diff - 1;
+
+         size_t low  = 0;
+         size_t high = cellIndexSize;
+         while (low < high)
          {
-            if (rowData[r] & _BV32(c))
+            size_t mid = (low + high) / 2;
+            if (cellIndex[mid].cell < cell)
             {
-               Serial.print(F("  X"));
+               low = mid + 1;
             }
             else
             {
-               Serial.print(F("   "));
+               high = mid;
             }
          }
-         Serial.println();
+         for ( ; (low < cellIndexSize) && (cellIndex[low].cell == cell); low++)
+         {
+            addPending(cellIndex[low].element);
+         }
       }
+   }
+
+   // add elements that asked to be polled
+   if (pollingElements || unindexedElements)
+   {
+      for (MatrixElement *elem = firstElement; elem; elem = elem->nextElement)
+      {
+         if (elem->polling || !elem->indexed)
+         {
+            addPending(elem);
+         }
+      }
+   }
+
+   MatrixElement *elem = firstPending;
+   while (elem)
+   {
+      MatrixElement *next = elem->nextPending;
+      elem->pending     = false;
+      elem->nextPending = NULL;
+      if (!elem->resynced)
+      {
+         handleElement(elem, false);
+      }
+      elem = next;
+   }
+   firstPending = NULL;
+   lastPending  = NULL;
+   clearResynced(resyncChunk);
+}
+
+
+// runs one element's handleLoop, timing it when profiling
+void FlightSimSwitchesBase::handleElement(MatrixElement *elem, bool resync)
+{
+#ifdef FLIGHTSIM_PROFILING
+   uint32_t start = FLIGHTSIM_CYCLES();
+   elem->handleLoop(resync);
+   uint32_t cycles = FLIGHTSIM_CYCLES() - start;
+   if (cycles > slowestElementCycles)
+   {
+      slowestElementCycles = cycles;
+      slowestElement       = elem;
+   }
+#else
+   elem->handleLoop(resync);
+#endif
+}
+
+
+/*
+ * Resyncs the next resyncChunkSize elements. Elements that have not been resynced
+ * yet still handle live changes, they are just resynced later.
+ */
+void FlightSimSwitchesBase::resyncElements()
+{
+   for (uint16_t count = 0; resyncCursor && (!resyncChunkSize || (count < resyncChunkSize)); count++)
+   {
+      handleElement(resyncCursor, true);
+      resyncCursor->resynced = true;
+      resyncCursor = resyncCursor->nextElement;
+      resyncRemaining--;
+   }
+
+   if (resyncCursor)
+   {
+      return;
+   }
+
+   resyncRemaining = 0;
+   resyncDuration  = millis() - resyncStart;
+   if (resyncChunkSize)
+   {
       printTime(&Serial);
-      Serial.println(F("---------------"));
+      Serial.print(F("FlightSimSwitches: Resync complete after "));
+      Serial.print(resyncDuration);
+      Serial.println(F(" ms"));
+   }
+   if (resyncCompleteCallback)
+   {
+      (*resyncCompleteCallback)();
+   }
+}
+
+
+// clears the resynced flags of the chunk that starts at elem
+void FlightSimSwitchesBase::clearResynced(MatrixElement *elem)
+{
+   for ( ; elem && elem->resynced; elem = elem->nextElement)
+   {
+      elem->resynced = false;
+   }
+}
+
+
+void FlightSimSwitchesBase::addPending(MatrixElement *elem)
+{
+   if (elem->pending)
+   {
+      return;
+   }
+   elem->pending = true;
+   if (lastPending)
+   {
+      lastPending->nextPending = elem;
    }
    else
    {
-      // directly connected Switches
-      printTime(&Serial);
-      Serial.print(F("Switches: "));
-      for (uint8_t i = 0; i < numberOfColumns; i++)
+      firstPending = elem;
+   }
+   lastPending = elem;
+}
+
+
+bool FlightSimSwitchesBase::skipFrame()
+{
+   // the debouncer needs new samples until raw and debounced data agree
+   if (debouncePending)
+   {
+      return false;
+   }
+   for (FlightSimInputSource *source = firstSource; source; source = source->nextSource)
+   {
+      if (source->frameChanged())
       {
-         Serial.print(i);
-         Serial.print(F(": "));
-         Serial.print(rowData[0] & _BV32(i) ? F("ON") : F("off"));
-         if (i < numberOfColumns - 1)
+         return false;
+      }
+   }
+   skippedFrames++;
+   return true;
+}
+
+
+void FlightSimSwitchesBase::loop()
+{
+   if (!checkInitialized(F("loop"), true))
+   {
+      return;
+   }
+
+   FlightSimOutput.process();
+
+   // format the debug log while no frame is due
+   bool frameDue = (scanMode == SCAN_BACKGROUND) ? frameReady : (matrixTimer > scanRate);
+   if (debugLog && !frameDue && (Serial.availableForWrite() >= LOG_RECORD_SPACE))
+   {
+      flushDebugLog(1);
+   }
+
+   if (scanMode == SCAN_BACKGROUND)
+   {
+      if (frameReady)
+      {
+         consumeFrame();
+      }
+      return;
+   }
+
+   if (matrixTimer > scanRate)
+   {
+      matrixTimer = 0;
+
+      if ((currentRow == 0) && skipFrame())
+      {
+         // nothing changed since the last frame, only dispatch
+         frameStart = micros();
+         publishFrame(false);
+         endOfFrame();
+         return;
+      }
+
+      if (scanMode == SCAN_FULL_FRAME)
+      {
+         // read all rows back-to-back, giving each row some time to settle
+         for (uint8_t row = 0; row < numberOfRows; row++)
          {
-            Serial.print(F(", "));
+            setRowNumber(row);
+            if (drivesRows() && settleTime)
+            {
+               delayMicroseconds(settleTime);
+            }
+            readCurrentRow();
          }
+         publishFrame(true);
+         endOfFrame();
+         return;
       }
-      Serial.println();
+
+      // read current row, next row will settle until the next call
+      readCurrentRow();
+      currentRow++;
+      if (currentRow >= numberOfRows)
+      {
+         // end of scan
+         currentRow = 0;
+         publishFrame(true);
+         endOfFrame();
+      }
+
+      setRowNumber(currentRow);
+   }
+}
+
+
+bool FlightSimSwitchesBase::beginBackgroundScan()
+{
+#ifdef FLIGHTSIM_BACKGROUND_SCAN
+   if (backgroundMatrix && (backgroundMatrix != this))
+   {
+      printTime(&Serial);
+      Serial.println(F("FlightSimSwitches ERROR: Sorry, only one matrix can scan in the background"));
+      return false;
+   }
+
+   memset(scanData, 0, maxRows * wordsPerRow * sizeof(uint32_t));
+   frameReady = false;
+   scanRow    = 0;
+   setRowNumber(0);                         // settles until the first interrupt
+
+   backgroundMatrix = this;
+   if (!scanTimer.begin(backgroundScanISR, scanRate * 1000))
+   {
+      backgroundMatrix = NULL;
+      printTime(&Serial);
+      Serial.println(F("FlightSimSwitches ERROR: No timer available for background scan"));
+      return false;
+   }
+
+   if (debugScan)
+   {
+      printTime(&Serial);
+      Serial.print(F("FlightSimSwitches: Scanning in the background, one row every "));
+      Serial.print(scanRate);
+      Serial.println(F(" ms"));
    }
+   return true;
+#else
+   printTime(&Serial);
+   Serial.println(F("FlightSimSwitches ERROR: Sorry, no background scan on this board"));
+   return false;
+#endif
+}
+
+
+#ifdef FLIGHTSIM_BACKGROUND_SCAN
+void FlightSimSwitchesBase::backgroundScanISR()
+{
+   backgroundMatrix->backgroundScan();
 }
 
 
-void FlightSimSwitches::setDebug(uint32_t debug_type)
+/*
+ * Timer interrupt: reads the selected row into scanData and selects the next
+ * one, so that it settles until the next interrupt. No Serial output here.
+ * Sources that block (e.g. I2C port expanders) are not suitable for this mode.
+ */
+void FlightSimSwitchesBase::backgroundScan()
 {
-   for (MatrixElement *elem = MatrixElement::firstElement; elem; elem = elem->nextElement)
+   if (scanRow == 0)
    {
-      if (elem->matrix == this)
+      scanStart = micros();
+      for (FlightSimInputSource *source = firstSource; source; source = source->nextSource)
       {
-         elem->setDebug(debug_type & elem->getDebugMask());
+         source->startFrame();
       }
    }
-   debugScan   = debug_type & DEBUG_SCAN;
-   debugConfig = debug_type & DEBUG_SWITCHES_CONFIG;
+
+   FlightSimInputSource *source   = findSource(scanRow);
+   uint32_t             *readData = scanData + scanRow * wordsPerRow;
+   memset(readData, 0, wordsPerRow * sizeof(uint32_t));
+   source->readRow(scanRow - source->firstRow, readData);
+
+   scanRow++;
+   if (scanRow >= numberOfRows)
+   {
+      scanRow = 0;
+      if (frameReady)
+      {
+         // loop() still owns rawData, read the next frame into the same buffer
+         overruns++;
+      }
+      else
+      {
+         uint32_t *frame = scanData;
+         scanData        = rawData;
+         rawData         = frame;
+         scanFrameTime   = scanStart;
+         __sync_synchronize();              // frame complete before it is handed over
+         frameReady = true;
+      }
+   }
+
+   source = findSource(scanRow);
+   source->selectRow(scanRow - source->firstRow);
 }
+#endif
 
 
 /*
- * Generic matrix element. Not to be instantiated directly. Only keeps reference
- * to matrix and chain of elements.
+ * Processes a frame handed over by the timer interrupt. Rows are read scanRate
+ * ms apart, event times are estimated from the start of the frame.
  */
+void FlightSimSwitchesBase::consumeFrame()
+{
+   __sync_synchronize();                    // see the frame the interrupt handed over
 
-MatrixElement *MatrixElement::firstElement = NULL;
-MatrixElement *MatrixElement::lastElement  = NULL;
-bool          MatrixElement::lastEnabled   = false;
+   frameStart      = scanFrameTime;
+   debouncePending = false;
+   clearChanges();
+   for (uint8_t row = 0; row < numberOfRows; row++)
+   {
+      processRow(row, rawData + row * wordsPerRow, frameStart + row * scanRate * 1000);
+   }
+   publishFrame(true);
+   endOfFrame();
 
-MatrixElement::MatrixElement(FlightSimSwitches *matrix)
+   __sync_synchronize();                    // done with rawData before it is given back
+   frameReady = false;
+}
+
+
+void FlightSimSwitchesBase::print()
+{
+   if (!checkInitialized(F("print"), true))
+   {
+      return;
+   }
+
+   if (numberOfRows > 1)
+   {
+      // Matrix
+      printTime(&Serial);
+      Serial.println(F("Switch matrix"));
+      printTime(&Serial);
+      Serial.print(F("    "));
+      for (uint16_t i = 0; i < numberOfColumns; i++)
+      {
+         Serial.print(F(" "));
+         if (i < 10)
+         {
+            Serial.print(F(" "));
+         }
+         Serial.print(i);
+      }
+      Serial.println();
+      for (uint8_t r = 0; r < numberOfRows; r++)
+      {
+         printTime(&Serial);
+         if (r < 10)
+         {
+            Serial.print(F(" "));
+         }
+         Serial.print(r);
+         Serial.print(F(": "));
+         for (uint16_t c = 0; c < numberOfColumns; c++)
+         {
+            if (isOn(r, c))
+            {
+               Serial.print(F("  X"));
+            }
+            else
+            {
+               Serial.print(F("   "));
+            }
+         }
+         Serial.println();
+      }
+      printTime(&Serial);
+      Serial.println(F("---------------"));
+   }
+   else
+   {
+      // directly connected Switches
+      printTime(&Serial);
+      Serial.print(F("Switches: "));
+      for (uint16_t i = 0; i < numberOfColumns; i++)
+      {
+         Serial.print(i);
+         Serial.print(F(": "));
+         Serial.print(isOn(0, i) ? F("ON") : F("off"));
+         if (i < numberOfColumns - 1)
+         {
+            Serial.print(F(", "));
+         }
+      }
+      Serial.println();
+   }
+}
+
+
+#ifdef FLIGHTSIM_PROFILING
+void FlightSimSwitchesBase::clearProfile()
+{
+   rowSelectTiming.clear();
+   rowReadTiming.clear();
+   dispatchTiming.clear();
+   this->slowestElement       = NULL;
+   this->slowestElementCycles = 0;
+   this->profileFrames        = 0;
+   this->profileStart         = millis();
+
+#ifdef ARM_DEMCR
+   // start the cycle counter (Teensy 3.x, already running on Teensy 4.x)
+   ARM_DEMCR    |= ARM_DEMCR_TRCENA;
+   ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+#endif
+}
+
+
+void FlightSimSwitchesBase::getProfile(FlightSimProfile *profile)
+{
+   uint32_t elapsed = millis() - profileStart;
+
+   profile->frames             = profileFrames;
+   profile->framesPerSecond    = elapsed ? profileFrames * 1000.0 / elapsed : 0;
+   profile->rowSelectMin       = rowSelectTiming.getMin();
+   profile->rowSelectAvg       = rowSelectTiming.getAvg();
+   profile->rowSelectMax       = rowSelectTiming.getMax();
+   profile->rowReadMin         = rowReadTiming.getMin();
+   profile->rowReadAvg         = rowReadTiming.getAvg();
+   profile->rowReadMax         = rowReadTiming.getMax();
+   profile->dispatchMin        = dispatchTiming.getMin();
+   profile->dispatchAvg        = dispatchTiming.getAvg();
+   profile->dispatchMax        = dispatchTiming.getMax();
+   profile->slowestElement     = slowestElement;
+   profile->slowestElementTime = FlightSimTiming::toNanoseconds(slowestElementCycles);
+}
+
+
+void FlightSimSwitchesBase::printTiming(const __FlashStringHelper *name, uint32_t min, uint32_t avg, uint32_t max)
+{
+   printTime(&Serial);
+   Serial.print(F("   "));
+   Serial.print(name);
+   Serial.print(F(": "));
+   Serial.print(min);
+   Serial.print(F("/"));
+   Serial.print(avg);
+   Serial.print(F("/"));
+   Serial.println(max);
+}
+
+
+void FlightSimSwitchesBase::printProfile()
+{
+   FlightSimProfile profile;
+   getProfile(&profile);
+
+   printTime(&Serial);
+   Serial.print(F("FlightSimSwitches profile: "));
+   Serial.print(profile.frames);
+   Serial.print(F(" frames, "));
+   Serial.print(profile.framesPerSecond);
+   Serial.println(F(" frames/s, times in ns min/avg/max"));
+   printTiming(F("select row"), profile.rowSelectMin, profile.rowSelectAvg, profile.rowSelectMax);
+   printTiming(F("read row"), profile.rowReadMin, profile.rowReadAvg, profile.rowReadMax);
+   printTiming(F("dispatch"), profile.dispatchMin, profile.dispatchAvg, profile.dispatchMax);
+
+   if (profile.slowestElement)
+   {
+      uint16_t index = 0;
+      for (MatrixElement *elem = firstElement; elem && (elem != profile.slowestElement); elem = elem->nextElement)
+      {
+         index++;
+      }
+      printTime(&Serial);
+      Serial.print(F("   slowest element: #"));
+      Serial.print(index);
+      Serial.print(F(", "));
+      Serial.print(profile.slowestElementTime);
+      Serial.println(F(" ns"));
+   }
+}
+#endif
+
+
+void FlightSimSwitchesBase::setDebug(uint32_t debug_type)
+{
+   for (MatrixElement *elem = firstElement; elem; elem = elem->nextElement)
+   {
+      elem->setDebug(debug_type & elem->getDebugMask());
+   }
+   debugScan   = debug_type & DEBUG_SCAN;
+   debugConfig = debug_type & DEBUG_SWITCHES_CONFIG;
+}
+
+
+/*
+ * Debouncer. The counters of a row are incremented with a ripple carry over
+ * the DEBOUNCE_BITS words and compared against the press and release sample
+ * counts with word-wide logic.
+ */
+
+void FlightSimDebouncer::setSamples(uint8_t pressSamples, uint8_t releaseSamples)
+{
+   this->pressSamples   = constrain(pressSamples, 1, MAX_DEBOUNCE_SAMPLES);
+   this->releaseSamples = constrain(releaseSamples, 1, MAX_DEBOUNCE_SAMPLES);
+}
+
+
+uint32_t FlightSimDebouncer::debounce(uint32_t raw, uint32_t debounced, uint32_t *counters)
+{
+   uint32_t delta = raw ^ debounced;
+   uint32_t carry = delta;
+   uint32_t pressMatch   = 0xffffffff;
+   uint32_t releaseMatch = 0xffffffff;
+
+   for (uint8_t i = 0; i < DEBOUNCE_BITS; i++)
+   {
+      // restart counting on stable bits, count up on changed bits
+      uint32_t counter = counters[i] & delta;
+      counters[i] = counter ^ carry;
+      carry       = counter & carry;
+
+      pressMatch   &= (pressSamples & _BV32(i)) ? counters[i] : ~counters[i];
+      releaseMatch &= (releaseSamples & _BV32(i)) ? counters[i] : ~counters[i];
+   }
+
+   uint32_t accept = delta & ((raw & pressMatch) | (~raw & releaseMatch));
+   for (uint8_t i = 0; i < DEBOUNCE_BITS; i++)
+   {
+      counters[i] &= ~accept;
+   }
+   return debounced ^ accept;
+}
+
+
+/*
+ * GPIO port map. Each column pin is described by its port input register and
+ * bit mask. Pins are merged into gathers whenever they share the port and the
+ * distance between port bit and column, so that a port wired in order to the
+ * columns is transferred with a single mask and shift.
+ */
+
+bool FlightSimPortMap::addPin(uint16_t column, volatile flightsim_port_t *portRegister, flightsim_port_t bitMask)
+{
+   if (!bitMask)
+   {
+      return false;
+   }
+
+   uint8_t port;
+   for (port = 0; port < numberOfPorts; port++)
+   {
+      if (ports[port] == portRegister)
+      {
+         break;
+      }
+   }
+   if (port == numberOfPorts)
+   {
+      if (numberOfPorts >= MAX_PORTS)
+      {
+         return false;
+      }
+      ports[numberOfPorts++] = portRegister;
+   }
+
+   uint8_t word  = MATRIX_WORD(column);
+   uint8_t bit   = __builtin_ctz(bitMask);
+   int8_t  shift = (int8_t) bit - (int8_t) MATRIX_BIT(column);
+   for (uint8_t i = 0; i < numberOfGathers; i++)
+   {
+      if ((gathers[i].port == port) && (gathers[i].word == word) && (gathers[i].shift == shift))
+      {
+         gathers[i].mask |= bitMask;
+         return true;
+      }
+   }
+   if (numberOfGathers >= MAX_PORT_GATHERS)
+   {
+      return false;
+   }
+   gathers[numberOfGathers].port  = port;
+   gathers[numberOfGathers].word  = word;
+   gathers[numberOfGathers].shift = shift;
+   gathers[numberOfGathers].mask  = bitMask;
+   numberOfGathers++;
+   return true;
+}
+
+
+void FlightSimPortMap::read(uint32_t *readData)
+{
+   uint32_t portValues[MAX_PORTS];
+   for (uint8_t i = 0; i < numberOfPorts; i++)
+   {
+      portValues[i] = *ports[i];
+   }
+
+   for (uint8_t i = 0; i < numberOfGathers; i++)
+   {
+      uint32_t bits = portValues[gathers[i].port] & gathers[i].mask;
+      if (gathers[i].shift >= 0)
+      {
+         readData[gathers[i].word] |= bits >> gathers[i].shift;
+      }
+      else
+      {
+         readData[gathers[i].word] |= bits << -gathers[i].shift;
+      }
+   }
+}
+
+
+/*
+ * Event ring. head and tail run freely and are masked on access, so that a full
+ * buffer can be told apart from an empty one. The barriers make sure that an
+ * event is stored before it is published, and read before its slot is released.
+ */
+
+bool FlightSimEventRing::push(uint8_t row, uint16_t column, bool state, uint32_t time)
+{
+   uint16_t h = head;
+   if ((uint16_t) (h - tail) >= size)
+   {
+      overflows++;
+      return false;
+   }
+
+   FlightSimSwitchEvent *event = &events[h & (size - 1)];
+   event->time   = time;
+   event->column = column;
+   event->row    = row;
+   event->state  = state;
+   __sync_synchronize();
+   head = h + 1;
+   return true;
+}
+
+
+bool FlightSimEventRing::pop(FlightSimSwitchEvent *event)
+{
+   uint16_t t = tail;
+   if (t == head)
+   {
+      return false;
+   }
+
+   __sync_synchronize();
+   *event = events[t & (size - 1)];
+   __sync_synchronize();
+   tail = t + 1;
+   return true;
+}
+
+
+bool FlightSimLogRing::push(const FlightSimLogRecord *record)
+{
+   if ((uint16_t) (head - tail) >= size)
+   {
+      drops++;
+      return false;
+   }
+
+   records[head & (size - 1)] = *record;
+   head++;
+   return true;
+}
+
+
+bool FlightSimLogRing::pop(FlightSimLogRecord *record)
+{
+   if (tail == head)
+   {
+      return false;
+   }
+
+   *record = records[tail & (size - 1)];
+   tail++;
+   return true;
+}
+
+
+/*
+ * Outbound queue. The message rate is enforced with a credit that grows by
+ * messageRate messages per millisecond, up to one millisecond worth of messages.
+ */
+
+#define MESSAGE_NONE           (0)      // superseded, skipped
+#define MESSAGE_ONCE           (1)
+#define MESSAGE_BEGIN          (2)
+#define MESSAGE_END            (3)
+#define MESSAGE_WRITE_FLOAT    (4)
+#define MESSAGE_WRITE_INTEGER  (5)
+
+FlightSimOutputQueue FlightSimOutput;
+
+FlightSimOutputQueue::FlightSimOutputQueue()
+{
+   memset(queues, 0, sizeof(queues));
+   this->messageRate             = DEFAULT_MESSAGE_RATE;
+   this->credit                  = 0;
+   this->lastRefill              = 0;
+   this->maxDepth                = 0;
+   this->sentMessages            = 0;
+   this->droppedMessages         = 0;
+   this->supersededMessages      = 0;
+   this->coalesceWrites          = true;
+   this->numberOfWrittenDatarefs = 0;
+   this->coalescedWrites         = 0;
+   this->skippedWrites           = 0;
+   this->collapsedCommands       = 0;
+}
+
+
+void FlightSimOutputQueue::once(FlightSimCommand *command, uint8_t priority, const void *owner, uint16_t count)
+{
+   if (count)
+   {
+      add(MESSAGE_ONCE, command, 0, count, priority, owner, NULL);
+   }
+}
+
+
+void FlightSimOutputQueue::begin(FlightSimCommand *command, uint8_t priority, const void *owner)
+{
+   add(MESSAGE_BEGIN, command, 0, 0, priority, owner, NULL);
+}
+
+
+void FlightSimOutputQueue::end(FlightSimCommand *command, uint8_t priority, const void *owner)
+{
+   add(MESSAGE_END, command, 0, 0, priority, owner, NULL);
+}
+
+
+void FlightSimOutputQueue::write(FlightSimFloat *dataref, float value, uint8_t priority, const void *owner,
+                                 const _XpRefStr_ *name)
+{
+   add(MESSAGE_WRITE_FLOAT, dataref, value, 0, priority, owner, name);
+}
+
+
+void FlightSimOutputQueue::write(FlightSimInteger *dataref, int32_t value, uint8_t priority, const void *owner,
+                                 const _XpRefStr_ *name)
+{
+   add(MESSAGE_WRITE_INTEGER, dataref, 0, value, priority, owner, name);
+}
+
+
+void FlightSimOutputQueue::add(uint8_t type, void *target, float floatValue, int32_t intValue, uint8_t priority, const void *owner,
+                               const _XpRefStr_ *name)
+{
+   if (priority >= NUMBER_OF_PRIORITIES)
+   {
+      priority = PRIORITY_RESYNC;
+   }
+
+   Message message;
+   message.type   = type;
+   message.target = target;
+   message.owner  = owner ? owner : target;
+   message.name   = name;
+   if (type == MESSAGE_WRITE_FLOAT)
+   {
+      message.floatValue = floatValue;
+   }
+   else
+   {
+      message.intValue = intValue;
+   }
+
+   if (priority == PRIORITY_LIVE)
+   {
+      // resync messages of the same owner are outdated now
+      Queue *queue = &queues[PRIORITY_RESYNC];
+      for (uint16_t i = 0; i < queue->count; i++)
+      {
+         Message *queued = &queue->messages[(queue->first + i) % OUTPUT_QUEUE_SIZE];
+         if ((queued->type != MESSAGE_NONE) && (queued->owner == message.owner))
+         {
+            queued->type = MESSAGE_NONE;
+            supersededMessages++;
+         }
+      }
+   }
+
+   bool isWrite = (type == MESSAGE_WRITE_FLOAT) || (type == MESSAGE_WRITE_INTEGER);
+   if (isWrite && coalesceWrites)
+   {
+      // writes wait for the end of the frame, see process()
+      coalesceWrite(&message);
+   }
+   else if (!getQueueDepth())
+   {
+      // nothing waiting, send right away as far as the rate allows it
+      while (takeCredit())
+      {
+         send(&message, priority);
+         if ((type != MESSAGE_ONCE) || !--message.intValue)
+         {
+            return;
+         }
+      }
+   }
+
+   Queue *queue = &queues[priority];
+   if (type == MESSAGE_ONCE)
+   {
+      // the same command at the end of the queue sends one batch for both
+      Message *last = queue->count ? &queue->messages[(queue->first + queue->count - 1) % OUTPUT_QUEUE_SIZE] : NULL;
+      if (last && (last->type == MESSAGE_ONCE) && (last->target == message.target) && (last->owner == message.owner))
+      {
+         last->intValue    += message.intValue;
+         collapsedCommands += message.intValue;
+         return;
+      }
+   }
+
+   if (queue->count >= OUTPUT_QUEUE_SIZE)
+   {
+      droppedMessages += (type == MESSAGE_ONCE) ? message.intValue : 1;
+      return;
+   }
+   if (type == MESSAGE_ONCE)
+   {
+      collapsedCommands += message.intValue - 1;
+   }
+   queue->messages[(queue->first + queue->count) % OUTPUT_QUEUE_SIZE] = message;
+   queue->count++;
+   if (getQueueDepth() > maxDepth)
+   {
+      maxDepth = getQueueDepth();
+   }
+}
+
+
+bool FlightSimOutputQueue::takeCredit()
+{
+   if (!messageRate)
+   {
+      return true;
+   }
+
+   uint32_t now     = micros();
+   uint32_t elapsed = now - lastRefill;
+   lastRefill = now;
+   if (elapsed > 1000)
+   {
+      elapsed = 1000;
+   }
+   credit += elapsed * messageRate;
+   if (credit > (uint32_t) messageRate * 1000)
+   {
+      credit = (uint32_t) messageRate * 1000;
+   }
+
+   if (credit < 1000)
+   {
+      return false;
+   }
+   credit -= 1000;
+   return true;
+}
+
+
+void FlightSimOutputQueue::process()
+{
+   for (uint8_t priority = 0; priority < NUMBER_OF_PRIORITIES; priority++)
+   {
+      Queue *queue = &queues[priority];
+      while (queue->count)
+      {
+         Message *message = &queue->messages[queue->first];
+         if ((message->type != MESSAGE_NONE) && !takeCredit())
+         {
+            return;
+         }
+         if ((message->type == MESSAGE_ONCE) && (message->intValue > 1))
+         {
+            // batch: one command per message credit, the rest stays queued
+            message->intValue--;
+            send(message, priority);
+            continue;
+         }
+         queue->first = (queue->first + 1) % OUTPUT_QUEUE_SIZE;
+         queue->count--;
+         send(message, priority);
+      }
+   }
+}
+
+
+bool FlightSimOutputQueue::sameDataref(void *target1, const _XpRefStr_ *name1, void *target2, const _XpRefStr_ *name2)
+{
+   if (target1 == target2)
+   {
+      return true;
+   }
+   if (!name1 || !name2)
+   {
+      return false;
+   }
+   return (name1 == name2) || !strcmp((const char *) name1, (const char *) name2);
+}
+
+
+void FlightSimOutputQueue::coalesceWrite(const Message *message)
+{
+   // a queued write to the same dataref is outdated, only the last value is sent.
+   // Writes queued before a command stay, the command may depend on them
+   for (uint8_t priority = 0; priority < NUMBER_OF_PRIORITIES; priority++)
+   {
+      Queue *queue = &queues[priority];
+      for (uint16_t i = queue->count; i > 0; i--)
+      {
+         Message *queued = &queue->messages[(queue->first + i - 1) % OUTPUT_QUEUE_SIZE];
+         if ((queued->type == MESSAGE_ONCE) || (queued->type == MESSAGE_BEGIN) || (queued->type == MESSAGE_END))
+         {
+            break;
+         }
+         if ((queued->type != MESSAGE_NONE) && sameDataref(queued->target, queued->name, message->target, message->name))
+         {
+            queued->type = MESSAGE_NONE;
+            coalescedWrites++;
+         }
+      }
+   }
+}
+
+
+bool FlightSimOutputQueue::isRedundantWrite(const Message *message, uint8_t priority)
+{
+   float value;
+   float readback;
+   if (message->type == MESSAGE_WRITE_FLOAT)
+   {
+      value    = message->floatValue;
+      readback = ((FlightSimFloat *) message->target)->read();
+   }
+   else
+   {
+      value    = message->intValue;
+      readback = ((FlightSimInteger *) message->target)->read();
+   }
+
+   uint8_t i;
+   for (i = 0; i < numberOfWrittenDatarefs; i++)
+   {
+      if (sameDataref(writtenDatarefs[i].target, writtenDatarefs[i].name, message->target, message->name))
+      {
+         break;
+      }
+   }
+
+   // without the last written value, only trust X-Plane on resync
+   bool known     = (i < numberOfWrittenDatarefs);
+   bool redundant = (readback == value) && ((priority == PRIORITY_RESYNC) || (known && (writtenDatarefs[i].value == value)));
+
+   if (!known && (numberOfWrittenDatarefs < MAX_WRITTEN_DATAREFS))
+   {
+      numberOfWrittenDatarefs++;
+      writtenDatarefs[i].target = message->target;
+      writtenDatarefs[i].name   = message->name;
+      known                     = true;
+   }
+   if (known)
+   {
+      writtenDatarefs[i].value = value;
+   }
+   return redundant;
+}
+
+
+void FlightSimOutputQueue::send(const Message *message, uint8_t priority)
+{
+   if (coalesceWrites && ((message->type == MESSAGE_WRITE_FLOAT) || (message->type == MESSAGE_WRITE_INTEGER)) &&
+       isRedundantWrite(message, priority))
+   {
+      skippedWrites++;
+      return;
+   }
+
+   switch (message->type)
+   {
+   case MESSAGE_ONCE:
+      ((FlightSimCommand *) message->target)->once();
+      break;
+
+   case MESSAGE_BEGIN:
+      ((FlightSimCommand *) message->target)->begin();
+      break;
+
+   case MESSAGE_END:
+      ((FlightSimCommand *) message->target)->end();
+      break;
+
+   case MESSAGE_WRITE_FLOAT:
+      ((FlightSimFloat *) message->target)->write(message->floatValue);
+      break;
+
+   case MESSAGE_WRITE_INTEGER:
+      ((FlightSimInteger *) message->target)->write(message->intValue);
+      break;
+
+   default:
+      return;
+   }
+   sentMessages++;
+}
+
+
+/*
+ * Switches on Teensy pins, one column per pin. Active low switches use the internal
+ * pullups, active high switches the internal pulldowns where available.
+ */
+
+FlightSimPinInput::FlightSimPinInput(uint16_t numberOfColumns, const uint8_t *columnPins, bool activeLow)
+{
+   this->numberOfColumns = numberOfColumns;
+   this->columnPins      = columnPins;
+   this->activeLow       = activeLow;
+   this->portRead        = true;
+   this->usePortMap      = false;
+}
+
+
+bool FlightSimPinInput::begin()
+{
+   if (!columnPins)
+   {
+      Serial.println(F("FlightSimSwitches ERROR: Please set the column pins"));
+      return false;
+   }
+
+   for (uint16_t i = 0; i < numberOfColumns; i++)
+   {
+#ifdef INPUT_PULLDOWN
+      pinMode(columnPins[i], activeLow ? INPUT_PULLUP : INPUT_PULLDOWN);
+#else
+      pinMode(columnPins[i], activeLow ? INPUT_PULLUP : INPUT);
+#endif
+   }
+
+   usePortMap = false;
+#ifdef FLIGHTSIM_PORT_READ
+   if (portRead)
+   {
+      portMap.clear();
+      usePortMap = true;
+      for (uint16_t i = 0; i < numberOfColumns; i++)
+      {
+         if (!portMap.addPin(i, FLIGHTSIM_PORT_REGISTER(columnPins[i]), FLIGHTSIM_PORT_BITMASK(columnPins[i])))
+         {
+            usePortMap = false;           // too many ports, fall back to digitalRead()
+            break;
+         }
+      }
+   }
+#endif
+   return true;
+}
+
+
+void FlightSimPinInput::readRow(uint8_t row, uint32_t *readData)
+{
+   if (usePortMap)
+   {
+      portMap.read(readData);
+      if (activeLow)
+      {
+         for (uint8_t w = 0; w < MATRIX_WORDS(numberOfColumns); w++)
+         {
+            readData[w] ^= getColumnMask(w);
+         }
+      }
+      return;
+   }
+
+   for (uint16_t i = 0; i < numberOfColumns; i++)
+   {
+      bool pinData = (digitalRead(columnPins[i]) == HIGH) ^ activeLow;
+      if (pinData)
+      {
+         readData[MATRIX_WORD(i)] |= _BV32(MATRIX_BIT(i));
+      }
+   }
+}
+
+
+uint32_t FlightSimPinInput::getColumnMask(uint8_t word)
+{
+   uint16_t columns = numberOfColumns - (uint16_t) word * 32;
+   if (word * 32 >= numberOfColumns)
+   {
+      return 0;
+   }
+   return (columns < 32) ? _BV32(columns) - 1 : 0xffffffff;
+}
+
+
+/*
+ * Switch matrix on Teensy pins. Exactly one row is active at any time, active rows
+ * are LOW by default, but can be set to active HIGH. Multiplexed rows output the
+ * row number in binary to the row pins.
+ */
+
+FlightSimPinMatrixInput::FlightSimPinMatrixInput(uint8_t numberOfRows, const uint8_t *rowPins,
+                                                 uint16_t numberOfColumns, const uint8_t *columnPins,
+                                                 bool activeLow, bool rowsMuxed)
+   : FlightSimPinInput(numberOfColumns, columnPins, activeLow)
+{
+   this->numberOfRows    = numberOfRows;
+   this->numberOfRowPins = 0;
+   this->rowPins         = rowPins;
+   this->rowsMuxed       = rowsMuxed;
+   this->lastRow         = 0xff;
+}
+
+
+bool FlightSimPinMatrixInput::begin()
+{
+   if (!rowPins)
+   {
+      Serial.println(F("FlightSimSwitches ERROR:  Please set the row pins"));
+      return false;
+   }
+
+   if (!rowsMuxed)
+   {
+      numberOfRowPins = numberOfRows;
+   }
+   else
+   {
+      for (int i = 0; i < 32; i++)
+      {
+         if (_BV32(i) >= numberOfRows)
+         {
+            numberOfRowPins = i;
+            break;
+         }
+      }
+   }
+
+   if (rowPins != FLIGHTSIM_EMPTY_PINS)
+   {
+      for (int i = 0; i < numberOfRowPins; i++)
+      {
+         pinMode(rowPins[i], OUTPUT);
+         digitalWrite(rowPins[i], activeLow ? HIGH : LOW);
+      }
+   }
+   lastRow = 0xff;
+
+   return FlightSimPinInput::begin();
+}
+
+
+void FlightSimPinMatrixInput::selectRow(uint8_t row)
+{
+   if (rowPins == FLIGHTSIM_EMPTY_PINS)
+   {
+      return;                      // do nothing if switches are connected directly to Teensy pins
+   }
+
+   if (!rowsMuxed)
+   {
+      // turn only selected row output LOW
+      if (lastRow != 0xff)
+      {
+         digitalWrite(rowPins[lastRow], activeLow ? HIGH : LOW);
+      }
+      digitalWrite(rowPins[row], activeLow ? LOW : HIGH);
+   }
+   else
+   {
+      // output row number to row select pins
+      for (uint8_t i = 0; i < numberOfRowPins; i++)
+      {
+         digitalWrite(rowPins[i], (row & _BV32(i)) ? HIGH : LOW);
+      }
+   }
+   lastRow = row;
+}
+
+
+/*
+ * Generic matrix element. Not to be instantiated directly. Only keeps reference
+ * to matrix and chain of elements.
+ */
+
+bool          MatrixElement::lastEnabled   = false;
+
+MatrixElement::MatrixElement(FlightSimSwitchesBase *matrix)
+{
+   this->matrix             = matrix;
+   this->nextElement        = NULL;
+   if (matrix)
+   {
+      matrix->addElement(this);
+   }
+   this->debug              = false;
+   this->change_callback    = NULL;
+   this->callbackContext    = NULL;
+   this->hasCallbackContext = false;
+   this->polling            = false;
+   this->indexed            = false;
+   this->pending            = false;
+   this->resynced           = false;
+   this->nextPending        = NULL;
+   this->positionGroups     = NULL;
+   this->numberOfGroups     = 0;
+   this->activePositions    = 0;
+}
+
+
+void MatrixElement::setPolling(bool polling)
+{
+   if (polling == this->polling)
+   {
+      return;
+   }
+   this->polling = polling;
+   if (matrix)
+   {
+      if (polling)
+      {
+         matrix->pollingElements++;
+      }
+      else
+      {
+         matrix->pollingElements--;
+      }
+   }
+}
+
+
+bool MatrixElement::getPositionData(uint32_t position)
+{
+   if (!matrix)
+   {
+      matrix->printTime(&Serial);
+      Serial.println(F("FlightSimSwitch ERROR: Please define a FlightSimSwitches or MatrixSwitches object before defining individual switches!"));
+      return 0;
+   }
+   if (position == NO_POSITION)
+   {
+      matrix->printTime(&Serial);
+      Serial.println(F("FlightSimSwitch ERROR: Switch position not set!"));
+      return 0;
+   }
+   uint32_t cell = matrix->getCell(position);
+   if (cell == NO_POSITION)
+   {
+      return false;
+   }
+   return matrix->isOn(MATRIX_ROW(cell), MATRIX_COLUMN(cell));
+}
+
+
+/*
+ * Multi-position switches: splits the positions into runs on ascending bits of
+ * the same row data word, so that findActivePosition() needs one AND and a
+ * count of trailing zeros per run instead of one lookup per position.
+ */
+void MatrixElement::buildPositionGroups()
+{
+   free(positionGroups);
+   positionGroups = NULL;
+   numberOfGroups = 0;
+
+   const uint32_t *positions;
+   size_t         numberOfPositions = getPositions(&positions);
+   if (numberOfPositions < 2)
+   {
+      return;
+   }
+
+   positionGroups = (FlightSimPositionGroup *) malloc(numberOfPositions * sizeof(FlightSimPositionGroup));
+   if (!positionGroups)
+   {
+      return;                      // positions are looked up one by one
+   }
+
+   FlightSimPositionGroup *group = NULL;
+   for (size_t i = 0; i < numberOfPositions; i++)
+   {
+      uint32_t cell = matrix->getCell(positions[i]);
+      if ((cell == NO_POSITION) || (MATRIX_ROW(cell) >= matrix->numberOfRows) || (MATRIX_COLUMN(cell) >= matrix->numberOfColumns))
+      {
+         group = NULL;             // never active, the next position starts a new run
+         continue;
+      }
+
+      uint16_t word = MATRIX_ROW(cell) * matrix->wordsPerRow + MATRIX_WORD(MATRIX_COLUMN(cell));
+      uint8_t  bit  = MATRIX_BIT(MATRIX_COLUMN(cell));
+      if (!group || (group->word != word) || (bit <= 31 - __builtin_clz(group->mask)))
+      {
+         group                = positionGroups + numberOfGroups++;
+         group->word          = word;
+         group->firstPosition = i;
+         group->mask          = 0;
+      }
+      group->mask |= _BV32(bit);
+   }
+}
+
+
+/*
+ * Returns the first active position or -1 and counts the active positions.
+ * Warns when more than one position becomes active
+ */
+int8_t MatrixElement::findActivePosition()
+{
+   uint8_t lastActivePositions = activePositions;
+   int8_t  position            = findFirstPosition();
+
+   if ((activePositions > 1) && (lastActivePositions <= 1))
+   {
+      matrix->printTime(&Serial);
+      Serial.print(F("FlightSimSwitches WARNING: "));
+      Serial.print(activePositions);
+      Serial.println(F(" positions of one switch are active, please check the wiring"));
+   }
+   return position;
+}
+
+
+int8_t MatrixElement::findFirstPosition()
+{
+   int8_t position = -1;
+   activePositions = 0;
+
+   if (positionGroups)
+   {
+      for (uint8_t g = 0; g < numberOfGroups; g++)
+      {
+         const FlightSimPositionGroup *group  = positionGroups + g;
+         uint32_t                     active = matrix->rowData[group->word] & group->mask;
+         if (!active)
+         {
+            continue;
+         }
+         if (position < 0)
+         {
+            position = group->firstPosition + __builtin_popcount(group->mask & (_BV32(__builtin_ctz(active)) - 1));
+         }
+         activePositions += __builtin_popcount(active);
+      }
+      return position;
+   }
+
+   const uint32_t *positions;
+   size_t         numberOfPositions = getPositions(&positions);
+   for (size_t i = 0; i < numberOfPositions; i++)
+   {
+      if (getPositionData(positions[i]))
+      {
+         if (position < 0)
+         {
+            position = i;
+         }
+         activePositions++;
+      }
+   }
+   return position;
+}
+
+
+/*
+ * Returns the value index of a multi-position switch, built on first use
+ */
+FlightSimValueIndex *MatrixElement::useValueIndex(FlightSimValueIndex *index, uint8_t numberOfPositions, const float *values, float tolerance)
+{
+   if (!index->isBuilt() && !index->hasFailed() && !index->build(numberOfPositions, values, tolerance))
+   {
+      matrix->printTime(&Serial);
+      Serial.println(F("FlightSimSwitches WARNING: Not enough memory for value index, commands will be sent one at a time"));
+   }
+   return index;
+}
+
+
+/*
+ * Value index. Sorts the positions by value once, merges values closer than the
+ * tolerance into one detent and keeps both directions of the mapping.
+ */
+
+bool FlightSimValueIndex::build(uint8_t numberOfPositions, const float *values, float tolerance)
+{
+   free(steps);
+   steps                   = NULL;
+   positionSteps           = NULL;
+   stepPositions           = NULL;
+   numberOfSteps           = 0;
+   this->values            = values;
+   this->numberOfPositions = numberOfPositions;
+   this->tolerance         = tolerance;
+   built                   = false;
+   failed                  = false;
+
+   if (!numberOfPositions)
+   {
+      built = true;
+      return true;
+   }
+
+   // one block: detent values, position -> detent, detent -> position, sort order
+   steps = (float *) malloc(numberOfPositions * (sizeof(float) + 3));
+   if (!steps)
+   {
+      failed = true;
+      return false;
+   }
+   built         = true;
+   positionSteps = (uint8_t *) (steps + numberOfPositions);
+   stepPositions = positionSteps + numberOfPositions;
+   uint8_t *order = stepPositions + numberOfPositions;
+
+   for (uint8_t i = 0; i < numberOfPositions; i++)
+   {
+      uint8_t j = i;
+      for (; (j > 0) && (values[order[j - 1]] > values[i]); j--)
+      {
+         order[j] = order[j - 1];
+      }
+      order[j] = i;
+   }
+
+   for (uint8_t i = 0; i < numberOfPositions; i++)
+   {
+      float value = values[order[i]];
+      if (!numberOfSteps || (value - steps[numberOfSteps - 1] >= tolerance))
+      {
+         steps[numberOfSteps]         = value;
+         stepPositions[numberOfSteps] = order[i];
+         numberOfSteps++;
+      }
+      positionSteps[order[i]] = numberOfSteps - 1;
+   }
+   return true;
+}
+
+
+// number of detents below (or at) value
+uint8_t FlightSimValueIndex::countBelow(float value, bool orEqual)
+{
+   uint8_t low  = 0;
+   uint8_t high = numberOfSteps;
+   while (low < high)
+   {
+      uint8_t middle = (low + high) / 2;
+      if ((steps[middle] < value) || (orEqual && (steps[middle] == value)))
+      {
+         low = middle + 1;
+      }
+      else
+      {
+         high = middle;
+      }
+   }
+   return low;
+}
+
+
+int8_t FlightSimValueIndex::findPosition(float value)
+{
+   if (!built)
+   {
+      // no index: nearest detent, the higher one of two as near
+      int8_t nearest = numberOfPositions ? 0 : -1;
+      for (uint8_t i = 1; i < numberOfPositions; i++)
+      {
+         float distance = fabs(values[i] - value);
+         float best     = fabs(values[nearest] - value);
+         if (isFirstOfStep(i) && ((distance < best) || ((distance == best) && (values[i] > values[nearest]))))
+         {
+            nearest = i;
+         }
+      }
+      return nearest;
+   }
+
+   if (!numberOfSteps)
+   {
+      return -1;
+   }
+
+   uint8_t step = countBelow(value, false);
+   if ((step == numberOfSteps) || ((step > 0) && (value - steps[step - 1] < steps[step] - value)))
+   {
+      step--;
+   }
+   return stepPositions[step];
+}
+
+
+/*
+ * Number of detents passed when moving from "from" to "to", at least 1
+ */
+uint8_t FlightSimValueIndex::countSteps(float from, float to)
 {
-   this->matrix = matrix;
-   if (firstElement == NULL)
+   if (!built)
+   {
+      return 1;
+   }
+
+   int16_t count;
+   if (to > from)
    {
-      firstElement = this;
+      count = countBelow(to + tolerance, false) - countBelow(from + tolerance, true);
    }
    else
    {
-      lastElement->nextElement = this;
+      count = countBelow(from - tolerance, false) - countBelow(to - tolerance, true);
    }
-   lastElement              = this;
-   this->debug              = false;
-   this->change_callback    = NULL;
-   this->callbackContext    = NULL;
-   this->hasCallbackContext = false;
+   return (count > 0) ? count : 1;
 }
 
 
-size_t MatrixElement::setGenericPinData(uint8_t *destination, uint32_t startPinIndex, uint32_t *matrixPositions, size_t count)
+uint8_t FlightSimValueIndex::getStep(uint8_t position)
 {
-   if (startPinIndex < MAX_COLUMNS + count)
+   if (built)
    {
-      for (size_t i = 0; i < count; i++)
-      {
-         *destination     = (uint8_t)(*matrixPositions);
-         *matrixPositions = startPinIndex;
-         destination++;
-         matrixPositions++;
-         startPinIndex++;
-      }
-      return count;
+      return positionSteps ? positionSteps[position] : 0;
    }
-   else
+
+   // no index: count the detents below, each at the first position of its value
+   uint8_t step = 0;
+   for (uint8_t i = 0; i < numberOfPositions; i++)
    {
-      return 0;
+      if ((values[i] < values[position]) && (values[position] - values[i] >= tolerance) && isFirstOfStep(i))
+      {
+         step++;
+      }
    }
+   return step;
 }
 
 
-bool MatrixElement::getPositionData(uint32_t position)
+// no position before this one has a value within the tolerance
+bool FlightSimValueIndex::isFirstOfStep(uint8_t position)
 {
-   if (!matrix)
-   {
-      matrix->printTime(&Serial);
-      Serial.println(F("FlightSimSwitch ERROR: Please define a FlightSimSwitches or MatrixSwitches object before defining individual switches!"));
-      return 0;
-   }
-   if (position == NO_POSITION)
+   for (uint8_t i = 0; i < position; i++)
    {
-      matrix->printTime(&Serial);
-      Serial.println(F("FlightSimSwitch ERROR: Switch position not set!"));
+      if (fabs(values[i] - values[position]) < tolerance)
+      {
+         return false;
+      }
    }
-   uint32_t *rowData = matrix->getRowData();
-   uint32_t rowValue = rowData[MATRIX_ROW(position)];
-   return rowValue & _BV32(MATRIX_COLUMN(position));
+   return true;
 }
 
 
@@ -569,7 +2506,7 @@ void MatrixElement::callback(float newValue)
  * This switch corresponds to a single position in the matrix
  */
 
-FlightSimOnOffCommandSwitch::FlightSimOnOffCommandSwitch(FlightSimSwitches *matrix, uint32_t matrixPosition)
+FlightSimOnOffCommandSwitch::FlightSimOnOffCommandSwitch(FlightSimSwitchesBase *matrix, uint32_t matrixPosition)
    : MatrixElement(matrix)
 {
    this->matrixPosition = matrixPosition;
@@ -629,11 +2566,9 @@ void FlightSimOnOffCommandSwitch::handleLoop(bool resync)
          {
             if (debug)
             {
-               matrix->printTime(&Serial);
-               Serial.print(F("FlightSimOnOffCommandSwitch: Sending ON command "));
-               Serial.println(PRINT_DATAREF(onName));
+               matrix->log(LOG_ONOFF_COMMAND_ON, onName);
             }
-            onCommand.once();
+            FlightSimOutput.once(&onCommand, resync ? PRIORITY_RESYNC : PRIORITY_LIVE, this);
             callback(1.0);
          }
       }
@@ -643,11 +2578,9 @@ void FlightSimOnOffCommandSwitch::handleLoop(bool resync)
          {
             if (debug)
             {
-               matrix->printTime(&Serial);
-               Serial.print(F("FlightSimOnOffCommandSwitch: Sending OFF command "));
-               Serial.println(PRINT_DATAREF(offName));
+               matrix->log(LOG_ONOFF_COMMAND_OFF, offName);
             }
-            offCommand.once();
+            FlightSimOutput.once(&offCommand, resync ? PRIORITY_RESYNC : PRIORITY_LIVE, this);
             callback(0.0);
          }
       }
@@ -667,7 +2600,7 @@ float FlightSimOnOffCommandSwitch::getValue()
  * This pushbutton corresponds to a single position in the matrix
  */
 
-FlightSimPushbutton::FlightSimPushbutton(FlightSimSwitches *matrix, uint32_t matrixPosition, bool inverted)
+FlightSimPushbutton::FlightSimPushbutton(FlightSimSwitchesBase *matrix, uint32_t matrixPosition, bool inverted)
    : MatrixElement(matrix)
 {
    this->matrixPosition = matrixPosition;
@@ -689,24 +2622,18 @@ void FlightSimPushbutton::handleLoop(bool resync)
       {
          if (debug)
          {
-            matrix->printTime(&Serial);
-            Serial.print(F("FlightSimOnOffCommandSwitch: Sending command "));
-            Serial.print(PRINT_DATAREF(commandName));
-            Serial.println(F(" BEGIN"));
+            matrix->log(LOG_PUSHBUTTON_BEGIN, commandName);
          }
-         command.begin();
+         FlightSimOutput.begin(&command, resync ? PRIORITY_RESYNC : PRIORITY_LIVE, this);
          callback(1.0);
       }
       else
       {
          if (debug)
          {
-            matrix->printTime(&Serial);
-            Serial.print(F("FlightSimOnOffCommandSwitch: Sending command "));
-            Serial.print(PRINT_DATAREF(commandName));
-            Serial.println(F(" END"));
+            matrix->log(LOG_PUSHBUTTON_END, commandName);
          }
-         command.end();
+         FlightSimOutput.end(&command, resync ? PRIORITY_RESYNC : PRIORITY_LIVE, this);
          callback(0.0);
       }
    }
@@ -727,7 +2654,7 @@ float FlightSimPushbutton::getValue()
  */
 
 
-FlightSimUpDownCommandSwitch::FlightSimUpDownCommandSwitch(FlightSimSwitches *matrix, uint8_t numberOfPositions, uint32_t *positions, float *values, float defaultValue, float tolerance)
+FlightSimUpDownCommandSwitch::FlightSimUpDownCommandSwitch(FlightSimSwitchesBase *matrix, uint8_t numberOfPositions, const uint32_t *positions, const float *values, float defaultValue, float tolerance)
    : MatrixElement(matrix)
 {
    this->numberOfPositions = numberOfPositions;
@@ -738,11 +2665,27 @@ FlightSimUpDownCommandSwitch::FlightSimUpDownCommandSwitch(FlightSimSwitches *ma
    this->oldSwitchValue    = 0.0;
    this->switchChanged     = false;
    this->tolerance         = tolerance;
-   this->commandSent       = false;
    this->name = XPlaneRef("(null)");
    this->pushbuttonPositions = 0;
    this->pushbuttonCommand   = NULL;
    this->findposition_callback = NULL;
+
+   this->pendingCommands      = 0;
+   this->pendingUp            = false;
+   this->maxPendingCommands   = DEFAULT_PENDING_COMMANDS;
+   this->commandTimeout       = DEFAULT_COMMAND_TIMEOUT;
+   this->commandTime          = 0;
+   this->retries              = 0;
+   this->maxRetries           = DEFAULT_COMMAND_RETRIES;
+   this->retryBackoff         = true;
+   this->unreachable          = false;
+   this->stalls               = 0;
+   this->changeTime           = 0;
+   this->lastConvergenceTime  = 0;
+   this->maxConvergenceTime   = 0;
+   this->totalConvergenceTime = 0;
+   this->convergences         = 0;
+   this->commandTimeouts      = 0;
 }
 
 
@@ -756,22 +2699,29 @@ void FlightSimUpDownCommandSwitch::setDatarefAndCommands(const _XpRefStr_ *posit
 
 float FlightSimUpDownCommandSwitch::findValue(int8_t *valueIndex)
 {
-   for (uint8_t i = 0; i < numberOfPositions; i++)
+   int8_t position = findActivePosition();
+   if (position < 0)
    {
-      if (getPositionData(matrixPositions[i]))
-      {
-         if (valueIndex)
-         {
-            *valueIndex = i;
-         }
-         return values[i];
-      }
+      return defaultValue;
+   }
+   if (valueIndex)
+   {
+      *valueIndex = position;
    }
-   return defaultValue;
+   return values[position];
 }
 
 
 void FlightSimUpDownCommandSwitch::handleLoop(bool resync)
+{
+   trackSwitch(resync);
+
+   // keep polling the dataref until it has reached the switch value
+   setPolling(findposition_callback || switchChanged || pendingCommands);
+}
+
+
+void FlightSimUpDownCommandSwitch::trackSwitch(bool resync)
 {
    int8_t valueIndex   = -1;
    float switchValue;
@@ -791,21 +2741,17 @@ void FlightSimUpDownCommandSwitch::handleLoop(bool resync)
    {
       if (debug)
       {
-         matrix->printTime(&Serial);
-         Serial.print(F("FlightSimUpDownCommandSwitch: dataref name: "));
-         Serial.print(PRINT_DATAREF(name));
-         Serial.print(F(", switch value="));
-         Serial.print(switchValue);
-         Serial.print(F(", old switch value="));
-         Serial.print(oldSwitchValue);
-         Serial.print(F(", resync="));
-         Serial.print(resync ? F("TRUE") : F("FALSE"));
-         Serial.print(F(", valueIndex="));
-         Serial.print(valueIndex);
-         Serial.println(F(", switch changed!"));
+         matrix->log(LOG_UPDOWN_CHANGED, name, switchValue, oldSwitchValue, 0, valueIndex, resync);
       }
       switchChanged  = true;
       oldSwitchValue = switchValue;
+      changeTime     = millis();
+      retries        = 0;
+      unreachable    = false;
+      if (resync)
+      {
+         pendingCommands = 0;                  // sent before the flightsim was listening
+      }
       callback(switchValue);
    }
 
@@ -816,111 +2762,150 @@ void FlightSimUpDownCommandSwitch::handleLoop(bool resync)
          // below tolerance is not considered a change
          if (debug)
          {
-            matrix->printTime(&Serial);
-            Serial.print(F("FlightSimUpDownCommandSwitch: dataref name: "));
-            Serial.print(PRINT_DATAREF(name));
-            Serial.print(F(", switch value="));
-            Serial.print(switchValue);
-            Serial.print(F(", dataref value="));
-            Serial.print(datarefValue);
-            Serial.println(F(", final position reached!"));
+            matrix->log(LOG_UPDOWN_REACHED, name, switchValue, datarefValue);
          }
-         switchChanged = false;                // reached final value
-      }
-      commandSent = false;
-      return;
-   }
-
-   if (commandSent)
-   {
-      // check if previous command has finished
-      if (abs(datarefValue - oldDatarefValue) < tolerance)
-      {
-         // no, dataref still has previous value. Wait for dataref
-         // to change
-         return;
-      }
-      else
-      {
-         // dataref has changed, we can send the next command
-         if (debug)
+         switchChanged       = false;          // reached final value
+         lastConvergenceTime = millis() - changeTime;
+         totalConvergenceTime += lastConvergenceTime;
+         convergences++;
+         if (lastConvergenceTime > maxConvergenceTime)
          {
-            matrix->printTime(&Serial);
-            Serial.print(F("FlightSimUpDownCommandSwitch: dataref name: "));
-            Serial.print(PRINT_DATAREF(name));
-            Serial.print(F(", switch value="));
-            Serial.print(switchValue);
-            Serial.print(F(", dataref value="));
-            Serial.print(datarefValue);
-            Serial.print(F(", old dataref value="));
-            Serial.print(oldDatarefValue);
-            Serial.println(F(", previous command handled!"));
+            maxConvergenceTime = lastConvergenceTime;
          }
-         commandSent = false;
       }
+      pendingCommands = 0;
+      unreachable     = false;
+      return;
    }
 
-   if (switchChanged)
+   if (pendingCommands)
    {
-      commandSent     = true;
-      oldDatarefValue = datarefValue;
-      if (switchValue > datarefValue)
+      if (abs(datarefValue - oldDatarefValue) >= tolerance)
       {
+         // dataref has moved, some commands have been handled
          if (debug)
          {
-            matrix->printTime(&Serial);
-            Serial.print(F("FlightSimUpDownCommandSwitch: dataref name: "));
-            Serial.print(PRINT_DATAREF(name));
-            Serial.print(F(", switch value="));
-            Serial.print(switchValue);
-            Serial.print(F(", dataref value="));
-            Serial.print(datarefValue);
-            Serial.println(F(", sending UP command"));
-         }
-         if (pushbuttonCommand)
-         {
-            pushbuttonCommand->end();
-            pushbuttonCommand = NULL;
-         }
-         if ((valueIndex != -1) && (pushbuttonPositions & _BV32(valueIndex)))
-         {
-            upCommand.begin();
-            pushbuttonCommand = &upCommand;
-         }
-         else
-         {
-            upCommand.once();
+            matrix->log(LOG_UPDOWN_HANDLED, name, switchValue, datarefValue, oldDatarefValue);
          }
+         uint8_t steps   = countSteps(oldDatarefValue, datarefValue);
+         pendingCommands = (steps < pendingCommands) ? pendingCommands - steps : 0;
+         oldDatarefValue = datarefValue;
+         commandTime     = millis();
+         retries         = 0;
       }
-      else
+      else if (millis() - commandTime > getRetryTimeout())
       {
-         if (debug)
+         // no reaction from X-Plane, consider the commands lost
+         pendingCommands = 0;
+         commandTimeouts++;
+         if (retries >= maxRetries)
          {
             matrix->printTime(&Serial);
-            Serial.print(F("FlightSimUpDownCommandSwitch: dataref name: "));
+            Serial.print(F("FlightSimSwitches WARNING: "));
             Serial.print(PRINT_DATAREF(name));
-            Serial.print(F(", switch value="));
-            Serial.print(switchValue);
-            Serial.print(F(", dataref value="));
-            Serial.print(datarefValue);
-            Serial.println(F(", sending DOWN command"));
-         }
-         if (pushbuttonCommand)
-         {
-            pushbuttonCommand->end();
-            pushbuttonCommand = NULL;
-         }
-         if ((valueIndex != -1) && (pushbuttonPositions & _BV32(valueIndex)))
-         {
-            pushbuttonCommand = &downCommand;
-            downCommand.begin();
-         }
-         else
-         {
-            downCommand.once();
+            Serial.println(F(" does not follow the up/down commands, giving up"));
+            switchChanged = false;
+            unreachable   = true;
+            stalls++;
+            return;
          }
+         retries++;
       }
    }
+
+   if (!switchChanged)
+   {
+      return;
+   }
+
+   bool up = switchValue > datarefValue;
+   if (pendingCommands && (up != pendingUp))
+   {
+      return;                                  // let the commands in the other direction finish
+   }
+
+   // one command per detent between the dataref and the switch value, limited
+   // to maxPendingCommands. Held (pushbutton) positions and resyncs, where the
+   // dataref may not be current yet, go one command at a time
+   bool    hold  = (valueIndex != -1) && (pushbuttonPositions & _BV32(valueIndex));
+   uint8_t steps = countSteps(datarefValue, switchValue);
+   uint8_t limit = (hold || resync) ? 1 : maxPendingCommands;
+   if (steps > limit)
+   {
+      steps = limit;
+   }
+   if (steps <= pendingCommands)
+   {
+      return;
+   }
+
+   if (!pendingCommands)
+   {
+      oldDatarefValue = datarefValue;
+   }
+   sendCommands(up, steps - pendingCommands, hold, resync ? PRIORITY_RESYNC : PRIORITY_LIVE);
+   if (debug)
+   {
+      matrix->log(up ? LOG_UPDOWN_UP : LOG_UPDOWN_DOWN, name, switchValue, datarefValue, 0, steps - pendingCommands);
+   }
+   pendingCommands = steps;
+   pendingUp       = up;
+   commandTime     = millis();
+}
+
+
+uint32_t FlightSimUpDownCommandSwitch::getRetryTimeout()
+{
+   if (!retryBackoff)
+   {
+      return commandTimeout;
+   }
+   return (uint32_t) commandTimeout << ((retries < MAX_RETRY_BACKOFF) ? retries : MAX_RETRY_BACKOFF);
+}
+
+
+void FlightSimUpDownCommandSwitch::sendCommands(bool up, uint8_t count, bool hold, uint8_t priority)
+{
+   FlightSimCommand *command = up ? &upCommand : &downCommand;
+
+   if (pushbuttonCommand)
+   {
+      FlightSimOutput.end(pushbuttonCommand, priority, this);
+      pushbuttonCommand = NULL;
+   }
+   if (hold)
+   {
+      FlightSimOutput.begin(command, priority, this);
+      pushbuttonCommand = command;
+      return;
+   }
+   FlightSimOutput.once(command, priority, this, count);
+}
+
+
+/*
+ * Number of detents between two dataref values: the distinct values of the
+ * value table passed when moving from "from" to "to", at least 1
+ */
+uint8_t FlightSimUpDownCommandSwitch::countSteps(float from, float to)
+{
+   return useValueIndex(&detents, numberOfPositions, values, tolerance)->countSteps(from, to);
+}
+
+
+int8_t FlightSimUpDownCommandSwitch::findPosition(float value)
+{
+   return useValueIndex(&detents, numberOfPositions, values, tolerance)->findPosition(value);
+}
+
+
+uint8_t FlightSimUpDownCommandSwitch::getStep(uint8_t position)
+{
+   if (position >= numberOfPositions)
+   {
+      return 0;
+   }
+   return useValueIndex(&detents, numberOfPositions, values, tolerance)->getStep(position);
 }
 
 
@@ -934,7 +2919,7 @@ float FlightSimUpDownCommandSwitch::getValue()
  * Matrix On-Off switch that writes values to a dataref
  *
  */
-FlightSimOnOffDatarefSwitch::FlightSimOnOffDatarefSwitch(FlightSimSwitches *matrix, uint32_t position, bool inverted)
+FlightSimOnOffDatarefSwitch::FlightSimOnOffDatarefSwitch(FlightSimSwitchesBase *matrix, uint32_t position, bool inverted)
    : MatrixElement(matrix)
 {
    this->matrixPosition = position;
@@ -960,13 +2945,9 @@ void FlightSimOnOffDatarefSwitch::handleLoop(bool resync)
       int32_t value = switchOn ^ inverted ? 1 : 0;
       if (debug)
       {
-         matrix->printTime(&Serial);
-         Serial.print(F("FlightSimOnOffDatarefSwitch: Writing value "));
-         Serial.print(value);
-         Serial.print(F(" to dataref "));
-         Serial.println(PRINT_DATAREF(name));
+         matrix->log(LOG_ONOFF_DATAREF_WRITE, name, value);
       }
-      dataref.write(value);
+      FlightSimOutput.write(&dataref, value, resync ? PRIORITY_RESYNC : PRIORITY_LIVE, this, name);
       oldValue = switchOn;
       callback(switchOn ? 1.0 : 0.0);
    }
@@ -986,7 +2967,7 @@ float FlightSimOnOffDatarefSwitch::getValue()
  */
 
 
-FlightSimWriteDatarefSwitch::FlightSimWriteDatarefSwitch(FlightSimSwitches *matrix, uint8_t numberOfPositions, uint32_t *positions, float *values, float defaultValue, float tolerance)
+FlightSimWriteDatarefSwitch::FlightSimWriteDatarefSwitch(FlightSimSwitchesBase *matrix, uint8_t numberOfPositions, const uint32_t *positions, const float *values, float defaultValue, float tolerance)
    : MatrixElement(matrix)
 {
    this->numberOfPositions = numberOfPositions;
@@ -1009,14 +2990,8 @@ void FlightSimWriteDatarefSwitch::setDataref(const _XpRefStr_ *positionDataref)
 
 float FlightSimWriteDatarefSwitch::findValue()
 {
-   for (uint8_t i = 0; i < numberOfPositions; i++)
-   {
-      if (getPositionData(matrixPositions[i]))
-      {
-         return values[i];
-      }
-   }
-   return defaultValue;
+   int8_t position = findActivePosition();
+   return (position < 0) ? defaultValue : values[position];
 }
 
 
@@ -1039,13 +3014,9 @@ void FlightSimWriteDatarefSwitch::handleLoop(bool resync)
       oldSwitchValue = switchValue;
       if (debug)
       {
-         matrix->printTime(&Serial);
-         Serial.print(F("FlightSimWriteDatarefSwitch: Writing value "));
-         Serial.print(switchValue);
-         Serial.print(F(" to dataref "));
-         Serial.println(PRINT_DATAREF(name));
+         matrix->log(LOG_WRITE_DATAREF_WRITE, name, switchValue);
       }
-      positionDataref.write(switchValue);
+      FlightSimOutput.write(&positionDataref, switchValue, resync ? PRIORITY_RESYNC : PRIORITY_LIVE, this, name);
       callback(switchValue);
    }
 }
@@ -1055,3 +3026,241 @@ float FlightSimWriteDatarefSwitch::getValue()
 {
    return oldSwitchValue;
 }
+
+
+int8_t FlightSimWriteDatarefSwitch::findPosition(float value)
+{
+   return useValueIndex(&detents, numberOfPositions, values, tolerance)->findPosition(value);
+}
+
+
+uint8_t FlightSimWriteDatarefSwitch::getStep(uint8_t position)
+{
+   if (position >= numberOfPositions)
+   {
+      return 0;
+   }
+   return useValueIndex(&detents, numberOfPositions, values, tolerance)->getStep(position);
+}
+
+
+/*
+ * Rotary encoder
+ *
+ * Quadrature decoding by table: the previous and the current A/B levels form a
+ * 4 bit index, which yields +1 (A leads, up), -1 (B leads, down) or 0 (no
+ * change or a skipped state)
+ */
+
+static const int8_t quadratureTable[16] = {
+    0, -1,  1,  0,
+    1,  0,  0, -1,
+   -1,  0,  0,  1,
+    0,  1, -1,  0
+};
+
+#define ENCODER_STATE_UNKNOWN (0xFF)
+
+FlightSimEncoder *FlightSimEncoder::interruptEncoders[MAX_INTERRUPT_ENCODERS];
+
+void (*const FlightSimEncoder::interruptFunctions[MAX_INTERRUPT_ENCODERS])() = {
+   interrupt<0>, interrupt<1>, interrupt<2>, interrupt<3>,
+   interrupt<4>, interrupt<5>, interrupt<6>, interrupt<7>
+};
+
+
+FlightSimEncoder::FlightSimEncoder(FlightSimSwitchesBase *matrix, uint32_t positionA, uint32_t positionB)
+   : MatrixElement(matrix)
+{
+   this->positions[0]       = positionA;
+   this->positions[1]       = positionB;
+   this->useInterrupts      = false;
+   this->interruptsAttached = false;
+   this->state              = ENCODER_STATE_UNKNOWN;
+   this->steps              = 0;
+   this->missedSteps        = 0;
+   this->stepsPerDetent     = DEFAULT_STEPS_PER_DETENT;
+   this->fastInterval       = 0;
+   this->fastFactor         = 1;
+   this->detentTime         = 0;
+   this->detents            = 0;
+   this->repeatInterval     = 0;
+   this->minHoldCommands    = 2;
+   this->holdCommand        = NULL;
+   this->holdEnd            = 0;
+   this->upName             = XPlaneRef("(null)");
+   this->downName           = XPlaneRef("(null)");
+}
+
+
+FlightSimEncoder::~FlightSimEncoder()
+{
+   if (!interruptsAttached)
+   {
+      return;
+   }
+
+   detachInterrupt(digitalPinToInterrupt(positions[0]));
+   detachInterrupt(digitalPinToInterrupt(positions[1]));
+   for (uint8_t slot = 0; slot < MAX_INTERRUPT_ENCODERS; slot++)
+   {
+      if (interruptEncoders[slot] == this)
+      {
+         interruptEncoders[slot] = NULL;
+      }
+   }
+   interruptsAttached = false;
+}
+
+
+void FlightSimEncoder::setCommands(const _XpRefStr_ *upCommand, const _XpRefStr_ *downCommand)
+{
+   this->upName   = upCommand;
+   this->downName = downCommand;
+   this->upCommand.assign(upCommand);
+   this->downCommand.assign(downCommand);
+}
+
+
+void FlightSimEncoder::beginElement()
+{
+   if (!useInterrupts || interruptsAttached)
+   {
+      return;
+   }
+
+   if (!matrix->hasPinPositions())
+   {
+      matrix->printTime(&Serial);
+      Serial.println(F("FlightSimSwitches WARNING: Encoder interrupts need direct pin mode, decoding at the scan rate"));
+      return;
+   }
+
+   uint8_t slot = 0;
+   while ((slot < MAX_INTERRUPT_ENCODERS) && interruptEncoders[slot])
+   {
+      slot++;
+   }
+   if ((slot == MAX_INTERRUPT_ENCODERS) || (positions[0] >= NUM_DIGITAL_PINS) || (positions[1] >= NUM_DIGITAL_PINS))
+   {
+      matrix->printTime(&Serial);
+      Serial.print(F("FlightSimSwitches WARNING: Encoder interrupts not available, "));
+      Serial.print(MAX_INTERRUPT_ENCODERS);
+      Serial.println(F(" encoders max on valid pins, decoding at the scan rate"));
+      return;
+   }
+
+   interruptEncoders[slot] = this;
+   interruptsAttached      = true;
+   state                   = (digitalRead(positions[0]) << 1) | digitalRead(positions[1]);
+   attachInterrupt(digitalPinToInterrupt(positions[0]), interruptFunctions[slot], CHANGE);
+   attachInterrupt(digitalPinToInterrupt(positions[1]), interruptFunctions[slot], CHANGE);
+
+   // the pins are not read by the frame, only the accumulated detents are sent
+   setPolling(true);
+}
+
+
+void FlightSimEncoder::handleInterrupt(uint8_t slot)
+{
+   FlightSimEncoder *encoder = interruptEncoders[slot];
+   encoder->decode((digitalRead(encoder->positions[0]) << 1) | digitalRead(encoder->positions[1]));
+}
+
+
+void FlightSimEncoder::decode(uint8_t newState)
+{
+   if (state != ENCODER_STATE_UNKNOWN)
+   {
+      steps += quadratureTable[(state << 2) | newState];
+      if ((state ^ newState) == 3)
+      {
+         missedSteps++;
+      }
+   }
+   state = newState;
+}
+
+
+void FlightSimEncoder::handleLoop(bool resync)
+{
+   if (!interruptsAttached)
+   {
+      decode((getPositionData(positions[0]) << 1) | getPositionData(positions[1]));
+   }
+   if (holdCommand && ((int32_t) (millis() - holdEnd) >= 0))
+   {
+      endHold();
+   }
+
+   // takes the complete detents and leaves the rest. The interrupt may change
+   // steps in between, and a 16 bit variable takes two instructions on AVR.
+   // A resync sends nothing more: the encoder is relative
+   noInterrupts();
+   int16_t turned = steps / stepsPerDetent;
+   steps         -= turned * stepsPerDetent;
+   interrupts();
+   if (!turned)
+   {
+      return;
+   }
+   detents += turned;
+
+   bool    up    = turned > 0;
+   int16_t count = up ? turned : -turned;
+   if (fastInterval && (millis() - detentTime < fastInterval))
+   {
+      count *= fastFactor;
+   }
+   detentTime = millis();
+
+   if (debug)
+   {
+      matrix->log(up ? LOG_ENCODER_UP : LOG_ENCODER_DOWN, up ? upName : downName, detents, 0, 0, count);
+   }
+
+   FlightSimCommand *command = up ? &upCommand : &downCommand;
+   if (holdCommand && (holdCommand != command))
+   {
+      endHold();
+   }
+   if (holdCommand)
+   {
+      holdEnd += count * repeatInterval;
+   }
+   else if (repeatInterval && (count >= minHoldCommands))
+   {
+      FlightSimOutput.begin(command, PRIORITY_LIVE, this);
+      holdCommand = command;
+      holdEnd     = millis() + count * repeatInterval;
+      setPolling(true);
+   }
+   else
+   {
+      FlightSimOutput.once(command, PRIORITY_LIVE, this, count);
+   }
+   callback(detents);
+}
+
+
+void FlightSimEncoder::endHold()
+{
+   FlightSimOutput.end(holdCommand, PRIORITY_LIVE, this);
+   holdCommand = NULL;
+   setPolling(interruptsAttached);
+}
+
+
+float FlightSimEncoder::getValue()
+{
+   return detents;
+}
+
+
+uint32_t FlightSimEncoder::getMissedSteps()
+{
+   noInterrupts();
+   uint32_t missed = missedSteps;
+   interrupts();
+   return missed;
+}
@@ -15,6 +15,44 @@
 
 #define _BV32(i) (((uint32_t) 1) << i)
 
+// direct port reads. Column pins are grouped by GPIO port and each port register
+// is read once per row. Boards not listed here use digitalRead() for every pin.
+// The host build simulates Teensy 4 ports, see extras/host/include/HostPorts.h
+#if defined(__IMXRT1062__) || defined(FLIGHTSIM_HOST)
+#define FLIGHTSIM_PORT_READ
+typedef uint32_t flightsim_port_t;
+#define FLIGHTSIM_PORT_REGISTER(pin)    (portInputRegister(pin))
+#define FLIGHTSIM_PORT_BITMASK(pin)     (digitalPinToBitMask(pin))
+#elif defined(__AVR__)
+#define FLIGHTSIM_PORT_READ
+typedef uint8_t flightsim_port_t;
+#define FLIGHTSIM_PORT_REGISTER(pin)    (portInputRegister(digitalPinToPort(pin)))
+#define FLIGHTSIM_PORT_BITMASK(pin)     (digitalPinToBitMask(pin))
+#else
+typedef uint32_t flightsim_port_t;
+#endif
+
+// background scanning from a timer interrupt, see SCAN_BACKGROUND
+#if defined(TEENSYDUINO) || defined(FLIGHTSIM_HOST)
+#define FLIGHTSIM_BACKGROUND_SCAN
+#endif
+
+// scan profiling, see FlightSimProfile. Off unless defined here or in the build flags
+// #define FLIGHTSIM_PROFILING
+#ifdef FLIGHTSIM_PROFILING
+#if defined(ARM_DWT_CYCCNT)
+#define FLIGHTSIM_CYCLES()              (ARM_DWT_CYCCNT)
+#if defined(F_CPU_ACTUAL)
+#define FLIGHTSIM_CYCLES_PER_US         (F_CPU_ACTUAL / 1000000)
+#else
+#define FLIGHTSIM_CYCLES_PER_US         (F_CPU / 1000000)
+#endif
+#else
+#define FLIGHTSIM_CYCLES()              ((uint32_t) micros())
+#define FLIGHTSIM_CYCLES_PER_US         (1)
+#endif
+#endif
+
 #define FLIGHTSIM_STARTUP   while (!Serial && millis()<3000); \
   if (Serial) { \
     delay(200); \
@@ -31,18 +69,112 @@
  */
 
 // position macros
-#define MATRIX(row, column)    ((row << 5) | column)
-#define MATRIX_ROW(n)          (n >> 5)
-#define MATRIX_COLUMN(n)       (n & 0x1f)
+#define MATRIX(row, column)    (((row) << 8) | (column))
+#define MATRIX_ROW(n)          ((n) >> 8)
+#define MATRIX_COLUMN(n)       ((n) & 0xff)
+
+// row data is stored in 32 bit words, a row may span several words
+#define MATRIX_WORDS(columns)  (((columns) + 31) / 32)
+#define MATRIX_WORD(column)    ((column) >> 5)
+#define MATRIX_BIT(column)     ((column) & 0x1f)
 
-// max rows and columns
+// default max rows and columns (FlightSimSwitches). Use FlightSimSwitchMatrix<rows, columns>
+// for other sizes, up to MAX_MATRIX_ROWS x MAX_MATRIX_COLUMNS
 #define MAX_ROWS             32
 #define MAX_COLUMNS          32
+#define MAX_MATRIX_ROWS      255
+#define MAX_MATRIX_COLUMNS   256
+
+class MatrixElement;
+
+struct FlightSimCellOwner {
+   uint16_t      cell;
+   MatrixElement *element;
+};
+
+// consecutive positions of an element on ascending bits of one row data word
+struct FlightSimPositionGroup {
+   uint16_t word;                      // index into the row data
+   uint8_t  firstPosition;
+   uint32_t mask;
+};
+
+// max GPIO ports and mask/shift pairs for direct port reads
+#define MAX_PORTS            8
+#define MAX_PORT_GATHERS     32
+
+// debouncer: number of vertical counter bits and max. number of samples
+#define DEBOUNCE_BITS        3
+#define MAX_DEBOUNCE_SAMPLES ((1 << DEBOUNCE_BITS) - 1)
+
+// outbound messages queued per priority, see FlightSimOutputQueue. A message takes
+// 11 bytes on AVR and 16 bytes on 32 bit boards, so AVR boards only get a few.
+// Change with a build flag, e.g. -DOUTPUT_QUEUE_SIZE=16, so that the library and
+// the sketch use the same size
+#ifndef OUTPUT_QUEUE_SIZE
+#ifdef __AVR__
+#define OUTPUT_QUEUE_SIZE    8
+#else
+#define OUTPUT_QUEUE_SIZE    64
+#endif
+#endif
+
+// message priorities. Live switch changes are sent before resync traffic
+#define PRIORITY_LIVE        (0)
+#define PRIORITY_RESYNC      (1)
+#define NUMBER_OF_PRIORITIES (2)
+
+// datarefs whose last written value is kept for write coalescing
+#ifndef MAX_WRITTEN_DATAREFS
+#ifdef __AVR__
+#define MAX_WRITTEN_DATAREFS 8
+#else
+#define MAX_WRITTEN_DATAREFS 64
+#endif
+#endif
+
+// debug log: Serial space needed to format one record without blocking
+#define LOG_RECORD_SPACE     (128)
+
+// debug log events
+#define LOG_ONOFF_COMMAND_ON     (0)
+#define LOG_ONOFF_COMMAND_OFF    (1)
+#define LOG_PUSHBUTTON_BEGIN     (2)
+#define LOG_PUSHBUTTON_END       (3)
+#define LOG_UPDOWN_CHANGED       (4)
+#define LOG_UPDOWN_REACHED       (5)
+#define LOG_UPDOWN_HANDLED       (6)
+#define LOG_UPDOWN_UP            (7)
+#define LOG_UPDOWN_DOWN          (8)
+#define LOG_ONOFF_DATAREF_WRITE  (9)
+#define LOG_WRITE_DATAREF_WRITE  (10)
+#define LOG_ENCODER_UP           (11)
+#define LOG_ENCODER_DOWN         (12)
+
+// storage per matrix: row data and changed cells. The planes of the debouncer,
+// the frame snapshot and the background scan are allocated by begin() when used
+#define STORAGE_PLANES       (2)
+#define MATRIX_STORAGE(rows, columns)    ((rows) * MATRIX_WORDS(columns) * STORAGE_PLANES)
 
 // default values
 #define DEFAULT_SCAN_RATE    (15)       // default scan rate in milliseconds
+#define DEFAULT_SETTLE_TIME  (10)       // default row settle time in microseconds (full frame scan)
 #define DEFAULT_TOLERANCE    (1E-4)     // default tolerance for multi-position switches
+#define DEFAULT_MESSAGE_RATE (0)        // default messages to X-Plane per millisecond, 0: unlimited
+#define DEFAULT_RESYNC_CHUNK (0)        // default elements resynced per frame, 0: all at once
+#define DEFAULT_PENDING_COMMANDS (4)    // default up/down commands sent ahead of the dataref
+#define DEFAULT_COMMAND_TIMEOUT  (500)  // default ms to wait for the dataref to follow a command
+#define DEFAULT_COMMAND_RETRIES (3)     // default timeouts before an up/down switch is unreachable
+#define MAX_RETRY_BACKOFF    (6)        // max doublings of the command timeout
+#define DEFAULT_STEPS_PER_DETENT (4)    // default quadrature steps per encoder detent
+#define MAX_INTERRUPT_ENCODERS   (8)    // encoders decoded in pin change interrupts
 #define NO_POSITION          (0xffffffff)
+#define NO_COLUMN            (0xffff)
+
+// scan modes
+#define SCAN_ROW_BY_ROW      (0)        // read one row every scanRate milliseconds
+#define SCAN_FULL_FRAME      (1)        // read all rows in one burst every scanRate milliseconds
+#define SCAN_BACKGROUND      (2)        // read one row every scanRate milliseconds from a timer interrupt
 
 // helper macros
 #define SWITCH_POSITIONS(...)    (uint32_t[]){__VA_ARGS__ }
@@ -59,99 +191,968 @@
 #define MatrixOnOffDatarefSwitch         FlightSimOnOffDatarefSwitch
 #define MatrixWriteDatarefSwitch         FlightSimWriteDatarefSwitch
 
-// debug values
-#define DEBUG_SCAN                       (1)
-#define DEBUG_SWITCHES_ONOFF_COMMAND     (2)
-#define DEBUG_SWITCHES_ON_COMMAND        (4)
-#define DEBUG_SWITCHES_OFF_COMMAND       (8)
-#define DEBUG_SWITCHES_PUSHBUTTON        (16)
-#define DEBUG_SWITCHES_UPDOWN_COMMAND    (32)
-#define DEBUG_SWITCHES_ONOFF_DATAREF     (64)
-#define DEBUG_SWITCHES_WRITE_DATAREF     (128)
-#define DEBUG_SWITCHES_CONFIG            (256)
-#define DEBUG_SWITCHES                   (0xFFFFFFFF & ~DEBUG_SCAN)
-#define DEBUG_OFF                        (0)
+// debug values
+#define DEBUG_SCAN                       (1)
+#define DEBUG_SWITCHES_ONOFF_COMMAND     (2)
+#define DEBUG_SWITCHES_ON_COMMAND        (4)
+#define DEBUG_SWITCHES_OFF_COMMAND       (8)
+#define DEBUG_SWITCHES_PUSHBUTTON        (16)
+#define DEBUG_SWITCHES_UPDOWN_COMMAND    (32)
+#define DEBUG_SWITCHES_ONOFF_DATAREF     (64)
+#define DEBUG_SWITCHES_WRITE_DATAREF     (128)
+#define DEBUG_SWITCHES_CONFIG            (256)
+#define DEBUG_SWITCHES_ENCODER           (512)
+#define DEBUG_SWITCHES                   (0xFFFFFFFF & ~DEBUG_SCAN)
+#define DEBUG_OFF                        (0)
+
+/*
+ * Maps column pins to GPIO port registers. Every port is read once and the bits
+ * are gathered into the row word with precomputed masks and shifts. Consecutive
+ * port bits that end up in consecutive columns share a single mask.
+ */
+class FlightSimPortMap {
+public:
+   FlightSimPortMap()
+   {
+      clear();
+   }
+
+   void clear()
+   {
+      numberOfPorts   = 0;
+      numberOfGathers = 0;
+   }
+
+   bool addPin(uint16_t column, volatile flightsim_port_t *portRegister, flightsim_port_t bitMask);
+   void read(uint32_t *readData);
+
+   uint8_t getNumberOfPorts()
+   {
+      return numberOfPorts;
+   }
+
+   uint8_t getNumberOfGathers()
+   {
+      return numberOfGathers;
+   }
+
+private:
+   struct Gather {
+      uint8_t  port;
+      uint8_t  word;                  // destination word in the row
+      int8_t   shift;                 // > 0: shift right, < 0: shift left
+      uint32_t mask;
+   };
+
+   volatile flightsim_port_t *ports[MAX_PORTS];
+   uint8_t numberOfPorts;
+   Gather  gathers[MAX_PORT_GATHERS];
+   uint8_t numberOfGathers;
+};
+
+
+/*
+ * Integrating debouncer, implemented as vertical counters: bit n of every counter
+ * of a row is stored in one word, so that 32 columns are processed at once.
+ * A counter counts the consecutive samples that differ from the debounced
+ * state, which flips once pressSamples (raw bit 1) or releaseSamples (raw bit 0)
+ * have been seen.
+ */
+class FlightSimDebouncer {
+public:
+   FlightSimDebouncer()
+   {
+      setSamples(1, 1);
+   }
+
+   void setSamples(uint8_t pressSamples, uint8_t releaseSamples);
+
+   bool isActive()
+   {
+      return (pressSamples > 1) || (releaseSamples > 1);
+   }
+
+   uint32_t debounce(uint32_t raw, uint32_t debounced, uint32_t *counters);
+
+private:
+   uint8_t pressSamples;
+   uint8_t releaseSamples;
+};
+
+
+/*
+ * Outbound queue for commands and dataref writes. All matrices share the USB link
+ * to X-Plane, so there is one queue, FlightSimOutput. Messages are sent at most
+ * at messageRate messages per millisecond, live messages before resync messages.
+ * A live message of an element drops the resync messages of the same element
+ * that are still queued, as they are outdated. When a queue is full, the message
+ * is lost and counted as dropped.
+ *
+ * With a message rate of 0 (default), everything is sent immediately.
+ *
+ * Dataref writes are coalesced: they are held until the end of the frame, and a newer write to the same dataref (same name,
+ * even through another element) replaces a queued one, unless a command was
+ * queued in between, so that commands and writes stay in order. When a write is
+ * sent, it is skipped if X-Plane already reports the value: on resync always,
+ * otherwise only if it was the last value written to that dataref, so that
+ * writes still in flight are not lost. This cuts the traffic of a resync on
+ * aircraft load. setWriteCoalescing(false) sends writes right away instead.
+ *
+ * Repeated once() commands are batches: a batch takes one queue entry and sends
+ * one command per message credit, and a once() of the command at the end of the
+ * queue is added to its batch instead of taking another entry.
+ */
+class FlightSimOutputQueue {
+public:
+   FlightSimOutputQueue();
+
+   void setMessageRate(uint16_t messagesPerMillisecond)
+   {
+      this->messageRate = messagesPerMillisecond;
+   }
+
+   void setWriteCoalescing(bool coalesceWrites)
+   {
+      this->coalesceWrites = coalesceWrites;
+   }
+
+   // owner identifies the sender (usually the element), NULL: the command or dataref.
+   // count sends the command repeatedly as one batch, which takes one queue entry
+   void once(FlightSimCommand *command, uint8_t priority = PRIORITY_LIVE, const void *owner = NULL, uint16_t count = 1);
+   void begin(FlightSimCommand *command, uint8_t priority = PRIORITY_LIVE, const void *owner = NULL);
+   void end(FlightSimCommand *command, uint8_t priority = PRIORITY_LIVE, const void *owner = NULL);
+   // name identifies the dataref for coalescing, NULL: the dataref object
+   void write(FlightSimFloat *dataref, float value, uint8_t priority = PRIORITY_LIVE, const void *owner = NULL,
+              const _XpRefStr_ *name = NULL);
+   void write(FlightSimInteger *dataref, int32_t value, uint8_t priority = PRIORITY_LIVE, const void *owner = NULL,
+              const _XpRefStr_ *name = NULL);
+
+   // sends queued messages as far as the message rate allows
+   void process();
+
+   uint16_t getQueueDepth()
+   {
+      return queues[PRIORITY_LIVE].count + queues[PRIORITY_RESYNC].count;
+   }
+
+   uint16_t getQueueDepth(uint8_t priority)
+   {
+      return queues[priority].count;
+   }
+
+   uint16_t getMaxQueueDepth()
+   {
+      return maxDepth;
+   }
+
+   uint32_t getSentMessages()
+   {
+      return sentMessages;
+   }
+
+   uint32_t getDroppedMessages()
+   {
+      return droppedMessages;
+   }
+
+   uint32_t getSupersededMessages()
+   {
+      return supersededMessages;
+   }
+
+   uint32_t getCoalescedWrites()
+   {
+      return coalescedWrites;
+   }
+
+   uint32_t getSkippedWrites()
+   {
+      return skippedWrites;
+   }
+
+   // once() commands that did not need a queue entry of their own: part of a
+   // batch or added to the batch of the same command at the end of the queue
+   uint32_t getCollapsedCommands()
+   {
+      return collapsedCommands;
+   }
+
+   void clearCounters()
+   {
+      maxDepth           = getQueueDepth();
+      sentMessages       = 0;
+      droppedMessages    = 0;
+      supersededMessages = 0;
+      coalescedWrites    = 0;
+      skippedWrites      = 0;
+      collapsedCommands  = 0;
+   }
+
+private:
+   struct Message {
+      uint8_t           type;
+      void              *target;
+      const void        *owner;
+      const _XpRefStr_ *name;
+      union {
+         float   floatValue;
+         int32_t intValue;             // value written, remaining count of once()
+      };
+   };
+
+   struct WrittenDataref {
+      void              *target;
+      const _XpRefStr_ *name;
+      float             value;
+   };
+
+   struct Queue {
+      Message  messages[OUTPUT_QUEUE_SIZE];
+      uint16_t first;
+      uint16_t count;
+   };
+
+   void add(uint8_t type, void *target, float floatValue, int32_t intValue, uint8_t priority, const void *owner,
+            const _XpRefStr_ *name);
+   bool takeCredit();
+   void send(const Message *message, uint8_t priority);
+   void coalesceWrite(const Message *message);
+   bool isRedundantWrite(const Message *message, uint8_t priority);
+   bool sameDataref(void *target1, const _XpRefStr_ *name1, void *target2, const _XpRefStr_ *name2);
+
+   Queue queues[NUMBER_OF_PRIORITIES];
+   uint16_t messageRate;
+   uint32_t credit;                        // in 1/1000 messages
+   uint32_t lastRefill;
+   uint16_t maxDepth;
+   uint32_t sentMessages;
+   uint32_t droppedMessages;
+   uint32_t supersededMessages;
+   bool coalesceWrites;
+   WrittenDataref writtenDatarefs[MAX_WRITTEN_DATAREFS];
+   uint8_t numberOfWrittenDatarefs;
+   uint32_t coalescedWrites;
+   uint32_t skippedWrites;
+   uint32_t collapsedCommands;
+};
+
+extern FlightSimOutputQueue FlightSimOutput;
+
+
+#ifdef FLIGHTSIM_PROFILING
+/*
+ * Scan profile, see FlightSimSwitchesBase::getProfile(). Times in nanoseconds
+ */
+struct FlightSimProfile {
+   uint32_t      frames;
+   float         framesPerSecond;
+   uint32_t      rowSelectMin;
+   uint32_t      rowSelectAvg;
+   uint32_t      rowSelectMax;
+   uint32_t      rowReadMin;
+   uint32_t      rowReadAvg;
+   uint32_t      rowReadMax;
+   uint32_t      dispatchMin;
+   uint32_t      dispatchAvg;
+   uint32_t      dispatchMax;
+   MatrixElement *slowestElement;
+   uint32_t      slowestElementTime;
+};
+
+/*
+ * Min, max and total of a measured time in cycles
+ */
+class FlightSimTiming {
+public:
+   FlightSimTiming()
+   {
+      clear();
+   }
+
+   void clear()
+   {
+      this->count = 0;
+      this->min   = 0xffffffff;
+      this->max   = 0;
+      this->total = 0;
+   }
+
+   void add(uint32_t cycles)
+   {
+      count++;
+      total += cycles;
+      if (cycles < min)
+      {
+         min = cycles;
+      }
+      if (cycles > max)
+      {
+         max = cycles;
+      }
+   }
+
+   uint32_t getMin()
+   {
+      return count ? toNanoseconds(min) : 0;
+   }
+
+   uint32_t getAvg()
+   {
+      return count ? toNanoseconds(total / count) : 0;
+   }
+
+   uint32_t getMax()
+   {
+      return toNanoseconds(max);
+   }
+
+   static uint32_t toNanoseconds(uint64_t cycles)
+   {
+      return cycles * 1000 / FLIGHTSIM_CYCLES_PER_US;
+   }
+
+private:
+   uint32_t count;
+   uint32_t min;
+   uint32_t max;
+   uint64_t total;
+};
+#endif
+
+
+/*
+ * Switch transition, as recorded in a FlightSimEventBuffer
+ */
+struct FlightSimSwitchEvent {
+   uint32_t time;                        // micros() when the row was read
+   uint16_t column;
+   uint8_t  row;
+   bool     state;
+};
+
+/*
+ * Single producer, single consumer ring buffer of switch transitions. The matrix
+ * scan is the only producer, a single consumer may drain it from loop() or any
+ * other context without locking. When the buffer is full, new events are lost
+ * and counted as overflows. Storage is provided by FlightSimEventBuffer.
+ */
+class FlightSimEventRing {
+public:
+   bool push(uint8_t row, uint16_t column, bool state, uint32_t time);
+   bool pop(FlightSimSwitchEvent *event);
+
+   uint16_t available()
+   {
+      return (uint16_t) (head - tail);
+   }
+
+   uint32_t getOverflows()
+   {
+      return overflows;
+   }
+
+   // consumer only
+   void clear()
+   {
+      tail = head;
+   }
+
+protected:
+   FlightSimEventRing(FlightSimSwitchEvent *events, uint16_t size)
+   {
+      this->events    = events;
+      this->size      = size;
+      this->head      = 0;
+      this->tail      = 0;
+      this->overflows = 0;
+   }
+
+private:
+   FlightSimSwitchEvent *events;
+   uint16_t size;                        // power of 2
+   volatile uint16_t head;               // written by the producer only
+   volatile uint16_t tail;               // written by the consumer only
+   volatile uint32_t overflows;
+};
+
+template <uint16_t Size>
+class FlightSimEventBuffer : public FlightSimEventRing {
+   static_assert((Size > 1) && ((Size & (Size - 1)) == 0), "FlightSimEventBuffer: size must be a power of 2");
+
+public:
+   FlightSimEventBuffer() : FlightSimEventRing(storage, Size)
+   {
+   }
+
+private:
+   FlightSimSwitchEvent storage[Size];
+};
+
+
+/*
+ * Debug log record: an event of an element and its values, formatted when the
+ * log is flushed
+ */
+struct FlightSimLogRecord {
+   uint32_t         time;               // millis()
+   const _XpRefStr_ *name;              // command or dataref of the element
+   float            values[3];
+   int16_t          index;
+   uint8_t          event;              // LOG_*
+   bool             resync;
+};
+
+/*
+ * Ring buffer of debug log records, written and flushed from loop(). When the
+ * buffer is full, new records are dropped and counted. Storage is provided by
+ * FlightSimLogBuffer.
+ */
+class FlightSimLogRing {
+public:
+   bool push(const FlightSimLogRecord *record);
+   bool pop(FlightSimLogRecord *record);
+
+   uint16_t available()
+   {
+      return (uint16_t) (head - tail);
+   }
+
+   uint32_t getDrops()
+   {
+      return drops;
+   }
+
+   void clear()
+   {
+      tail = head;
+   }
+
+protected:
+   FlightSimLogRing(FlightSimLogRecord *records, uint16_t size)
+   {
+      this->records = records;
+      this->size    = size;
+      this->head    = 0;
+      this->tail    = 0;
+      this->drops   = 0;
+   }
+
+private:
+   FlightSimLogRecord *records;
+   uint16_t size;                        // power of 2
+   uint16_t head;
+   uint16_t tail;
+   uint32_t drops;
+};
+
+template <uint16_t Size>
+class FlightSimLogBuffer : public FlightSimLogRing {
+   static_assert((Size > 1) && ((Size & (Size - 1)) == 0), "FlightSimLogBuffer: size must be a power of 2");
+
+public:
+   FlightSimLogBuffer() : FlightSimLogRing(storage, Size)
+   {
+   }
+
+private:
+   FlightSimLogRecord storage[Size];
+};
+
+
+extern const uint8_t FLIGHTSIM_EMPTY_PINS[];
+
+/*
+ * Input source. Acquires the switch states for a matrix: Teensy pins, shift
+ * registers, port expanders etc. The matrix calls startFrame() before reading
+ * row 0 and selectRow() before reading any row. readRow() receives a zeroed
+ * buffer of MATRIX_WORDS(columns) words and sets the bits of all active inputs.
+ *
+ * Sources that know when their inputs change (e.g. through an interrupt line)
+ * return false from frameChanged(), so the matrix skips reading that frame.
+ *
+ * A matrix can be fed by several sources. Their rows are stacked in the order
+ * the sources were added, so the rows of the second source follow the last row
+ * of the first one. Row numbers passed to a source always start at 0.
+ */
+class FlightSimInputSource {
+   friend class FlightSimSwitchesBase;
+
+public:
+   FlightSimInputSource()
+   {
+      this->nextSource = NULL;
+      this->firstRow   = 0;
+   }
+
+   virtual ~FlightSimInputSource()
+   {
+   }
+
+   virtual bool begin() = 0;
+   virtual uint8_t getNumberOfRows() = 0;
+   virtual uint16_t getNumberOfColumns() = 0;
+   virtual void readRow(uint8_t row, uint32_t *readData) = 0;
+
+   virtual bool frameChanged()
+   {
+      return true;
+   }
+
+   virtual void startFrame()
+   {
+   }
+
+   virtual void selectRow(uint8_t row)
+   {
+   }
+
+   // true if selecting a row drives hardware that needs time to settle
+   virtual bool drivesRows()
+   {
+      return false;
+   }
+
+private:
+   FlightSimInputSource *nextSource;
+   uint8_t firstRow;                     // first matrix row of this source
+};
+
+
+/*
+ * Switches connected directly to Teensy pins, one column per pin. Pins are read
+ * through the GPIO port registers where possible, see FlightSimPortMap.
+ */
+class FlightSimPinInput : public FlightSimInputSource {
+public:
+   FlightSimPinInput(uint16_t numberOfColumns, const uint8_t *columnPins, bool activeLow = true);
+
+   void setColumnPins(uint16_t numberOfColumns, const uint8_t *columnPins)
+   {
+      this->numberOfColumns = numberOfColumns;
+      this->columnPins      = columnPins;
+   }
+
+   void setNumberOfColumns(uint16_t numberOfColumns)
+   {
+      this->numberOfColumns = numberOfColumns;
+   }
+
+   void setColumnPins(const uint8_t *columnPins)
+   {
+      this->columnPins = columnPins;
+   }
+
+   void setActiveLow(bool activeLow)
+   {
+      this->activeLow = activeLow;
+   }
+
+   void setPortRead(bool portRead)
+   {
+      this->portRead = portRead;
+   }
+
+   virtual bool begin();
+   virtual void readRow(uint8_t row, uint32_t *readData);
+
+   virtual uint8_t getNumberOfRows()
+   {
+      return 1;
+   }
+
+   virtual uint16_t getNumberOfColumns()
+   {
+      return numberOfColumns;
+   }
+
+   const uint8_t *getColumnPins()
+   {
+      return columnPins;
+   }
+
+   // port map used for reading, NULL if the pins are read with digitalRead()
+   FlightSimPortMap *getPortMap()
+   {
+      return usePortMap ? &portMap : NULL;
+   }
+
+protected:
+   uint32_t getColumnMask(uint8_t word);
+
+   const uint8_t *columnPins;
+   uint16_t numberOfColumns;
+   bool activeLow;
+   bool portRead;
+   bool usePortMap;
+   FlightSimPortMap portMap;
+};
+
+
+/*
+ * Row/column switch matrix on Teensy pins. The rows are the OUTPUT lines, the
+ * columns the INPUT lines. Rows can be multiplexed through a 74HCT/LS154 or
+ * 74HCT/LS138 chip. Without row pins, this is the same as FlightSimPinInput.
+ */
+class FlightSimPinMatrixInput : public FlightSimPinInput {
+public:
+   FlightSimPinMatrixInput(uint8_t numberOfRows, const uint8_t *rowPins, uint16_t numberOfColumns, const uint8_t *columnPins,
+                           bool activeLow = true, bool rowsMuxed = false);
+
+   void setNumberOfRows(uint8_t numberOfRows)
+   {
+      this->numberOfRows = numberOfRows;
+   }
+
+   void setRowPins(const uint8_t *rowPins)
+   {
+      this->rowPins = rowPins;
+   }
+
+   void setRowsMultiplexed(bool rowsMuxed)
+   {
+      this->rowsMuxed = rowsMuxed;
+   }
+
+   virtual bool begin();
+   virtual void selectRow(uint8_t row);
+
+   virtual uint8_t getNumberOfRows()
+   {
+      return numberOfRows;
+   }
+
+   virtual bool drivesRows()
+   {
+      return rowPins != FLIGHTSIM_EMPTY_PINS;
+   }
+
+   uint8_t getNumberOfRowPins()
+   {
+      return numberOfRowPins;
+   }
+
+private:
+   uint8_t numberOfRows;
+   uint8_t numberOfRowPins;
+   const uint8_t *rowPins;
+   bool rowsMuxed;
+   uint8_t lastRow;
+};
+
+/*
+ * Switch matrix engine. Storage for the row data is provided by
+ * FlightSimSwitchMatrix, so that the size of a matrix is fixed at compile time.
+ */
+class FlightSimSwitchesBase {
+   friend class MatrixElement;
+
+public:
+   void setNumberOfOutputs(uint8_t rows)
+   {
+      if (checkInitialized(F("setNumberOfRows"), false))
+      {
+         pinInput.setNumberOfRows(rows);
+      }
+   }
+
+   void setNumberOfInputs(uint16_t columns)
+   {
+      if (checkInitialized(F("setNumberOfColumns"), false))
+      {
+         pinInput.setNumberOfColumns(columns);
+      }
+   }
+
+   void setOutputPins(const uint8_t *rowPins)
+   {
+      if (checkInitialized(F("setRowPins"), false))
+      {
+         pinInput.setRowPins(rowPins);
+      }
+   }
+
+   void setInputPins(const uint8_t *columnPins)
+   {
+      if (checkInitialized(F("setColumnPins"), false))
+      {
+         pinInput.setColumnPins(columnPins);
+         this->columnPinsAreDynamic = false;
+      }
+   }
+
+   void setScanRate(uint32_t scanRate)
+   {
+      this->scanRate = scanRate;
+   }
+
+   // SCAN_BACKGROUND can only be selected or left before begin().
+   // SCAN_ROW_BY_ROW and SCAN_BACKGROUND read the rows of a frame one scanRate
+   // period apart, so an element with positions in several rows, e.g. a rotary
+   // switch, may see a move between two of its rows half done for one frame: no
+   // position or two. SCAN_FULL_FRAME reads all rows at once and avoids that
+   void setScanMode(uint8_t scanMode)
+   {
+      if ((scanMode == SCAN_BACKGROUND) || (this->scanMode == SCAN_BACKGROUND))
+      {
+         if (!checkInitialized(F("setScanMode"), false))
+         {
+            return;
+         }
+      }
+      this->scanMode = scanMode;
+   }
+
+   void setRowSettleTime(uint32_t settleTime)
+   {
+      this->settleTime = settleTime;
+   }
+
+   void setDebounce(uint8_t pressSamples, uint8_t releaseSamples)
+   {
+      if (checkInitialized(F("setDebounce"), false))
+      {
+         debouncer.setSamples(pressSamples, releaseSamples);
+      }
+   }
+
+   void setDebounce(uint8_t samples)
+   {
+      setDebounce(samples, samples);
+   }
+
+   // SCAN_ROW_BY_ROW: holds the scanned rows back until the frame is complete, so
+   // that getRowData() and isOn() never mix two frames between loop() calls. The
+   // rows are still read one scanRate period apart, see setScanMode(). Costs two
+   // more planes of row data
+   void setFrameSnapshot(bool frameSnapshot)
+   {
+      if (checkInitialized(F("setFrameSnapshot"), false))
+      {
+         this->frameSnapshot = frameSnapshot;
+      }
+   }
+
+   // shared by all matrices, see FlightSimOutputQueue
+   void setMessageRate(uint16_t messagesPerMillisecond)
+   {
+      FlightSimOutput.setMessageRate(messagesPerMillisecond);
+   }
+
+   void setWriteCoalescing(bool coalesceWrites)
+   {
+      FlightSimOutput.setWriteCoalescing(coalesceWrites);
+   }
+
+   // number of elements resynced per frame, 0: all elements in one frame
+   void setResyncChunkSize(uint16_t resyncChunkSize)
+   {
+      this->resyncChunkSize = resyncChunkSize;
+   }
+
+   void onResyncComplete(void (*fptr)())
+   {
+      resyncCompleteCallback = fptr;
+   }
+
+   void setActiveLow(uint32_t activeLow)
+   {
+      if (checkInitialized(F("setActiveLow"), false))
+      {
+         pinInput.setActiveLow(activeLow);
+      }
+   }
+
+   // replaces the built-in pin matrix (or any other source) by inputSource
+   void setInputSource(FlightSimInputSource *inputSource)
+   {
+      if (checkInitialized(F("setInputSource"), false))
+      {
+         firstSource = NULL;
+         lastSource  = NULL;
+         addSource(inputSource);
+      }
+   }
+
+   void setInputSource(FlightSimInputSource& inputSource)
+   {
+      setInputSource(&inputSource);
+   }
+
+   // adds inputSource below the rows of the sources added before
+   void addInputSource(FlightSimInputSource *inputSource)
+   {
+      if (checkInitialized(F("addInputSource"), false))
+      {
+         addSource(inputSource);
+      }
+   }
+
+   void addInputSource(FlightSimInputSource& inputSource)
+   {
+      addInputSource(&inputSource);
+   }
+
+   void setPortRead(bool portRead)
+   {
+      if (checkInitialized(F("setPortRead"), false))
+      {
+         pinInput.setPortRead(portRead);
+      }
+   }
+
+   void setRowsMultiplexed(uint32_t rowsMuxed)
+   {
+      if (checkInitialized(F("setRowsMultiplexed"), false))
+      {
+         pinInput.setRowsMultiplexed(rowsMuxed);
+      }
+   }
+
+   void begin();
+   void loop();
+
+   // debounced state of the matrix. Elements are dispatched once the last row of
+   // a frame has been read, see setScanMode() for how far apart the rows are read.
+   // Between loop() calls, SCAN_ROW_BY_ROW updates the rows as they are scanned,
+   // unless setFrameSnapshot() holds them back until the frame is complete
+   uint32_t *getRowData()
+   {
+      return rowData;
+   }
+
+   // cells that changed in the last complete frame, same layout as getRowData()
+   uint32_t *getChangedData()
+   {
+      return frameChangedData;
+   }
+
+   // raw data is kept while debouncing or scanning in the background only,
+   // otherwise it is the same as the debounced data
+   uint32_t *getRawRowData()
+   {
+      return rawData ? rawData : rowData;
+   }
+
+   uint8_t getWordsPerRow()
+   {
+      return wordsPerRow;
+   }
+
+   // true in direct pin mode, where element positions are pin numbers
+   bool hasPinPositions()
+   {
+      return pinColumns != NULL;
+   }
+
+   // matrix cell of an element position, see MatrixElement::getPositions()
+   uint32_t getCell(uint32_t position)
+   {
+      if (!pinColumns || (position == NO_POSITION))
+      {
+         return position;
+      }
+      if ((position >= NUM_DIGITAL_PINS) || (pinColumns[position] == NO_COLUMN))
+      {
+         return NO_POSITION;
+      }
+      return MATRIX(0, pinColumns[position]);
+   }
+
+   bool isOn(const uint8_t row, const uint16_t column)
+   {
+      return rowData[row * wordsPerRow + MATRIX_WORD(column)] & _BV32(MATRIX_BIT(column));
+   }
+
+   bool isChanged(const uint8_t row, const uint16_t column)
+   {
+      return frameChangedData[row * wordsPerRow + MATRIX_WORD(column)] & _BV32(MATRIX_BIT(column));
+   }
+
+   bool isRawOn(const uint8_t row, const uint16_t column)
+   {
+      return getRawRowData()[row * wordsPerRow + MATRIX_WORD(column)] & _BV32(MATRIX_BIT(column));
+   }
+
+   void onChangePosition(void (*fptr)(uint8_t, uint8_t, bool))
+   {
+      changePositionCallback = fptr;
+   }
+
+   void onChangeMatrix(void (*fptr)())
+   {
+      changeMatrixCallback = fptr;
+   }
 
-class FlightSimSwitches {
-public:
-   FlightSimSwitches(uint32_t scanRate = DEFAULT_SCAN_RATE, bool activeLow = true);
-   FlightSimSwitches(uint8_t numberOfRows, const uint8_t *rowPins, uint8_t numberOfColumns, const uint8_t *columnPins, uint32_t scanrate = DEFAULT_SCAN_RATE, bool activeLow = true, bool rowsMuxed = false);
-   FlightSimSwitches(uint8_t numberOfColumns, const uint8_t *columnPins, uint32_t scanrate = DEFAULT_SCAN_RATE, bool activeLow = true);
-   void setNumberOfOutputs(uint8_t rows)
+   // records every transition, see FlightSimEventRing
+   void setEventBuffer(FlightSimEventRing *eventBuffer)
    {
-      if (checkInitialized(F("setNumberOfRows"), false))
-      {
-         numberOfRows = rows;
-      }
+      this->eventBuffer = eventBuffer;
    }
 
-   void setNumberOfInputs(uint8_t columns)
+   void setEventBuffer(FlightSimEventRing& eventBuffer)
    {
-      if (checkInitialized(F("setNumberOfColumns"), false))
-      {
-         numberOfColumns = columns;
-      }
+      setEventBuffer(&eventBuffer);
    }
 
-   void setOutputPins(const uint8_t *rowPins)
+   // buffers the debug output of elements, formatted from loop() while it is idle.
+   // Without a buffer, debug output is printed right away
+   void setDebugLog(FlightSimLogRing *debugLog)
    {
-      if (checkInitialized(F("setRowPins"), false))
-      {
-         this->rowPins = rowPins;
-      }
+      this->debugLog = debugLog;
    }
 
-   void setInputPins(const uint8_t *columnPins)
+   void setDebugLog(FlightSimLogRing& debugLog)
    {
-      if (checkInitialized(F("setColumnPins"), false))
-      {
-         this->columnPins = columnPins;
-         this->columnPinsAreDynamic = false;
-      }
+      setDebugLog(&debugLog);
    }
 
-   void setScanRate(uint32_t scanRate)
+   // prints all buffered debug output
+   void flushDebugLog()
    {
-      this->scanRate = scanRate;
+      flushDebugLog(0xffff);
    }
 
-   void setActiveLow(uint32_t activeLow)
+   uint32_t getFrameCount()
    {
-      if (checkInitialized(F("setActiveLow"), false))
-      {
-         this->activeLow = activeLow;
-      }
+      return frameCount;
    }
 
-   void setRowsMultiplexed(uint32_t rowsMuxed)
+   uint32_t getFrameDuration()
    {
-      if (checkInitialized(F("setRowsMultiplexed"), false))
-      {
-         this->rowsMuxed = rowsMuxed;
-      }
+      return frameDuration;
    }
 
-   void begin();
-   void loop();
+   uint32_t getSkippedFrames()
+   {
+      return skippedFrames;
+   }
 
-   uint32_t *getRowData()
+   // frames scanned in the background and dropped because loop() had not
+   // consumed the previous one yet
+   uint32_t getOverruns()
    {
-      return rowData;
+      return overruns;
    }
 
-   bool isOn(const uint8_t row, const uint8_t column)
+   uint16_t getNumberOfElements()
    {
-      return rowData[row] & _BV32(column);
+      return numberOfElements;
    }
 
-   void onChangePosition(void (*fptr)(uint8_t, uint8_t, bool))
+   bool isResyncing()
    {
-      changePositionCallback = fptr;
+      return resyncCursor != NULL;
    }
 
-   void onChangeMatrix(void (*fptr)())
+   uint16_t getResyncRemaining()
    {
-      changeMatrixCallback = fptr;
+      return resyncRemaining;
+   }
+
+   // time since the resync started or, when complete, its total duration in ms
+   uint32_t getResyncTime()
+   {
+      return resyncCursor ? millis() - resyncStart : resyncDuration;
    }
 
    bool hasChanged()
@@ -167,54 +1168,316 @@ public:
    void setDebug(uint32_t debugType);
    void print();
    void printTime(Stream *s);
+   void printTime(Stream *s, uint32_t time);
+   void log(uint8_t event, const _XpRefStr_ *name, float value1 = 0, float value2 = 0, float value3 = 0,
+            int16_t index = 0, bool resync = false);
+
+#ifdef FLIGHTSIM_PROFILING
+   void getProfile(FlightSimProfile *profile);
+   void printProfile();
+   void clearProfile();
+#endif
+
+   static FlightSimSwitchesBase *firstMatrix;
+
+protected:
+   FlightSimSwitchesBase(uint32_t *storage, uint8_t maxRows, uint16_t maxColumns, uint8_t *dynamicColumnPins,
+                         uint32_t scanRate, bool activeLow);
+   FlightSimSwitchesBase(uint32_t *storage, uint8_t maxRows, uint16_t maxColumns, uint8_t *dynamicColumnPins,
+                         uint8_t numberOfRows, const uint8_t *rowPins, uint16_t numberOfColumns, const uint8_t *columnPins,
+                         uint32_t scanRate, bool activeLow, bool rowsMuxed);
 
-   static FlightSimSwitches *firstMatrix;
 private:
    bool checkInitialized(const __FlashStringHelper *message, bool mustBeInitialized);
+   void setStorage(uint32_t *storage, uint8_t maxRows, uint16_t maxColumns, uint8_t *dynamicColumnPins);
+   void init(uint32_t scanRate);
+   void addSource(FlightSimInputSource *source);
+   void findColumnPins();
+   bool beginSources();
    void setRowNumber(uint32_t currentRow);
-   uint32_t getSingleRowData();
+   void readSingleRow(uint32_t *readData);
+   bool skipFrame();
+   void readCurrentRow();
+   bool allocatePlanes();
+   void processRow(uint8_t rowNumber, const uint32_t *raw, uint32_t readTime);
+   void clearChanges();
+   void publishFrame(bool rowsRead);
+   void endOfFrame();
+   FlightSimInputSource *findSource(uint8_t row);
+   bool beginBackgroundScan();
+   void consumeFrame();
+#ifdef FLIGHTSIM_BACKGROUND_SCAN
+   void backgroundScan();
+   static void backgroundScanISR();
+#endif
+
+   bool drivesRows()
+   {
+      return currentSource->drivesRows();
+   }
+   void buildCellIndex();
+   void markChangedCells(uint8_t row, uint8_t word, uint32_t diff);
+   void dispatchElements(bool resync);
+   void handleElement(MatrixElement *elem, bool resync);
+   void flushDebugLog(uint16_t maxRecords);
+   void printLogRecord(const FlightSimLogRecord *record);
+#ifdef FLIGHTSIM_PROFILING
+   void printTiming(const __FlashStringHelper *name, uint32_t min, uint32_t avg, uint32_t max);
+#endif
+   void resyncElements();
+   void clearResynced(MatrixElement *elem);
+   void addPending(MatrixElement *elem);
+   void addElement(MatrixElement *elem);
 
    uint8_t numberOfRows;
-   uint8_t numberOfRowPins;
-   const uint8_t *rowPins;
-   bool rowsMuxed;
 
-   uint8_t numberOfColumns;
+   uint8_t maxRows;
+   uint16_t maxColumns;
+   uint8_t wordsPerRow;
+
+   uint16_t numberOfColumns;
    bool columnPinsAreDynamic;
-   const uint8_t *columnPins;
-   uint8_t dynamicColumnPins[MAX_COLUMNS];
+   uint8_t *dynamicColumnPins;
+   uint16_t *pinColumns;                 // column of each pin if positions are pin numbers, else NULL
+   FlightSimPinMatrixInput pinInput;     // built-in source, used if no other source is set
+   FlightSimInputSource *firstSource;
+   FlightSimInputSource *lastSource;
+   FlightSimInputSource *currentSource;
+   bool debouncePending;
+   uint32_t skippedFrames;
 
-   bool activeLow;
    uint32_t scanRate;
+   uint8_t scanMode;
+   uint32_t settleTime;
    elapsedMillis matrixTimer;
+   uint32_t frameStart;
+   uint32_t frameDuration;
+   uint32_t frameCount;
+
+   MatrixElement *firstElement;
+   MatrixElement *lastElement;
+   uint16_t numberOfElements;
 
    uint8_t currentRow;
-   uint8_t lastRow;
-   uint32_t rowData[MAX_ROWS];
+   uint32_t *staticStorage;              // row data and changed cells, see STORAGE_PLANES
+   uint32_t *planeStorage;               // planes allocated by begin(), see allocatePlanes()
+   bool frameSnapshot;
+   uint32_t *rowData;                    // published frame
+   uint32_t *nextRowData;                // frame being scanned, rowData without snapshot
+   uint32_t *rawData;                    // NULL unless debouncing or scanning in the background
+   uint32_t *debounceCounters;           // NULL unless debouncing
+   uint32_t *frameChangedData;           // changes of the published frame
+   uint32_t *changedData;                // changes of the frame being scanned, frameChangedData without snapshot
+   uint32_t *scanData;                   // row data being read in the background, swapped with rawData
+   FlightSimCellOwner *cellIndex;
+   size_t cellIndexSize;
+   bool dispatchAll;
+   uint16_t pollingElements;
+   uint16_t unindexedElements;
+   MatrixElement *firstPending;
+   MatrixElement *lastPending;
+   FlightSimDebouncer debouncer;
    bool initialized;
    bool hasChangedLoop;
    bool hasChangedPoll;
    bool lastEnabled;
+   MatrixElement *resyncCursor;          // next element to resync, NULL if not resyncing
+   uint16_t resyncChunkSize;
+   uint16_t resyncRemaining;
+   uint32_t resyncStart;
+   uint32_t resyncDuration;
 
    bool debugScan;
    bool debugConfig;
 
    void (*changePositionCallback)(uint8_t, uint8_t, bool);
    void (*changeMatrixCallback)();
+   void (*resyncCompleteCallback)();
+   FlightSimEventRing *eventBuffer;
+   FlightSimLogRing *debugLog;
+
+   // background scan: the timer interrupt reads into scanData and hands over a
+   // complete frame by swapping it with rawData and setting frameReady. Until
+   // loop() clears frameReady the interrupt leaves rawData alone.
+   volatile bool frameReady;
+   volatile uint32_t overruns;
+   volatile uint32_t scanFrameTime;      // micros() at row 0 of the frame in rawData
+   uint32_t scanStart;                   // micros() at row 0 of the frame in scanData
+   uint8_t scanRow;
+#ifdef FLIGHTSIM_BACKGROUND_SCAN
+   IntervalTimer scanTimer;
+   static FlightSimSwitchesBase *backgroundMatrix;
+#endif
+
+#ifdef FLIGHTSIM_PROFILING
+   FlightSimTiming rowSelectTiming;
+   FlightSimTiming rowReadTiming;
+   FlightSimTiming dispatchTiming;
+   MatrixElement *slowestElement;
+   uint32_t slowestElementCycles;
+   uint32_t profileFrames;
+   uint32_t profileStart;
+#endif
+};
+
+
+/*
+ * Switch matrix with compile time size. Rows and columns are the maximum values,
+ * the actual size is set through the constructor or the setter methods.
+ */
+template <uint8_t Rows, uint16_t Columns>
+class FlightSimSwitchMatrix : public FlightSimSwitchesBase {
+   static_assert((Rows > 0) && (Rows <= MAX_MATRIX_ROWS), "FlightSimSwitchMatrix: invalid number of rows");
+   static_assert((Columns > 0) && (Columns <= MAX_MATRIX_COLUMNS), "FlightSimSwitchMatrix: invalid number of columns");
+
+public:
+   FlightSimSwitchMatrix(uint32_t scanRate = DEFAULT_SCAN_RATE, bool activeLow = true)
+      : FlightSimSwitchesBase(storage, Rows, Columns, dynamicColumnPins, scanRate, activeLow)
+   {
+   }
+
+   FlightSimSwitchMatrix(uint8_t numberOfRows, const uint8_t *rowPins, uint16_t numberOfColumns, const uint8_t *columnPins,
+                         uint32_t scanRate = DEFAULT_SCAN_RATE, bool activeLow = true, bool rowsMuxed = false)
+      : FlightSimSwitchesBase(storage, Rows, Columns, dynamicColumnPins,
+                              numberOfRows, rowPins, numberOfColumns, columnPins, scanRate, activeLow, rowsMuxed)
+   {
+   }
+
+   FlightSimSwitchMatrix(uint16_t numberOfColumns, const uint8_t *columnPins, uint32_t scanRate = DEFAULT_SCAN_RATE, bool activeLow = true)
+      : FlightSimSwitchesBase(storage, Rows, Columns, dynamicColumnPins,
+                              1, FLIGHTSIM_EMPTY_PINS, numberOfColumns, columnPins, scanRate, activeLow, false)
+   {
+   }
+
+private:
+   uint32_t storage[MATRIX_STORAGE(Rows, Columns)];
+   uint8_t dynamicColumnPins[Columns];
+};
+
+typedef FlightSimSwitchMatrix<MAX_ROWS, MAX_COLUMNS> FlightSimSwitches;
+
+
+/*
+ * Positions of a multi-position switch fixed at compile time:
+ *
+ *    typedef FlightSimPositions<MATRIX(2, 0), MATRIX(2, 1), MATRIX(2, 2)> FuelPumpPositions;
+ *    static_assert(FuelPumpPositions::fits(8, 16), "fuel pump is not on the panel");
+ *
+ *    const float fuelPumpValues[] = { 0, 1, 2 };
+ *    FlightSimUpDownCommandSwitch fuelPump(matrix, FuelPumpPositions(), fuelPumpValues);
+ *
+ * The table is a constant, so it needs no RAM on boards that keep constants in
+ * flash, and the number of values is checked against the number of positions.
+ */
+template <uint32_t... Positions>
+struct FlightSimPositions {
+   static constexpr uint8_t  count = sizeof...(Positions);
+   static constexpr uint32_t positions[] = { Positions... };
+
+   // true if all positions are on a matrix of the given size
+   static constexpr bool fits(uint8_t rows, uint16_t columns)
+   {
+      for (uint8_t i = 0; i < count; i++)
+      {
+         if ((positions[i] != NO_POSITION) && ((MATRIX_ROW(positions[i]) >= rows) || (MATRIX_COLUMN(positions[i]) >= columns)))
+         {
+            return false;
+         }
+      }
+      return true;
+   }
+};
+
+template <uint32_t... Positions>
+constexpr uint32_t FlightSimPositions<Positions...>::positions[];
+
+
+/*
+ * Sorted index of the value table of a multi-position switch. Values closer
+ * than the tolerance are one detent (step). Maps a dataref value to the nearest
+ * position and counts the detents between two values by binary search, so the
+ * cost does not grow with the number of positions.
+ *
+ * Built on first use and rebuilt when the tolerance changes. Without memory for
+ * the index, the lookups scan the value table and countSteps() counts 1.
+ */
+class FlightSimValueIndex {
+public:
+   FlightSimValueIndex()
+   {
+      steps             = NULL;
+      positionSteps     = NULL;
+      stepPositions     = NULL;
+      numberOfSteps     = 0;
+      values            = NULL;
+      numberOfPositions = 0;
+      built             = false;
+      failed            = false;
+   }
+
+   ~FlightSimValueIndex()
+   {
+      free(steps);
+   }
+
+   void invalidate()
+   {
+      built  = false;
+      failed = false;
+   }
+
+   // false if there is not enough memory, values is used by the lookups then
+   bool build(uint8_t numberOfPositions, const float *values, float tolerance);
+   int8_t findPosition(float value);
+   uint8_t countSteps(float from, float to);
+
+   // detent number (0: lowest value) of a position
+   uint8_t getStep(uint8_t position);
+
+   uint8_t getNumberOfSteps()
+   {
+      return numberOfSteps;
+   }
+
+   bool isBuilt()
+   {
+      return built;
+   }
+
+   // build() ran out of memory, it is not tried again until invalidate()
+   bool hasFailed()
+   {
+      return failed;
+   }
+
+private:
+   uint8_t countBelow(float value, bool orEqual);
+   bool isFirstOfStep(uint8_t position);
+
+   float *steps;                       // ascending detent values
+   uint8_t *positionSteps;             // position -> detent
+   uint8_t *stepPositions;             // detent -> first position with that value
+   uint8_t numberOfSteps;
+   const float *values;                // value table of the switch
+   uint8_t numberOfPositions;
+   float tolerance;
+   bool built;
+   bool failed;
 };
 
 
 class MatrixElement {
-   friend class FlightSimSwitches;
+   friend class FlightSimSwitchesBase;
 
 public:
-   MatrixElement(FlightSimSwitches *matrix);
-   MatrixElement(FlightSimSwitches& matrix) : MatrixElement(&matrix)
+   MatrixElement(FlightSimSwitchesBase *matrix);
+   MatrixElement(FlightSimSwitchesBase& matrix) : MatrixElement(&matrix)
    {
    }
 
    virtual ~MatrixElement()
    {
+      free(positionGroups);
    }
 
    void setDebug(bool debug)
@@ -237,40 +1500,77 @@ public:
       callbackContext    = info;
    }
 
+   // number of positions found active on the last evaluation. More than one
+   // on a multi-position switch points to a wiring fault
+   uint8_t getActivePositions()
+   {
+      return activePositions;
+   }
+
+   bool hasWiringFault()
+   {
+      return activePositions > 1;
+   }
+
+   // dispatched every frame, not only when one of its cells changes
+   bool isPolling()
+   {
+      return polling;
+   }
+
 protected:
-   FlightSimSwitches *matrix;
+   FlightSimSwitchesBase *matrix;
    MatrixElement *nextElement;
-   static MatrixElement *firstElement;
-   static MatrixElement *lastElement;
    static bool lastEnabled;
    void (*change_callback)(float);
    void *callbackContext;
    bool hasCallbackContext;
    bool debug;
+   bool polling;
+   bool indexed;
+   bool pending;
+   bool resynced;                        // resynced in the current frame
+   MatrixElement *nextPending;
+   FlightSimPositionGroup *positionGroups;
+   uint8_t numberOfGroups;
+   uint8_t activePositions;
    bool getPositionData(uint32_t position);
+   void buildPositionGroups();
+   int8_t findActivePosition();
+   int8_t findFirstPosition();
+   FlightSimValueIndex *useValueIndex(FlightSimValueIndex *index, uint8_t numberOfPositions, const float *values, float tolerance);
    virtual void handleLoop(bool resync) = 0;
    virtual uint32_t getDebugMask() = 0;
    void callback(float newValue);
-   size_t setGenericPinData(uint8_t *destination, uint32_t startPinIndex, uint32_t *matrixPositions, size_t count);
 
-   virtual size_t setPinData(uint8_t *pinBuffer, size_t startPinIndex)
+   // called by FlightSimSwitchesBase::begin() once the matrix is set up
+   virtual void beginElement()
+   {
+   }
+
+   // positions read by the element. Without row and column pins (direct pin
+   // mode), positions are pin numbers and also select the column pins
+   virtual size_t getPositions(const uint32_t **positions)
    {
+      *positions = NULL;
       return 0;
    }
+
+   void setPolling(bool polling);
 };
 
 class FlightSimOnOffCommandSwitch : public MatrixElement {
 public:
-   FlightSimOnOffCommandSwitch(FlightSimSwitches *matrix, uint32_t matrixPosition);
+   FlightSimOnOffCommandSwitch(FlightSimSwitchesBase *matrix, uint32_t matrixPosition);
    FlightSimOnOffCommandSwitch(uint32_t matrixPosition) : FlightSimOnOffCommandSwitch(FlightSimSwitches::firstMatrix, matrixPosition)
    {
    }
 
-   FlightSimOnOffCommandSwitch(FlightSimSwitches& matrix, uint32_t matrixPosition) : FlightSimOnOffCommandSwitch(&matrix, matrixPosition)
+   FlightSimOnOffCommandSwitch(FlightSimSwitchesBase& matrix, uint32_t matrixPosition) : FlightSimOnOffCommandSwitch(&matrix, matrixPosition)
    {
    }
 
-   FlightSimOnOffCommandSwitch(FlightSimSwitches& matrix) : FlightSimOnOffCommandSwitch(&matrix, NO_POSITION)
+   FlightSimOnOffCommandSwitch(FlightSimSwitchesBase& matrix) : FlightSimOnOffCommandSwitch(&matrix, NO_POSITION)
    {
    }
 
@@ -291,9 +1591,11 @@ protected:
    void setOffCommandOnly(const _XpRefStr_ *offCommand);
    virtual void handleLoop(bool resync);
 
-   virtual size_t setPinData(uint8_t *pinBuffer, size_t startPinIndex)
+
+   virtual size_t getPositions(const uint32_t **positions)
    {
-      return setGenericPinData(pinBuffer, startPinIndex, &matrixPosition, 1);
+      *positions = &matrixPosition;
+      return 1;
    }
 
    virtual uint32_t getDebugMask()
@@ -314,7 +1616,7 @@ private:
 
 class FlightSimOnCommandSwitch : public FlightSimOnOffCommandSwitch {
 public:
-   FlightSimOnCommandSwitch(FlightSimSwitches *matrix, uint32_t matrixPosition) : FlightSimOnOffCommandSwitch(matrix, matrixPosition)
+   FlightSimOnCommandSwitch(FlightSimSwitchesBase *matrix, uint32_t matrixPosition) : FlightSimOnOffCommandSwitch(matrix, matrixPosition)
    {
    }
 
@@ -322,11 +1624,11 @@ public:
    {
    }
 
-   FlightSimOnCommandSwitch(FlightSimSwitches& matrix, uint32_t matrixPosition) : FlightSimOnCommandSwitch(&matrix, matrixPosition)
+   FlightSimOnCommandSwitch(FlightSimSwitchesBase& matrix, uint32_t matrixPosition) : FlightSimOnCommandSwitch(&matrix, matrixPosition)
    {
    }
 
-   FlightSimOnCommandSwitch(FlightSimSwitches& matrix) : FlightSimOnCommandSwitch(&matrix, NO_POSITION)
+   FlightSimOnCommandSwitch(FlightSimSwitchesBase& matrix) : FlightSimOnCommandSwitch(&matrix, NO_POSITION)
    {
    }
 
@@ -359,7 +1661,7 @@ protected:
 
 class FlightSimOffCommandSwitch : public FlightSimOnOffCommandSwitch {
 public:
-   FlightSimOffCommandSwitch(FlightSimSwitches *matrix, uint32_t matrixPosition) : FlightSimOnOffCommandSwitch(matrix, matrixPosition)
+   FlightSimOffCommandSwitch(FlightSimSwitchesBase *matrix, uint32_t matrixPosition) : FlightSimOnOffCommandSwitch(matrix, matrixPosition)
    {
    }
 
@@ -367,11 +1669,11 @@ public:
    {
    }
 
-   FlightSimOffCommandSwitch(FlightSimSwitches& matrix, uint32_t matrixPosition) : FlightSimOffCommandSwitch(&matrix, matrixPosition)
+   FlightSimOffCommandSwitch(FlightSimSwitchesBase& matrix, uint32_t matrixPosition) : FlightSimOffCommandSwitch(&matrix, matrixPosition)
    {
    }
 
-   FlightSimOffCommandSwitch(FlightSimSwitches& matrix) : FlightSimOffCommandSwitch(&matrix, NO_POSITION)
+   FlightSimOffCommandSwitch(FlightSimSwitchesBase& matrix) : FlightSimOffCommandSwitch(&matrix, NO_POSITION)
    {
    }
 
@@ -404,13 +1706,13 @@ protected:
 
 class FlightSimPushbutton : public MatrixElement {
 public:
-   FlightSimPushbutton(FlightSimSwitches *matrix, uint32_t matrixPosition, bool inverted = false);
+   FlightSimPushbutton(FlightSimSwitchesBase *matrix, uint32_t matrixPosition, bool inverted = false);
 
    FlightSimPushbutton(uint32_t matrixPosition, bool inverted = false) : FlightSimPushbutton(FlightSimSwitches::firstMatrix, matrixPosition, inverted)
    {
    }
 
-   FlightSimPushbutton(FlightSimSwitches& matrix, uint32_t matrixPosition, bool inverted = false) : FlightSimPushbutton(&matrix, matrixPosition, inverted)
+   FlightSimPushbutton(FlightSimSwitchesBase& matrix, uint32_t matrixPosition, bool inverted = false) : FlightSimPushbutton(&matrix, matrixPosition, inverted)
    {
    }
 
@@ -445,9 +1747,11 @@ public:
 protected:
    virtual void handleLoop(bool resync);
 
-   virtual size_t setPinData(uint8_t *pinBuffer, size_t startPinIndex)
+
+   virtual size_t getPositions(const uint32_t **positions)
    {
-      return setGenericPinData(pinBuffer, startPinIndex, &matrixPosition, 1);
+      *positions = &matrixPosition;
+      return 1;
    }
 
    virtual uint32_t getDebugMask()
@@ -464,20 +1768,34 @@ protected:
 
 class FlightSimUpDownCommandSwitch : public MatrixElement {
 public:
-   FlightSimUpDownCommandSwitch(FlightSimSwitches *matrix, uint8_t numberOfPositions, uint32_t *positions, float *values, float defaultValue = 0, float tolerance = DEFAULT_TOLERANCE);
+   FlightSimUpDownCommandSwitch(FlightSimSwitchesBase *matrix, uint8_t numberOfPositions, const uint32_t *positions, const float *values, float defaultValue = 0, float tolerance = DEFAULT_TOLERANCE);
 
-   FlightSimUpDownCommandSwitch(FlightSimSwitches& matrix,
-                                uint8_t numberOfPositions, uint32_t *positions, float *values, float defaultValue = 0, float tolerance = DEFAULT_TOLERANCE) :
+   FlightSimUpDownCommandSwitch(FlightSimSwitchesBase& matrix,
+                                uint8_t numberOfPositions, const uint32_t *positions, const float *values, float defaultValue = 0, float tolerance = DEFAULT_TOLERANCE) :
       FlightSimUpDownCommandSwitch(&matrix, numberOfPositions, positions, values, defaultValue, tolerance)
    {
    }
 
    FlightSimUpDownCommandSwitch(
-      uint8_t numberOfPositions, uint32_t *positions, float *values, float defaultValue = 0, float tolerance = DEFAULT_TOLERANCE) :
+      uint8_t numberOfPositions, const uint32_t *positions, const float *values, float defaultValue = 0, float tolerance = DEFAULT_TOLERANCE) :
       FlightSimUpDownCommandSwitch(FlightSimSwitches::firstMatrix, numberOfPositions, positions, values, defaultValue, tolerance)
    {
    }
 
+   template <uint32_t... Positions>
+   FlightSimUpDownCommandSwitch(FlightSimSwitchesBase& matrix, FlightSimPositions<Positions...>,
+                                const float (&values)[sizeof...(Positions)], float defaultValue = 0, float tolerance = DEFAULT_TOLERANCE) :
+      FlightSimUpDownCommandSwitch(&matrix, sizeof...(Positions), FlightSimPositions<Positions...>::positions, values, defaultValue, tolerance)
+   {
+   }
+
+   template <uint32_t... Positions>
+   FlightSimUpDownCommandSwitch(FlightSimPositions<Positions...>,
+                                const float (&values)[sizeof...(Positions)], float defaultValue = 0, float tolerance = DEFAULT_TOLERANCE) :
+      FlightSimUpDownCommandSwitch(FlightSimSwitches::firstMatrix, sizeof...(Positions), FlightSimPositions<Positions...>::positions, values, defaultValue, tolerance)
+   {
+   }
+
    void setDefaultValue(float defaultValue)
    {
       this->defaultValue = defaultValue;
@@ -486,6 +1804,7 @@ public:
    void setTolerance(float tolerance)
    {
       this->tolerance = tolerance;
+      detents.invalidate();
    }
 
    void setDatarefAndCommands(const _XpRefStr_ *positionDataref, const _XpRefStr_ *upCommand, const _XpRefStr_ *downCommand);
@@ -508,8 +1827,15 @@ public:
 
    inline uint8_t getNumberOfPositions() {return numberOfPositions;}
 
+   // position whose value is nearest to value, -1 without positions
+   int8_t findPosition(float value);
+
+   // detent of a position, counted from the lowest value
+   uint8_t getStep(uint8_t position);
+
    void setFindPositionFunction(int8_t (*fptr)()) {
       findposition_callback=fptr;
+      setPolling(fptr != NULL);
    }
 
    void setPushbuttonPosition(const uint8_t pushbuttonPosition)
@@ -517,15 +1843,75 @@ public:
       this->pushbuttonPositions |= _BV32(pushbuttonPosition);
    }
 
+   // up/down commands sent before the dataref has followed, 1: one command at a time
+   void setMaxPendingCommands(uint8_t maxPendingCommands)
+   {
+      this->maxPendingCommands = maxPendingCommands ? maxPendingCommands : 1;
+   }
+
+   // ms without dataref movement after which pending commands are considered lost
+   void setCommandTimeout(uint16_t commandTimeout)
+   {
+      this->commandTimeout = commandTimeout;
+   }
+
+   // resends after a timeout before the dataref is considered unreachable. With
+   // backoff, the timeout doubles on every retry
+   void setCommandRetries(uint8_t maxRetries, bool retryBackoff = true)
+   {
+      this->maxRetries   = maxRetries;
+      this->retryBackoff = retryBackoff;
+   }
+
+   // the dataref did not follow the commands. No more commands are sent and the
+   // dataref is not polled until the switch moves again or X-Plane restarts
+   bool isUnreachable()
+   {
+      return unreachable;
+   }
+
+   // number of times the switch became unreachable
+   uint32_t getStalls()
+   {
+      return stalls;
+   }
+
+   // time in ms from a switch change until the dataref reached the switch value
+   uint32_t getConvergenceTime()
+   {
+      return lastConvergenceTime;
+   }
+
+   uint32_t getMaxConvergenceTime()
+   {
+      return maxConvergenceTime;
+   }
+
+   uint32_t getAverageConvergenceTime()
+   {
+      return convergences ? totalConvergenceTime / convergences : 0;
+   }
+
+   uint32_t getCommandTimeouts()
+   {
+      return commandTimeouts;
+   }
+
    virtual float getValue();
 
 protected:
    virtual float findValue(int8_t *valueIndex);
    virtual void handleLoop(bool resync);
+   void trackSwitch(bool resync);
+   void sendCommands(bool up, uint8_t count, bool hold, uint8_t priority);
+   uint32_t getRetryTimeout();
+   uint8_t countSteps(float from, float to);
+
 
-   virtual size_t setPinData(uint8_t *pinBuffer, size_t startPinIndex)
+   virtual size_t getPositions(const uint32_t **positions)
    {
-      return setGenericPinData(pinBuffer, startPinIndex, matrixPositions, numberOfPositions);
+      *positions = matrixPositions;
+      return numberOfPositions;
    }
 
    virtual uint32_t getDebugMask()
@@ -535,40 +1921,70 @@ protected:
 
 private:
    uint8_t numberOfPositions;
-   uint32_t *matrixPositions;
+   const uint32_t *matrixPositions;
    uint32_t pushbuttonPositions;
    FlightSimCommand *pushbuttonCommand;
-   float *values;
+   const float *values;
    float defaultValue;
    float tolerance;
+   FlightSimValueIndex detents;
 
    bool switchChanged;
    const _XpRefStr_ *name;
    FlightSimFloat positionDataref;
    FlightSimCommand upCommand;
    FlightSimCommand downCommand;
-   bool commandSent;
+   uint8_t pendingCommands;              // sent, dataref has not followed yet
+   bool pendingUp;
+   uint8_t maxPendingCommands;
+   uint16_t commandTimeout;
+   uint32_t commandTime;                 // last command sent or dataref movement
+   uint8_t retries;
+   uint8_t maxRetries;
+   bool retryBackoff;
+   bool unreachable;
+   uint32_t stalls;
    float oldDatarefValue;
+   uint32_t changeTime;
+   uint32_t lastConvergenceTime;
+   uint32_t maxConvergenceTime;
+   uint32_t totalConvergenceTime;
+   uint32_t convergences;
+   uint32_t commandTimeouts;
    float oldSwitchValue;
    int8_t (*findposition_callback)();
 };
 
 class FlightSimWriteDatarefSwitch : public MatrixElement {
 public:
-   FlightSimWriteDatarefSwitch(FlightSimSwitches *matrix, uint8_t numberOfPositions, uint32_t *positions, float *values, float defaultValue = 0, float tolerance = DEFAULT_TOLERANCE);
+   FlightSimWriteDatarefSwitch(FlightSimSwitchesBase *matrix, uint8_t numberOfPositions, const uint32_t *positions, const float *values, float defaultValue = 0, float tolerance = DEFAULT_TOLERANCE);
 
    FlightSimWriteDatarefSwitch(
-      uint8_t numberOfPositions, uint32_t *positions, float *values, float defaultValue = 0, float tolerance = DEFAULT_TOLERANCE)
+      uint8_t numberOfPositions, const uint32_t *positions, const float *values, float defaultValue = 0, float tolerance = DEFAULT_TOLERANCE)
       : FlightSimWriteDatarefSwitch(FlightSimSwitches::firstMatrix, numberOfPositions, positions, values, defaultValue, tolerance)
    {
    }
 
-   FlightSimWriteDatarefSwitch(FlightSimSwitches& matrix,
-                               uint8_t numberOfPositions, uint32_t *positions, float *values, float defaultValue = 0, float tolerance = DEFAULT_TOLERANCE)
+   FlightSimWriteDatarefSwitch(FlightSimSwitchesBase& matrix,
+                               uint8_t numberOfPositions, const uint32_t *positions, const float *values, float defaultValue = 0, float tolerance = DEFAULT_TOLERANCE)
       : FlightSimWriteDatarefSwitch(&matrix, numberOfPositions, positions, values, defaultValue, tolerance)
    {
    }
 
+   template <uint32_t... Positions>
+   FlightSimWriteDatarefSwitch(FlightSimSwitchesBase& matrix, FlightSimPositions<Positions...>,
+                               const float (&values)[sizeof...(Positions)], float defaultValue = 0, float tolerance = DEFAULT_TOLERANCE)
+      : FlightSimWriteDatarefSwitch(&matrix, sizeof...(Positions), FlightSimPositions<Positions...>::positions, values, defaultValue, tolerance)
+   {
+   }
+
+   template <uint32_t... Positions>
+   FlightSimWriteDatarefSwitch(FlightSimPositions<Positions...>,
+                               const float (&values)[sizeof...(Positions)], float defaultValue = 0, float tolerance = DEFAULT_TOLERANCE)
+      : FlightSimWriteDatarefSwitch(FlightSimSwitches::firstMatrix, sizeof...(Positions), FlightSimPositions<Positions...>::positions, values, defaultValue, tolerance)
+   {
+   }
+
    inline bool isPinOn(uint8_t position) {
       if (position >= numberOfPositions) {
          return 0;
@@ -587,8 +2003,15 @@ public:
 
    inline size_t getNumberOfPositions() {return numberOfPositions;}
 
+   // position whose value is nearest to value, -1 without positions
+   int8_t findPosition(float value);
+
+   // detent of a position, counted from the lowest value
+   uint8_t getStep(uint8_t position);
+
    void setFindPositionFunction(int8_t (*fptr)()) {
       findposition_callback=fptr;
+      setPolling(fptr != NULL);
    }
 
    void setDefaultValue(float defaultValue)
@@ -599,6 +2022,7 @@ public:
    void setTolerance(float tolerance)
    {
       this->tolerance = tolerance;
+      detents.invalidate();
    }
 
    void setDataref(const _XpRefStr_ *positionDataref);
@@ -615,9 +2039,11 @@ protected:
    virtual float findValue();
    virtual void handleLoop(bool resync);
 
-   virtual size_t setPinData(uint8_t *pinBuffer, size_t startPinIndex)
+
+   virtual size_t getPositions(const uint32_t **positions)
    {
-      return setGenericPinData(pinBuffer, startPinIndex, matrixPositions, numberOfPositions);
+      *positions = matrixPositions;
+      return numberOfPositions;
    }
 
    virtual uint32_t getDebugMask()
@@ -627,10 +2053,11 @@ protected:
 
 private:
    uint8_t numberOfPositions;
-   uint32_t *matrixPositions;
+   const uint32_t *matrixPositions;
    float oldSwitchValue;
-   float *values;
+   const float *values;
    float tolerance;
+   FlightSimValueIndex detents;
    float defaultValue;
    const _XpRefStr_ *name;
    FlightSimFloat positionDataref;
@@ -639,9 +2066,9 @@ private:
 
 class FlightSimOnOffDatarefSwitch : public MatrixElement {
 public:
-   FlightSimOnOffDatarefSwitch(FlightSimSwitches *matrix, uint32_t position, bool inverted = false);
+   FlightSimOnOffDatarefSwitch(FlightSimSwitchesBase *matrix, uint32_t position, bool inverted = false);
 
-   FlightSimOnOffDatarefSwitch(FlightSimSwitches& matrix, uint32_t position, bool inverted = false)
+   FlightSimOnOffDatarefSwitch(FlightSimSwitchesBase& matrix, uint32_t position, bool inverted = false)
       : FlightSimOnOffDatarefSwitch(&matrix, position, inverted)
    {
    }
@@ -651,7 +2078,7 @@ public:
    {
    }
 
-   FlightSimOnOffDatarefSwitch(FlightSimSwitches& matrix)
+   FlightSimOnOffDatarefSwitch(FlightSimSwitchesBase& matrix)
       : FlightSimOnOffDatarefSwitch(&matrix, NO_POSITION, false)
    {
    }
@@ -689,9 +2116,11 @@ protected:
       return DEBUG_SWITCHES_ONOFF_DATAREF;
    }
 
-   virtual size_t setPinData(uint8_t *pinBuffer, size_t startPinIndex)
+
+   virtual size_t getPositions(const uint32_t **positions)
    {
-      return setGenericPinData(pinBuffer, startPinIndex, &matrixPosition, 1);
+      *positions = &matrixPosition;
+      return 1;
    }
 
 private:
@@ -702,4 +2131,137 @@ private:
    FlightSimInteger dataref;
 };
 
+/*
+ * Rotary encoder. Decodes the quadrature signals on two positions (A and B) and
+ * sends one up or down command per detent.
+ *
+ * On a matrix, the signals are sampled once per frame, so the scan rate limits
+ * the rotation speed: a frame that misses a quadrature state loses the step. In
+ * direct pin mode, setInterrupts(true) decodes every edge in a pin change
+ * interrupt and the frame only sends the accumulated detents.
+ *
+ * An encoder is relative: a resync has no state to send again, and detents
+ * turned while X-Plane was not running are not repeated.
+ */
+class FlightSimEncoder : public MatrixElement {
+public:
+   FlightSimEncoder(FlightSimSwitchesBase *matrix, uint32_t positionA, uint32_t positionB);
+
+   FlightSimEncoder(FlightSimSwitchesBase& matrix, uint32_t positionA, uint32_t positionB)
+      : FlightSimEncoder(&matrix, positionA, positionB)
+   {
+   }
+
+   FlightSimEncoder(uint32_t positionA, uint32_t positionB)
+      : FlightSimEncoder(FlightSimSwitches::firstMatrix, positionA, positionB)
+   {
+   }
+
+   FlightSimEncoder(FlightSimSwitchesBase& matrix)
+      : FlightSimEncoder(&matrix, NO_POSITION, NO_POSITION)
+   {
+   }
+
+   FlightSimEncoder()
+      : FlightSimEncoder(FlightSimSwitches::firstMatrix, NO_POSITION, NO_POSITION)
+   {
+   }
+
+   // detaches the pin change interrupts and frees the interrupt slot
+   virtual ~FlightSimEncoder();
+
+   void setPositions(uint32_t positionA, uint32_t positionB)
+   {
+      this->positions[0] = positionA;
+      this->positions[1] = positionB;
+   }
+
+   void setCommands(const _XpRefStr_ *upCommand, const _XpRefStr_ *downCommand);
+
+   // quadrature steps per detent: 4 for most encoders, 2 or 1 for half and
+   // quarter cycle types
+   void setStepsPerDetent(uint8_t stepsPerDetent)
+   {
+      this->stepsPerDetent = stepsPerDetent ? stepsPerDetent : 1;
+   }
+
+   // a detent less than fastInterval ms after the previous one sends factor
+   // commands. Default factor 1: no acceleration
+   void setAcceleration(uint16_t fastInterval, uint8_t factor)
+   {
+      this->fastInterval = fastInterval;
+      this->fastFactor   = factor ? factor : 1;
+   }
+
+   // for commands that X-Plane repeats while held: several detents in a frame
+   // (at least minCommands) begin the command and end it after repeatInterval ms
+   // per detent, instead of sending each command. 0: always send the commands
+   void setHoldRepeat(uint16_t repeatInterval, uint8_t minCommands = 2)
+   {
+      this->repeatInterval  = repeatInterval;
+      this->minHoldCommands = minCommands;
+   }
+
+   // decode in pin change interrupts, direct pin mode only. Call before begin()
+   void setInterrupts(bool interrupts)
+   {
+      this->useInterrupts = interrupts;
+   }
+
+   // detents turned since begin(), up counts positive
+   virtual float getValue();
+
+   // quadrature steps that skipped a state (both signals changed at once)
+   uint32_t getMissedSteps();
+
+protected:
+   virtual void handleLoop(bool resync);
+   virtual void beginElement();
+   void decode(uint8_t state);
+   void endHold();
+
+   virtual size_t getPositions(const uint32_t **positions)
+   {
+      *positions = this->positions;
+      return 2;
+   }
+
+   virtual uint32_t getDebugMask()
+   {
+      return DEBUG_SWITCHES_ENCODER;
+   }
+
+private:
+   static void handleInterrupt(uint8_t slot);
+   template <uint8_t Slot>
+   static void interrupt()
+   {
+      handleInterrupt(Slot);
+   }
+   static FlightSimEncoder *interruptEncoders[MAX_INTERRUPT_ENCODERS];
+   static void (*const interruptFunctions[MAX_INTERRUPT_ENCODERS])();
+
+   uint32_t positions[2];
+   bool useInterrupts;
+   bool interruptsAttached;
+   uint8_t state;                        // last A/B levels, A in bit 1
+   volatile int16_t steps;               // not turned into detents yet, see handleLoop()
+   volatile uint32_t missedSteps;
+   uint8_t stepsPerDetent;
+   uint16_t fastInterval;
+   uint8_t fastFactor;
+   uint32_t detentTime;
+   int32_t detents;
+   uint16_t repeatInterval;
+   uint8_t minHoldCommands;
+   FlightSimCommand *holdCommand;        // begun, ends at holdEnd
+   uint32_t holdEnd;
+   const _XpRefStr_ *upName;
+   const _XpRefStr_ *downName;
+   FlightSimCommand upCommand;
+   FlightSimCommand downCommand;
+};
+
+#include "FlightSimInputSources.h"
+
 #endif // _FLIGHTSIM_SWITCHES_H